@@ -1,4 +1,5 @@
 #include "Application.h"
+#include "Profiler.h"
 #include "resource.h"
 #include "shobjidl_core.h"
 #include "atlstr.h"
@@ -9,15 +10,17 @@
 INT_PTR CALLBACK About(HWND, UINT, WPARAM, LPARAM);
 static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
-Application::Application() :
+Application::Application(bool benchmarkMode) :
 	instance(nullptr),
 	wnd(nullptr),
 	title{},
 	windowClass{},
 	openGLContext(nullptr),
-	graphics(nullptr),
+	renderThread(nullptr),
 	isInit(false),
-	isClosing(false)
+	benchmarkMode(benchmarkMode),
+	isClosing(false),
+	continuous(false)
 {
 	openGLContext = new OpenGL(wnd);
 
@@ -29,9 +32,16 @@ Application::Application() :
 		return;
 	}
 
+	// A benchmark creates its own Graphics for every model it measures, on this thread.
+	if (benchmarkMode)
+	{
+		isInit = true;
+		return;
+	}
+
 	try
 	{
-		graphics = new Graphics(openGLContext);
+		renderThread = new RenderThread(openGLContext, wnd);
 		isInit = true;
 	}
 	catch (const std::exception& e)
@@ -43,9 +53,10 @@ Application::Application() :
 
 Application::~Application()
 {
-	if (graphics)
+	// The render thread hands the context back before it is deleted.
+	if (renderThread)
 	{
-		delete graphics;
+		delete renderThread;
 	}
 
 	if (openGLContext)
@@ -56,6 +67,8 @@ Application::~Application()
 	closeWindow();
 }
 
+// The window's thread only handles messages; drawing, uploads and waiting on the GPU
+// all happen on the render thread, which the handlers feed with commands.
 void Application::run() const
 {
 	if (!isInit)
@@ -64,43 +77,84 @@ void Application::run() const
 	}
 
 	MSG msg = {};
+	while (!isClosing && GetMessage(&msg, nullptr, 0, 0) > 0)
+	{
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+}
 
-	bool done = false;
-	while (!done)
+void Application::setContinuous(bool enabled)
+{
+	continuous = enabled;
+	post(RenderCommand::Type::SetContinuous, continuous ? 1 : 0);
+}
+
+// Models loaded afterwards store 16-bit positions.
+void Application::setQuantizedPositions(bool enabled)
+{
+	post(RenderCommand::Type::SetQuantizedPositions, enabled ? 1 : 0);
+}
+
+bool Application::benchmark(const Benchmark::Settings& settings)
+{
+	if (!isInit)
 	{
-		if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
-		{
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-		}
+		return false;
+	}
 
-		if (msg.message == WM_QUIT)
-		{
-			done = true;
-		}
-		else
+	try
+	{
+		Benchmark benchmark(settings);
+		const bool succeeded = settings.software ? benchmark.runSoftware(SCREEN_DEPTH, SCREEN_NEAR) : benchmark.run(openGLContext);
+		if (!benchmark.writeReport())
 		{
-			if (!frame())
-			{
-				done = true;
-			}
+			const std::wstring error = L"Could not write " + strToWstr(settings.report) + L".";
+			MessageBox(wnd, error.c_str(), L"Error", MB_OK);
+			return false;
 		}
+		return succeeded;
+	}
+	catch (const std::exception& e)
+	{
+		const std::wstring error = strToWstr(e.what());
+		MessageBox(wnd, error.c_str(), L"Error", MB_OK);
+		return false;
 	}
 }
 
-bool Application::frame() const
+// Moves and redraws that do not fit in the queue are dropped rather than wait for the
+// render thread; it keeps every other command.
+void Application::post(RenderCommand::Type type, int first, int second)
 {
-	if (isClosing)
+	if (renderThread)
 	{
-		return false;
+		renderThread->post({ type, first, second });
 	}
+}
 
-	if (!graphics->render())
+// Only the newest counters the render thread sent are shown.
+void Application::showStats()
+{
+	RenderStats stats = {};
+	bool received = false;
+	while (renderThread && renderThread->takeStats(stats))
 	{
-		return false;
+		received = true;
 	}
 
-	return true;
+	if (!received)
+	{
+		return;
+	}
+
+	const std::wstring text = std::wstring(title) + L" - " + std::to_wstring(stats.drawCalls) + L" draws, " +
+		std::to_wstring(stats.programChanges) + L" program changes, " +
+		std::to_wstring(stats.visibleObjects) + L" visible, " + std::to_wstring(stats.culledObjects) + L" culled (" + std::to_wstring(stats.occludedObjects) + L" occluded), " +
+		std::to_wstring(stats.uniformLookups) + L" uniform lookups, " +
+		std::to_wstring(stats.stateCalls) + L" state calls (" + std::to_wstring(stats.elidedStateCalls) + L" elided), " +
+		std::to_wstring(stats.streamStalls) + L" stream stalls per frame";
+	SetWindowTextW(wnd, text.c_str());
 }
 
 LRESULT CALLBACK Application::messageHandler(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
@@ -116,16 +170,13 @@ LRESULT CALLBACK Application::messageHandler(HWND hwnd, UINT message, WPARAM wPa
 		case ID_FILE_LOADMODEL:
 		{
 			std::string file;
-			const std::wstring ext = L"*.STL";
-			const std::wstring type = L"STL files";
+			const std::wstring ext = L"*.STL;*.PLY;*.GLB;*.3MF;*.GZ";
+			const std::wstring type = L"Mesh files";
 			HRESULT hr = openFile(type, ext, file);
-			if (SUCCEEDED(hr))
+			if (SUCCEEDED(hr) && renderThread)
 			{
-				if (!graphics->load(file))
-				{
-					MessageBox(wnd, L"Could not load file.", L"Error", MB_OK);
-				}
-			}			
+				renderThread->load(file);
+			}
 		}			
 			break;
 		case IDM_ABOUT:
@@ -149,19 +200,57 @@ LRESULT CALLBACK Application::messageHandler(HWND hwnd, UINT message, WPARAM wPa
 			break;
 
 		case VK_UP:
-			graphics->move(Direction::Up);
+			post(RenderCommand::Type::Move, static_cast<int>(Direction::Up));
 			break;
 
 		case VK_DOWN:
-			graphics->move(Direction::Down);
+			post(RenderCommand::Type::Move, static_cast<int>(Direction::Down));
 			break;
 
 		case VK_LEFT:
-			graphics->move(Direction::Left);
+			post(RenderCommand::Type::Move, static_cast<int>(Direction::Left));
 			break;
 
 		case VK_RIGHT:
-			graphics->move(Direction::Right);
+			post(RenderCommand::Type::Move, static_cast<int>(Direction::Right));
+			break;
+
+		case 'P':
+			post(RenderCommand::Type::TogglePointCloud);
+			break;
+
+		case 'C':
+			post(RenderCommand::Type::ToggleClipPlane);
+			break;
+
+		case 'I':
+			post(RenderCommand::Type::ToggleBuildPlate);
+			break;
+
+		case 'G':
+			post(RenderCommand::Type::ToggleGpuCulling);
+			break;
+
+		case 'O':
+			post(RenderCommand::Type::ToggleOcclusionCulling);
+			break;
+
+		case 'T':
+			Profiler::instance().dump("profile.csv");
+			break;
+
+		case 'R':
+			setContinuous(!continuous);
+			break;
+
+		case VK_ADD:
+		case VK_OEM_PLUS:
+			post(RenderCommand::Type::ChangePointBudget, 1);
+			break;
+
+		case VK_SUBTRACT:
+		case VK_OEM_MINUS:
+			post(RenderCommand::Type::ChangePointBudget, 0);
 			break;
 
 		default:
@@ -170,6 +259,31 @@ LRESULT CALLBACK Application::messageHandler(HWND hwnd, UINT message, WPARAM wPa
 		}
 		return 0;
 
+	// The next frame covers the whole client area.
+	case WM_PAINT:
+		ValidateRect(hwnd, nullptr);
+		post(RenderCommand::Type::Redraw);
+		return 0;
+
+	case WM_SIZE:
+		if (renderThread)
+		{
+			renderThread->resize(LOWORD(lParam), HIWORD(lParam));
+		}
+		break;
+
+	case WM_RENDER_STATS:
+		showStats();
+		return 0;
+
+	case WM_RENDER_LOAD_FAILED:
+		MessageBox(wnd, L"Could not load file.", L"Error", MB_OK);
+		return 0;
+
+	case WM_RENDER_FAILED:
+		isClosing = true;
+		return 0;
+
 	default:
 		;
 	}
@@ -235,7 +349,7 @@ bool Application::initWindow(OpenGL* OpenGL, int& screenWidth, int& screenHeight
 		screenHeight = rect.bottom - rect.top;
 	}
 
-	if (!openGLContext->initializeOpenGl(wnd, screenWidth, screenHeight, SCREEN_DEPTH, SCREEN_NEAR, VSYNC_ENABLED))
+	if (!openGLContext->initializeOpenGl(wnd, screenWidth, screenHeight, SCREEN_DEPTH, SCREEN_NEAR, VSYNC_ENABLED && !benchmarkMode))
 	{
 		MessageBox(wnd, L"Could not initialize OpenGL, check if video card supports OpenGL 4.0.", L"Error", MB_OK);
 		return false;
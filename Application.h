@@ -1,19 +1,25 @@
 #pragma once
 
-#include "Graphics.h"
+#include "OpenGL.h"
+#include "RenderThread.h"
+#include "Benchmark.h"
 #include <string>
 #include <atomic>
 
 class Application
 {
 public:
-	Application();
+	Application(bool benchmarkMode = false);
 	~Application();
 	void run() const;
+	void setContinuous(bool enabled);
+	void setQuantizedPositions(bool enabled);
+	bool benchmark(const Benchmark::Settings& settings);
 	LRESULT CALLBACK messageHandler(HWND, UINT, WPARAM, LPARAM);
 	
 private:
-	bool frame() const;
+	void post(RenderCommand::Type type, int first = 0, int second = 0);
+	void showStats();
 	bool initWindow(OpenGL*, int&, int&);
 	void closeWindow();
     static std::wstring strToWstr(std::string str);
@@ -25,12 +31,14 @@ private:
 	WCHAR title[maxLoadString];
 	WCHAR windowClass[maxLoadString];
 	OpenGL* openGLContext;
-	Graphics* graphics;
+	RenderThread* renderThread;
 	bool isInit;
+	bool benchmarkMode;
 	const bool VSYNC_ENABLED = true;
 	const float SCREEN_DEPTH = 1000.0f;
 	const float SCREEN_NEAR = 0.1f;
 	std::atomic<bool> isClosing;
+	bool continuous;
 };
 
 static Application* applicationHandle = nullptr;
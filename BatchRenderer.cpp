@@ -0,0 +1,508 @@
+#include "BatchRenderer.h"
+#include "GLState.h"
+#include "RenderContext.h"
+#include <algorithm>
+#include <numeric>
+
+// ARB_indirect_parameters; the loader header predates the extension.
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+namespace
+{
+	// Storage bindings of cull.comp. Its draw index output shares the binding the light
+	// shader reads it from.
+	const unsigned boundsStorageBinding = 2;
+	const unsigned batchBaseStorageBinding = 3;
+	const unsigned templateStorageBinding = 4;
+	const unsigned commandStorageBinding = 5;
+	const unsigned countStorageBinding = 6;
+	const unsigned visibilityStorageBinding = 7;
+	const unsigned depthPyramidUnit = 0;
+	const unsigned cullGroupSize = 64;
+}
+
+BatchRenderer::BatchRenderer() :
+	commandBuffer(0),
+	templateBuffer(0),
+	objectBuffer(0),
+	drawIndexBuffer(0),
+	boundsBuffer(0),
+	batchBaseBuffer(0),
+	countBuffer(0),
+	visibilityBuffer(0),
+	readbackBuffers{},
+	readbackFences{},
+	nextReadback(0),
+	multiDrawElementsIndirectCount(nullptr),
+	multiDrawArraysIndirectCount(nullptr),
+	gpuCulled(false),
+	visibleDraws(0),
+	occludedDraws(0)
+{
+	glGenBuffers(1, &commandBuffer);
+	glGenBuffers(1, &templateBuffer);
+	glGenBuffers(1, &objectBuffer);
+	glGenBuffers(1, &drawIndexBuffer);
+	glGenBuffers(1, &boundsBuffer);
+	glGenBuffers(1, &batchBaseBuffer);
+	glGenBuffers(1, &countBuffer);
+	glGenBuffers(1, &visibilityBuffer);
+	glGenBuffers(static_cast<GLsizei>(readbackCount), readbackBuffers);
+
+	if (RenderContext::hasExtension("GL_ARB_indirect_parameters"))
+	{
+		multiDrawElementsIndirectCount = reinterpret_cast<MultiDrawElementsIndirectCount>(RenderContext::getProcAddress("glMultiDrawElementsIndirectCountARB"));
+		multiDrawArraysIndirectCount = reinterpret_cast<MultiDrawArraysIndirectCount>(RenderContext::getProcAddress("glMultiDrawArraysIndirectCountARB"));
+	}
+}
+
+BatchRenderer::~BatchRenderer()
+{
+	releaseReadbacks();
+
+	const unsigned buffers[] = { commandBuffer, templateBuffer, objectBuffer, drawIndexBuffer, boundsBuffer, batchBaseBuffer, countBuffer, visibilityBuffer };
+	GLState& state = GLState::instance();
+	state.deleteBuffers(static_cast<int>(sizeof(buffers) / sizeof(buffers[0])), buffers);
+	state.deleteBuffers(static_cast<int>(readbackCount), readbackBuffers);
+}
+
+// Multi-draw indirect and storage buffers are core in 4.3; the draw index reaches the
+// shader through ARB_shader_draw_parameters.
+bool BatchRenderer::isSupported()
+{
+	return GLAD_GL_VERSION_4_3 && glMultiDrawElementsIndirect && glMultiDrawArraysIndirect &&
+		RenderContext::hasExtension("GL_ARB_shader_draw_parameters");
+}
+
+// Compute shaders come with 4.3; the draw counts written on the GPU need ARB_indirect_parameters.
+bool BatchRenderer::isGpuCullingSupported() const
+{
+	return glDispatchCompute && multiDrawElementsIndirectCount && multiDrawArraysIndirectCount;
+}
+
+void BatchRenderer::clear()
+{
+	draws.clear();
+}
+
+void BatchRenderer::add(Shader* shader, const Model::Primitive& primitive, size_t object, unsigned instanceCount)
+{
+	draws.push_back({ shader, &primitive, object, instanceCount });
+}
+
+bool BatchRenderer::isSameBatch(const Draw& a, const Draw& b)
+{
+	return a.shader == b.shader && a.primitive->vao == b.primitive->vao && a.primitive->mode == b.primitive->mode && a.primitive->indexType == b.primitive->indexType;
+}
+
+size_t BatchRenderer::getIndexSize(unsigned indexType)
+{
+	switch (indexType)
+	{
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+// Draws without culling bounds, such as those of a point cloud, are never culled.
+BatchRenderer::DrawBounds BatchRenderer::getVolume(const FrustumCuller& bounds, size_t object, size_t batch)
+{
+	DrawBounds volume;
+	if (object < bounds.getCount())
+	{
+		bounds.getBounds(object, volume.sphere, volume.extent);
+	}
+	else
+	{
+		volume.sphere = glm::vec4(0.0f, 0.0f, 0.0f, 1e30f);
+		volume.extent = glm::vec3(1e30f);
+	}
+	volume.batch = static_cast<uint32_t>(batch);
+	return volume;
+}
+
+void BatchRenderer::build(const std::vector<ObjectBlock>& objects, const FrustumCuller& bounds)
+{
+	std::stable_sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b)
+	{
+		if (a.shader != b.shader)
+		{
+			return a.shader < b.shader;
+		}
+		if (a.primitive->vao != b.primitive->vao)
+		{
+			return a.primitive->vao < b.primitive->vao;
+		}
+		if (a.primitive->mode != b.primitive->mode)
+		{
+			return a.primitive->mode < b.primitive->mode;
+		}
+		return a.primitive->indexType < b.primitive->indexType;
+	});
+
+	batches.clear();
+	templates.clear();
+	ordered.clear();
+	volumes.clear();
+
+	std::vector<uint32_t> batchBases;
+	for (size_t i = 0; i < draws.size(); ++i)
+	{
+		const Draw& draw = draws[i];
+		if (i == 0 || !isSameBatch(draws[i - 1], draw))
+		{
+			batches.push_back({ draw.shader, draw.primitive->vao, draw.primitive->mode, draw.primitive->indexType, 0, static_cast<unsigned>(i), 0 });
+			batchBases.push_back(static_cast<uint32_t>(i));
+		}
+
+		DrawCommand command;
+		command.count = static_cast<uint32_t>(draw.primitive->count);
+		command.instanceCount = draw.instanceCount;
+		command.first = draw.primitive->indexType ? static_cast<uint32_t>(draw.primitive->indexOffset / getIndexSize(draw.primitive->indexType)) : 0;
+		command.baseVertex = 0;
+		command.baseInstance = 0;
+		templates.push_back(command);
+
+		volumes.push_back(getVolume(bounds, draw.object, batches.size() - 1));
+		++batches.back().drawCount;
+		ordered.push_back(objects[draw.object]);
+	}
+
+	// Until a frame is culled every draw is visible and draws map to objects one to one.
+	commands = templates;
+	drawIndices.resize(draws.size());
+	std::iota(drawIndices.begin(), drawIndices.end(), 0u);
+	visible.assign(draws.size(), 1);
+	for (Batch& batch : batches)
+	{
+		batch.visibleCount = batch.drawCount;
+	}
+	gpuCulled = false;
+	visibleDraws = draws.size();
+	occludedDraws = 0;
+
+	if (draws.empty())
+	{
+		return;
+	}
+
+	// The GPU path compacts into two ranges of commands and draw indices, one per pass.
+	const size_t ranges = isGpuCullingSupported() ? 2 : 1;
+	GLState& state = GLState::instance();
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLsizeiptr>(ranges * commands.size() * sizeof(DrawCommand)), nullptr, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, static_cast<GLsizeiptr>(commands.size() * sizeof(DrawCommand)), commands.data());
+
+	const auto upload = [&state](unsigned buffer, size_t size, const void* data, unsigned usage)
+	{
+		state.bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(size), data, usage);
+	};
+
+	upload(objectBuffer, ordered.size() * sizeof(ObjectBlock), ordered.data(), GL_DYNAMIC_DRAW);
+	upload(drawIndexBuffer, ranges * drawIndices.size() * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(drawIndices.size() * sizeof(uint32_t)), drawIndices.data());
+	if (isGpuCullingSupported())
+	{
+		// Everything counts as visible in the frame before the first occlusion test.
+		const std::vector<uint32_t> allVisible(draws.size(), 1);
+		upload(visibilityBuffer, allVisible.size() * sizeof(uint32_t), allVisible.data(), GL_DYNAMIC_DRAW);
+		upload(templateBuffer, templates.size() * sizeof(DrawCommand), templates.data(), GL_STATIC_DRAW);
+		upload(boundsBuffer, volumes.size() * sizeof(DrawBounds), volumes.data(), GL_DYNAMIC_DRAW);
+		upload(batchBaseBuffer, batchBases.size() * sizeof(uint32_t), batchBases.data(), GL_STATIC_DRAW);
+		upload(countBuffer, (2 * batches.size() + 2) * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+
+		// Copies of the old counts no longer match the batches.
+		releaseReadbacks();
+		for (const unsigned readback : readbackBuffers)
+		{
+			state.bindBuffer(GL_COPY_WRITE_BUFFER, readback);
+			glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>((2 * batches.size() + 2) * sizeof(uint32_t)), nullptr, GL_STREAM_READ);
+		}
+	}
+}
+
+// Objects that only moved keep their batches and commands. Their blocks and volumes are
+// rewritten in place, and only the span of draws between the first and last that moved
+// is uploaded.
+void BatchRenderer::update(const std::vector<ObjectBlock>& objects, const FrustumCuller& bounds, const std::vector<uint8_t>& moved)
+{
+	size_t first = draws.size();
+	size_t last = 0;
+	for (size_t i = 0; i < draws.size(); ++i)
+	{
+		const size_t object = draws[i].object;
+		if (object >= moved.size() || !moved[object])
+		{
+			continue;
+		}
+
+		ordered[i] = objects[object];
+		volumes[i] = getVolume(bounds, object, volumes[i].batch);
+		first = std::min(first, i);
+		last = i;
+	}
+
+	if (first > last)
+	{
+		return;
+	}
+
+	const size_t count = last - first + 1;
+	GLState& state = GLState::instance();
+	state.bindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(first * sizeof(ObjectBlock)), static_cast<GLsizeiptr>(count * sizeof(ObjectBlock)), &ordered[first]);
+	if (isGpuCullingSupported())
+	{
+		state.bindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(first * sizeof(DrawBounds)), static_cast<GLsizeiptr>(count * sizeof(DrawBounds)), &volumes[first]);
+	}
+}
+
+// CPU compaction: the visible draws of each batch are moved to the front of its range in
+// their original order. Nothing is uploaded while the visible set stays the same.
+void BatchRenderer::setVisibility(const std::vector<uint8_t>& visibility)
+{
+	bool changed = gpuCulled;
+	for (size_t i = 0; i < draws.size(); ++i)
+	{
+		const uint8_t isVisible = draws[i].object < visibility.size() ? visibility[draws[i].object] : 1;
+		changed = changed || isVisible != visible[i];
+		visible[i] = isVisible;
+	}
+
+	gpuCulled = false;
+	occludedDraws = 0;
+	if (!changed)
+	{
+		return;
+	}
+
+	visibleDraws = 0;
+	for (Batch& batch : batches)
+	{
+		batch.visibleCount = 0;
+		for (unsigned i = batch.drawBase; i < batch.drawBase + static_cast<unsigned>(batch.drawCount); ++i)
+		{
+			if (visible[i])
+			{
+				const unsigned slot = batch.drawBase + static_cast<unsigned>(batch.visibleCount++);
+				commands[slot] = templates[i];
+				drawIndices[slot] = i;
+			}
+		}
+		visibleDraws += static_cast<size_t>(batch.visibleCount);
+	}
+
+	GLState& state = GLState::instance();
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, static_cast<GLsizeiptr>(commands.size() * sizeof(DrawCommand)), commands.data());
+	state.bindBuffer(GL_SHADER_STORAGE_BUFFER, drawIndexBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(drawIndices.size() * sizeof(uint32_t)), drawIndices.data());
+}
+
+// GPU compaction: one invocation per draw writes the visible commands and draw indices
+// and counts them per batch. The counts stay on the GPU for the draws. The first pass of
+// a frame clears the counts; the occlusion pass tests against the given depth pyramid.
+void BatchRenderer::cull(const Shader& cullShader, CullPass pass, const glm::mat4& viewProjectionMatrix, const DepthPyramid* depthPyramid, RenderStats& stats)
+{
+	if (draws.empty())
+	{
+		return;
+	}
+
+	constexpr uint32_t planesName = hashName("planes");
+	constexpr uint32_t drawCountName = hashName("drawCount");
+	constexpr uint32_t batchCountName = hashName("batchCount");
+	constexpr uint32_t viewProjectionMatrixName = hashName("viewProjectionMatrix");
+	constexpr uint32_t depthPyramidName = hashName("depthPyramid");
+	constexpr uint32_t viewportSizeName = hashName("viewportSize");
+	constexpr uint32_t pyramidLevelsName = hashName("pyramidLevels");
+
+	GLState& state = GLState::instance();
+	const size_t countSize = (2 * batches.size() + 2) * sizeof(uint32_t);
+	if (pass != CullPass::Occlusion)
+	{
+		readVisibleCounts();
+		state.bindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	}
+
+	glm::vec4 planes[6];
+	FrustumCuller::extractPlanes(viewProjectionMatrix, planes);
+
+	cullShader.setShader();
+	++stats.programChanges;
+	glUniform4fv(cullShader.getUniform(planesName), 6, &planes[0].x);
+	glUniform1ui(cullShader.getUniform(drawCountName), static_cast<unsigned>(draws.size()));
+	glUniform1ui(cullShader.getUniform(batchCountName), static_cast<unsigned>(batches.size()));
+	if (pass == CullPass::Occlusion && depthPyramid)
+	{
+		const glm::ivec2 viewportSize = depthPyramid->getViewportSize();
+		depthPyramid->bind(depthPyramidUnit);
+		glUniformMatrix4fv(cullShader.getUniform(viewProjectionMatrixName), 1, GL_FALSE, &viewProjectionMatrix[0][0]);
+		glUniform1i(cullShader.getUniform(depthPyramidName), static_cast<int>(depthPyramidUnit));
+		glUniform2i(cullShader.getUniform(viewportSizeName), viewportSize.x, viewportSize.y);
+		glUniform1i(cullShader.getUniform(pyramidLevelsName), depthPyramid->getLevels());
+	}
+
+	const ptrdiff_t drawCount = static_cast<ptrdiff_t>(draws.size());
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, boundsStorageBinding, boundsBuffer, 0, drawCount * static_cast<ptrdiff_t>(sizeof(DrawBounds)));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, batchBaseStorageBinding, batchBaseBuffer, 0, static_cast<ptrdiff_t>(batches.size() * sizeof(uint32_t)));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, templateStorageBinding, templateBuffer, 0, drawCount * static_cast<ptrdiff_t>(sizeof(DrawCommand)));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, commandStorageBinding, commandBuffer, 0, 2 * drawCount * static_cast<ptrdiff_t>(sizeof(DrawCommand)));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, drawIndexStorageBinding, drawIndexBuffer, 0, 2 * drawCount * static_cast<ptrdiff_t>(sizeof(uint32_t)));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, countStorageBinding, countBuffer, 0, static_cast<ptrdiff_t>(countSize));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, visibilityStorageBinding, visibilityBuffer, 0, drawCount * static_cast<ptrdiff_t>(sizeof(uint32_t)));
+
+	glDispatchCompute(static_cast<unsigned>((draws.size() + cullGroupSize - 1) / cullGroupSize), 1, 1);
+
+	// Indirect commands and parameters are command reads; draw indices are storage reads.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	gpuCulled = true;
+}
+
+// Just before the counts are cleared, the previous frame's are copied into the next
+// slot of the ring, unless the GPU has not yet finished the copy made there last time.
+// Every copy whose fence has signalled is read, oldest first, so the newest one wins;
+// until one has, the figures of an earlier frame are kept.
+void BatchRenderer::readVisibleCounts()
+{
+	if (!gpuCulled)
+	{
+		return;
+	}
+
+	GLState& state = GLState::instance();
+	std::vector<uint32_t> counts(2 * batches.size() + 2);
+	for (size_t i = 0; i < readbackCount; ++i)
+	{
+		const size_t slot = (nextReadback + i) % readbackCount;
+		GLsync& fence = readbackFences[slot];
+		if (!fence || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			continue;
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+		state.bindBuffer(GL_COPY_READ_BUFFER, readbackBuffers[slot]);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, static_cast<GLsizeiptr>(counts.size() * sizeof(uint32_t)), counts.data());
+		visibleDraws = std::accumulate(counts.begin(), counts.begin() + static_cast<ptrdiff_t>(2 * batches.size()), size_t(0));
+		occludedDraws = counts.back();
+	}
+
+	if (readbackFences[nextReadback])
+	{
+		return;
+	}
+
+	// The counts were written by the culling shader, and the copy reads them as a buffer.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	state.bindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[nextReadback]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(counts.size() * sizeof(uint32_t)));
+	readbackFences[nextReadback] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	nextReadback = (nextReadback + 1) % readbackCount;
+}
+
+void BatchRenderer::releaseReadbacks()
+{
+	for (GLsync& fence : readbackFences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	nextReadback = 0;
+}
+
+void BatchRenderer::submit(RenderStats& stats, CullPass pass) const
+{
+	if (batches.empty())
+	{
+		return;
+	}
+
+	constexpr uint32_t drawBaseName = hashName("drawBase");
+
+	// Draws added by the occlusion pass sit in the second range of commands and counts.
+	const size_t range = pass == CullPass::Occlusion ? 1 : 0;
+
+	GLState& state = GLState::instance();
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, objectStorageBinding, objectBuffer, 0, static_cast<ptrdiff_t>(ordered.size() * sizeof(ObjectBlock)));
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, drawIndexStorageBinding, drawIndexBuffer, 0, static_cast<ptrdiff_t>((range + 1) * drawIndices.size() * sizeof(uint32_t)));
+	if (gpuCulled)
+	{
+		state.bindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+	}
+
+	const Shader* current = nullptr;
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		const Batch& batch = batches[i];
+		if (!gpuCulled && batch.visibleCount == 0)
+		{
+			continue;
+		}
+
+		if (batch.shader != current)
+		{
+			current = batch.shader;
+			current->setShader();
+			++stats.programChanges;
+		}
+
+		const size_t drawBase = range * draws.size() + batch.drawBase;
+		glUniform1ui(current->getUniform(drawBaseName), static_cast<unsigned>(drawBase));
+		state.bindVertexArray(batch.vao);
+
+		const void* offset = reinterpret_cast<const void*>(drawBase * sizeof(DrawCommand));
+		const GLsizei stride = static_cast<GLsizei>(sizeof(DrawCommand));
+		if (gpuCulled)
+		{
+			const GLintptr countOffset = static_cast<GLintptr>((range * batches.size() + i) * sizeof(uint32_t));
+			if (batch.indexType)
+			{
+				multiDrawElementsIndirectCount(batch.mode, batch.indexType, offset, countOffset, batch.drawCount, stride);
+			}
+			else
+			{
+				multiDrawArraysIndirectCount(batch.mode, offset, countOffset, batch.drawCount, stride);
+			}
+		}
+		else if (batch.indexType)
+		{
+			glMultiDrawElementsIndirect(batch.mode, batch.indexType, offset, batch.visibleCount, stride);
+		}
+		else
+		{
+			glMultiDrawArraysIndirect(batch.mode, offset, batch.visibleCount, stride);
+		}
+		++stats.drawCalls;
+	}
+}
+
+size_t BatchRenderer::getDrawCount() const
+{
+	return draws.size();
+}
+
+size_t BatchRenderer::getVisibleCount() const
+{
+	return visibleDraws;
+}
+
+size_t BatchRenderer::getOccludedCount() const
+{
+	return occludedDraws;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "DepthPyramid.h"
+#include "FrustumCuller.h"
+#include "Model.h"
+#include "RenderStats.h"
+#include "Shader.h"
+#include "ShaderBlocks.h"
+#include "ShaderLibrary.h"
+#include <cstdint>
+#include <vector>
+
+// Turns the draws of a frame into a few glMultiDraw*Indirect calls. Draws that share a
+// program, vertex array, mode and index type form one batch; their per-draw data is
+// stored in batch order in a storage buffer, and the shader finds it through a draw
+// index table. Commands are only rebuilt when the scene changes; when objects only move,
+// their blocks and culling volumes are rewritten in place. Each frame the visible
+// draws of a batch are compacted to the front of its range, either on the CPU from a
+// visibility list or by the culling compute shader, whose per-batch counts are read
+// back by glMultiDraw*IndirectCountARB without a round trip. With occlusion culling the
+// GPU path draws in two ranges: what was visible last frame, and what the depth pyramid
+// of those draws shows has come into view. The GPU counts are only reported: they are
+// copied into a small ring of buffers, each guarded by a fence, and a copy is read once
+// its fence has signalled, so the figures lag a few frames but never stall the CPU.
+class BatchRenderer
+{
+public:
+	BatchRenderer();
+	~BatchRenderer();
+	BatchRenderer(const BatchRenderer&) = delete;
+	BatchRenderer& operator=(const BatchRenderer&) = delete;
+	static bool isSupported();
+	bool isGpuCullingSupported() const;
+	void clear();
+	void add(Shader* shader, const Model::Primitive& primitive, size_t object, unsigned instanceCount);
+	void build(const std::vector<ObjectBlock>& objects, const FrustumCuller& bounds);
+	void update(const std::vector<ObjectBlock>& objects, const FrustumCuller& bounds, const std::vector<uint8_t>& moved);
+	void setVisibility(const std::vector<uint8_t>& visibility);
+	void cull(const Shader& cullShader, CullPass pass, const glm::mat4& viewProjectionMatrix, const DepthPyramid* depthPyramid, RenderStats& stats);
+	void submit(RenderStats& stats, CullPass pass = CullPass::Frustum) const;
+	size_t getDrawCount() const;
+	size_t getVisibleCount() const;
+	size_t getOccludedCount() const;
+
+private:
+	// Elements commands; arrays commands read the first four members, with baseVertex
+	// standing in for their baseInstance, so both share one stride.
+	struct DrawCommand
+	{
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t first;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	// Mirrors DrawBounds in cull.comp under std430.
+	struct DrawBounds
+	{
+		glm::vec4 sphere;
+		glm::vec3 extent;
+		uint32_t batch;
+	};
+
+	struct Draw
+	{
+		Shader* shader;
+		const Model::Primitive* primitive;
+		size_t object;
+		unsigned instanceCount;
+	};
+
+	struct Batch
+	{
+		Shader* shader;
+		unsigned vao;
+		unsigned mode;
+		unsigned indexType;
+		int drawCount;
+		unsigned drawBase;
+		int visibleCount;
+	};
+
+	typedef void (APIENTRYP MultiDrawElementsIndirectCount)(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+	typedef void (APIENTRYP MultiDrawArraysIndirectCount)(GLenum mode, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+	static bool isSameBatch(const Draw& a, const Draw& b);
+	static size_t getIndexSize(unsigned indexType);
+	static DrawBounds getVolume(const FrustumCuller& bounds, size_t object, size_t batch);
+	void readVisibleCounts();
+	void releaseReadbacks();
+
+	unsigned commandBuffer;
+	unsigned templateBuffer;
+	unsigned objectBuffer;
+	unsigned drawIndexBuffer;
+	unsigned boundsBuffer;
+	unsigned batchBaseBuffer;
+	unsigned countBuffer;
+	unsigned visibilityBuffer;
+	static const size_t readbackCount = 3;
+	unsigned readbackBuffers[readbackCount];
+	GLsync readbackFences[readbackCount];
+	size_t nextReadback;
+	MultiDrawElementsIndirectCount multiDrawElementsIndirectCount;
+	MultiDrawArraysIndirectCount multiDrawArraysIndirectCount;
+	bool gpuCulled;
+	size_t visibleDraws;
+	size_t occludedDraws;
+	std::vector<Draw> draws;
+	std::vector<Batch> batches;
+	std::vector<DrawCommand> templates;
+	std::vector<DrawCommand> commands;
+	std::vector<uint32_t> drawIndices;
+	std::vector<uint8_t> visible;
+	std::vector<ObjectBlock> ordered;
+	std::vector<DrawBounds> volumes;
+};
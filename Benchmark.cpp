@@ -0,0 +1,649 @@
+#define _USE_MATH_DEFINES
+#include "Benchmark.h"
+#include "Camera.h"
+#include "Graphics.h"
+#include "GLState.h"
+#include "Json.h"
+#include "NormalMatrices.h"
+#include "SoftwareRenderer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+	// Pipeline statistics gathered by the profiler, which are counts rather than times.
+	const char* const statisticSeries[] = { "gpu/vertices", "gpu/primitives", "gpu/fragments" };
+
+	double elapsedMilliseconds(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Blocks until the GPU has finished every command issued so far.
+	void waitForGpu()
+	{
+		if (!glFenceSync)
+		{
+			glFinish();
+			return;
+		}
+
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		GLenum status = GL_TIMEOUT_EXPIRED;
+		while (status == GL_TIMEOUT_EXPIRED)
+		{
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+		glDeleteSync(fence);
+	}
+
+	// Largest resident size of the process so far, in bytes.
+	size_t getPeakMemory()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return counters.PeakWorkingSetSize;
+		}
+		return 0;
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+		{
+			return static_cast<size_t>(usage.ru_maxrss) * 1024;
+		}
+		return 0;
+#endif
+	}
+
+	bool parseCount(const std::string& text, unsigned& value)
+	{
+		char* end = nullptr;
+		const unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+		if (text.empty() || *end != '\0')
+		{
+			return false;
+		}
+		value = static_cast<unsigned>(parsed);
+		return true;
+	}
+
+	void writeString(std::ostream& stream, const std::string& text)
+	{
+		stream << '"';
+		for (const char c : text)
+		{
+			switch (c)
+			{
+			case '"':
+				stream << "\\\"";
+				break;
+			case '\\':
+				stream << "\\\\";
+				break;
+			case '\n':
+				stream << "\\n";
+				break;
+			case '\t':
+				stream << "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					static const char digits[] = "0123456789abcdef";
+					stream << "\\u00" << digits[c >> 4] << digits[c & 0xf];
+				}
+				else
+				{
+					stream << c;
+				}
+				break;
+			}
+		}
+		stream << '"';
+	}
+
+	// The report's name with its extension replaced, so each model's image sits beside it.
+	std::string getImagePath(const std::string& report, size_t index)
+	{
+		const size_t separator = report.find_last_of("/\\");
+		const size_t extension = report.find_last_of('.');
+		const std::string stem = extension != std::string::npos && (separator == std::string::npos || extension > separator) ? report.substr(0, extension) : report;
+		return stem + "-" + std::to_string(index) + ".ppm";
+	}
+
+	// Binary PPM; the alpha channel of the RGBA8 rows is dropped.
+	bool writeImage(const std::string& file, const std::vector<uint8_t>& pixels, int width, int height)
+	{
+		std::ofstream stream(file, std::ios::binary);
+		if (!stream)
+		{
+			return false;
+		}
+
+		stream << "P6\n" << width << " " << height << "\n255\n";
+		for (size_t i = 0; i + 3 < pixels.size(); i += 4)
+		{
+			stream.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+		}
+		return static_cast<bool>(stream);
+	}
+
+	// A series that was never sampled, such as pipeline statistics on a driver without
+	// them, is written as null.
+	void writeSummary(std::ostream& stream, const Profiler::Summary& summary)
+	{
+		if (summary.samples == 0)
+		{
+			stream << "null";
+			return;
+		}
+
+		stream << "{ \"samples\": " << summary.samples << ", \"mean\": " << summary.mean << ", \"p50\": " << summary.p50 <<
+			", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }";
+	}
+}
+
+// Options come first, then the models: [--frames n] [--warmup n] [--step seconds]
+// [--path camera.json] [--report out.json] [--size WxH] [--quantize] [--software] model...
+bool Benchmark::parseArguments(const std::vector<std::string>& arguments, Settings& settings, std::string& error)
+{
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		const std::string& argument = arguments[i];
+		if (argument.compare(0, 2, "--") != 0)
+		{
+			settings.models.push_back(argument);
+			continue;
+		}
+
+		if (argument == "--quantize")
+		{
+			settings.quantize = true;
+			continue;
+		}
+
+		if (argument == "--software")
+		{
+			settings.software = true;
+			continue;
+		}
+
+		if (i + 1 == arguments.size())
+		{
+			error = "Missing value for " + argument + ".";
+			return false;
+		}
+
+		const std::string& value = arguments[++i];
+		bool valid = true;
+		if (argument == "--frames")
+		{
+			valid = parseCount(value, settings.frames) && settings.frames > 0;
+		}
+		else if (argument == "--warmup")
+		{
+			valid = parseCount(value, settings.warmupFrames);
+		}
+		else if (argument == "--step")
+		{
+			char* end = nullptr;
+			settings.step = std::strtod(value.c_str(), &end);
+			valid = *end == '\0' && settings.step > 0.0;
+		}
+		else if (argument == "--path")
+		{
+			settings.cameraPath = value;
+		}
+		else if (argument == "--report")
+		{
+			settings.report = value;
+		}
+		else if (argument == "--size")
+		{
+			const size_t separator = value.find('x');
+			unsigned width = 0;
+			unsigned height = 0;
+			valid = separator != std::string::npos && parseCount(value.substr(0, separator), width) && parseCount(value.substr(separator + 1), height) && width > 0 && height > 0;
+			settings.width = static_cast<int>(width);
+			settings.height = static_cast<int>(height);
+		}
+		else
+		{
+			error = "Unknown option " + argument + ".";
+			return false;
+		}
+
+		if (!valid)
+		{
+			error = "Invalid value " + value + " for " + argument + ".";
+			return false;
+		}
+	}
+
+	if (settings.models.empty())
+	{
+		error = "No models to benchmark.";
+		return false;
+	}
+
+	return true;
+}
+
+Benchmark::Benchmark(const Settings& settings) :
+	settings(settings),
+	width(0),
+	height(0)
+{
+	if (settings.cameraPath.empty())
+	{
+		// Without a path the camera pulls in towards the model and swings across it.
+		keys = {
+			{ 0.0, { 0.0f, 0.0f, -10.0f } },
+			{ 2.0, { 2.0f, 0.0f, -6.0f } },
+			{ 4.0, { 0.0f, 1.0f, -4.0f } },
+			{ 6.0, { -2.0f, 0.0f, -6.0f } },
+			{ 8.0, { 0.0f, 0.0f, -10.0f } },
+		};
+	}
+	else if (!loadPath(settings.cameraPath))
+	{
+		throw std::runtime_error("Cannot load the camera path!");
+	}
+}
+
+bool Benchmark::loadPath(const std::string& file)
+{
+	std::ifstream stream(file, std::ios::binary);
+	if (!stream)
+	{
+		return false;
+	}
+
+	const std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	JsonValue document;
+	std::string error;
+	if (!JsonValue::parse(text.data(), text.data() + text.size(), document, error) || !document.isObject())
+	{
+		return false;
+	}
+
+	const JsonValue& list = document["keys"];
+	if (!list.isArray() || list.size() == 0)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < list.size(); ++i)
+	{
+		const JsonValue& position = list[i]["position"];
+		if (!list[i]["time"].isNumber() || !position.isArray() || position.size() != 3)
+		{
+			return false;
+		}
+
+		Key key;
+		key.time = list[i]["time"].asNumber();
+		key.position = glm::vec3(position[0].asNumber(), position[1].asNumber(), position[2].asNumber());
+
+		// Keys are played back in order, so their times may not go backwards.
+		if (!keys.empty() && key.time < keys.back().time)
+		{
+			return false;
+		}
+		keys.push_back(key);
+	}
+
+	return true;
+}
+
+glm::vec3 Benchmark::getCameraPosition(double time) const
+{
+	const double duration = keys.back().time - keys.front().time;
+	if (duration <= 0.0)
+	{
+		return keys.front().position;
+	}
+
+	time = keys.front().time + std::fmod(time, duration);
+	size_t next = 1;
+	while (next + 1 < keys.size() && keys[next].time <= time)
+	{
+		++next;
+	}
+
+	const Key& from = keys[next - 1];
+	const Key& to = keys[next];
+	const double span = to.time - from.time;
+	const float weight = span > 0.0 ? static_cast<float>((time - from.time) / span) : 1.0f;
+	return glm::mix(from.position, to.position, weight);
+}
+
+// Every model gets its own Graphics, so no GL objects of one model carry over to the next.
+bool Benchmark::run(RenderContext* context)
+{
+	renderer = context->getVideoCardInfo();
+
+	GLint viewport[4] = {};
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	width = viewport[2];
+	height = viewport[3];
+
+	results.clear();
+	bool succeeded = true;
+	for (const std::string& model : settings.models)
+	{
+		Result result{};
+		result.file = model;
+		if (!measure(context, result))
+		{
+			succeeded = false;
+		}
+		result.peakMemory = getPeakMemory();
+		results.push_back(result);
+	}
+
+	return succeeded;
+}
+
+// No context is needed: the view is the size asked for, with the projection the GL
+// contexts use.
+bool Benchmark::runSoftware(float screenDepth, float screenNear)
+{
+	renderer = "SoftwareRenderer";
+	width = settings.width;
+	height = settings.height;
+	const float fieldOfView = static_cast<float>(M_PI) / 4.0f;
+	const glm::mat4 projectionMatrix = glm::perspective(fieldOfView, static_cast<float>(width) / static_cast<float>(height), screenNear, screenDepth);
+
+	results.clear();
+	bool succeeded = true;
+	for (size_t i = 0; i < settings.models.size(); ++i)
+	{
+		Result result{};
+		result.file = settings.models[i];
+		if (!measureSoftware(projectionMatrix, result, getImagePath(settings.report, i)))
+		{
+			succeeded = false;
+		}
+		result.peakMemory = getPeakMemory();
+		results.push_back(result);
+	}
+
+	return succeeded;
+}
+
+bool Benchmark::measure(RenderContext* context, Result& result) const
+{
+	Profiler& profiler = Profiler::instance();
+
+	// Names of objects deleted with the last Graphics may be handed out again.
+	GLState::instance().invalidate();
+
+	try
+	{
+		Graphics graphics(context);
+		graphics.setQuantizedPositions(settings.quantize);
+
+		const auto loadStart = std::chrono::high_resolution_clock::now();
+		if (!graphics.load(result.file))
+		{
+			result.error = "Cannot load the model.";
+			return false;
+		}
+		result.loadMilliseconds = elapsedMilliseconds(loadStart);
+
+		// Warm-up frames hold the first key and include the wait for programs to compile.
+		// Every frame is fenced and timed until the GPU has finished it, so frame times
+		// cover the GPU's work as well as the CPU's; the time to submit is kept apart.
+		std::vector<double> frameTimes;
+		std::vector<double> submitTimes;
+		std::vector<double> drawCalls;
+		auto runStart = loadStart;
+		for (unsigned frame = 0; frame < settings.warmupFrames + settings.frames; ++frame)
+		{
+			const bool measured = frame >= settings.warmupFrames;
+			if (frame == settings.warmupFrames)
+			{
+				profiler.clear();
+				runStart = std::chrono::high_resolution_clock::now();
+			}
+
+			graphics.setCameraPosition(getCameraPosition(measured ? (frame - settings.warmupFrames) * settings.step : 0.0));
+
+			const auto frameStart = std::chrono::high_resolution_clock::now();
+			if (!graphics.render())
+			{
+				result.error = "Cannot render frame " + std::to_string(frame) + ".";
+				return false;
+			}
+
+			const double submitMilliseconds = elapsedMilliseconds(frameStart);
+			waitForGpu();
+			const double milliseconds = elapsedMilliseconds(frameStart);
+			if (frame == 0)
+			{
+				result.firstFrameMilliseconds = milliseconds;
+			}
+
+			if (measured)
+			{
+				frameTimes.push_back(milliseconds);
+				submitTimes.push_back(submitMilliseconds);
+				drawCalls.push_back(graphics.getStats().drawCalls);
+				result.streamStalls += graphics.getStats().streamStalls;
+			}
+		}
+		result.totalMilliseconds = elapsedMilliseconds(runStart);
+
+		result.frameMilliseconds = Profiler::summarize(frameTimes);
+		result.submitMilliseconds = Profiler::summarize(submitTimes);
+		result.drawCalls = Profiler::summarize(drawCalls);
+		result.triangles = profiler.getSummary("gpu/primitives");
+		for (const std::string& series : profiler.getSeries())
+		{
+			if (series.compare(0, 4, "gpu/") == 0 && std::find(std::begin(statisticSeries), std::end(statisticSeries), series) == std::end(statisticSeries))
+			{
+				result.gpuMilliseconds.push_back({ series.substr(4), profiler.getSummary(series) });
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		result.error = e.what();
+		return false;
+	}
+
+	return true;
+}
+
+// The model is read without uploading anything and drawn with the camera, light and
+// material of Graphics, so its image can be set beside the GL one. The whole frame is
+// CPU work, so frames are timed on the clock; throughput is in millions of triangles a
+// second.
+bool Benchmark::measureSoftware(const glm::mat4& projectionMatrix, Result& result, const std::string& image) const
+{
+	try
+	{
+		const auto loadStart = std::chrono::high_resolution_clock::now();
+		Model model(result.file, 0, false);
+		result.loadMilliseconds = elapsedMilliseconds(loadStart);
+
+		std::vector<ObjectBlock> objects;
+		for (const Model::Instance& instance : model.getInstances())
+		{
+			objects.push_back({ instance.transform, glm::mat4(1.0f), defaultObjectColour, defaultMaterial, model.getPositionScale(), model.getPositionOffset() });
+		}
+		if (!objects.empty())
+		{
+			computeNormalMatrices(&objects[0].modelMatrix, &objects[0].normalMatrix, objects.size(), sizeof(ObjectBlock));
+		}
+
+		FrameBlock frame{};
+		frame.projectionMatrix = projectionMatrix;
+		frame.ambientLight = defaultAmbientLight;
+		frame.lightPositions[0] = glm::vec4(defaultLightPosition, 1.0f);
+		frame.lightColours[0] = defaultLightColour;
+
+		Camera camera;
+		SoftwareRenderer software(width, height);
+		std::vector<double> frameTimes;
+		std::vector<double> triangles;
+		std::vector<double> throughput;
+		auto runStart = loadStart;
+		for (unsigned index = 0; index < settings.warmupFrames + settings.frames; ++index)
+		{
+			const bool measured = index >= settings.warmupFrames;
+			if (index == settings.warmupFrames)
+			{
+				runStart = std::chrono::high_resolution_clock::now();
+			}
+
+			const glm::vec3 position = getCameraPosition(measured ? (index - settings.warmupFrames) * settings.step : 0.0);
+			camera.setPosition(position);
+			camera.render();
+			frame.viewMatrix = camera.getViewMatrix();
+			frame.viewProjectionMatrix = frame.projectionMatrix * frame.viewMatrix;
+			frame.cameraPosition = glm::vec4(position, 1.0f);
+
+			const auto frameStart = std::chrono::high_resolution_clock::now();
+			software.render(model, frame, objects);
+			const double milliseconds = elapsedMilliseconds(frameStart);
+			if (index == 0)
+			{
+				result.firstFrameMilliseconds = milliseconds;
+			}
+
+			if (measured)
+			{
+				frameTimes.push_back(milliseconds);
+				triangles.push_back(static_cast<double>(software.getTriangleCount()));
+				throughput.push_back(software.getThroughput());
+			}
+		}
+		result.totalMilliseconds = elapsedMilliseconds(runStart);
+
+		result.frameMilliseconds = Profiler::summarize(frameTimes);
+		result.triangles = Profiler::summarize(triangles);
+		result.megaTrianglesPerSecond = Profiler::summarize(throughput);
+		if (!writeImage(image, software.getPixels(), software.getWidth(), software.getHeight()))
+		{
+			result.error = "Cannot write " + image + ".";
+			return false;
+		}
+		result.image = image;
+	}
+	catch (const std::exception& e)
+	{
+		result.error = e.what();
+		return false;
+	}
+
+	return true;
+}
+
+// Times are in milliseconds. Frame times run until the GPU has finished the frame, and
+// submit times until the CPU has issued it. Draw calls are counted on the CPU for every measured frame;
+// triangles are the primitives the GPU reports submitted, and GPU times come from the
+// profiler's zones, both over the most recent frames whose queries were read back. In
+// software runs the triangles are those set up on the CPU, and the image is the path of
+// the last frame.
+bool Benchmark::writeReport() const
+{
+	std::ofstream stream(settings.report);
+	if (!stream)
+	{
+		return false;
+	}
+
+	size_t peakMemory = 0;
+	stream << "{\n  \"renderer\": ";
+	writeString(stream, renderer);
+	stream << ",\n  \"width\": " << width << ",\n  \"height\": " << height;
+	stream << ",\n  \"frames\": " << settings.frames << ",\n  \"warmupFrames\": " << settings.warmupFrames << ",\n  \"step\": " << settings.step;
+	stream << ",\n  \"quantize\": " << (settings.quantize ? "true" : "false");
+	stream << ",\n  \"software\": " << (settings.software ? "true" : "false");
+	stream << ",\n  \"cameraPath\": ";
+	if (settings.cameraPath.empty())
+	{
+		stream << "null";
+	}
+	else
+	{
+		writeString(stream, settings.cameraPath);
+	}
+
+	stream << ",\n  \"models\": [";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& result = results[i];
+		if (result.peakMemory > peakMemory)
+		{
+			peakMemory = result.peakMemory;
+		}
+
+		stream << (i > 0 ? ",\n" : "\n") << "    {\n      \"file\": ";
+		writeString(stream, result.file);
+		stream << ",\n      \"error\": ";
+		if (result.error.empty())
+		{
+			stream << "null";
+		}
+		else
+		{
+			writeString(stream, result.error);
+		}
+
+		stream << ",\n      \"loadMilliseconds\": " << result.loadMilliseconds;
+		stream << ",\n      \"firstFrameMilliseconds\": " << result.firstFrameMilliseconds;
+		stream << ",\n      \"totalMilliseconds\": " << result.totalMilliseconds;
+		stream << ",\n      \"framesPerSecond\": " << (result.totalMilliseconds > 0.0 ? result.frameMilliseconds.samples * 1000.0 / result.totalMilliseconds : 0.0);
+		stream << ",\n      \"frameMilliseconds\": ";
+		writeSummary(stream, result.frameMilliseconds);
+		stream << ",\n      \"submitMilliseconds\": ";
+		writeSummary(stream, result.submitMilliseconds);
+		stream << ",\n      \"drawCalls\": ";
+		writeSummary(stream, result.drawCalls);
+		stream << ",\n      \"triangles\": ";
+		writeSummary(stream, result.triangles);
+		stream << ",\n      \"megaTrianglesPerSecond\": ";
+		writeSummary(stream, result.megaTrianglesPerSecond);
+		stream << ",\n      \"image\": ";
+		if (result.image.empty())
+		{
+			stream << "null";
+		}
+		else
+		{
+			writeString(stream, result.image);
+		}
+		stream << ",\n      \"streamStalls\": " << result.streamStalls;
+		stream << ",\n      \"gpuMilliseconds\": {";
+		for (size_t j = 0; j < result.gpuMilliseconds.size(); ++j)
+		{
+			stream << (j > 0 ? ",\n" : "\n") << "        ";
+			writeString(stream, result.gpuMilliseconds[j].first);
+			stream << ": ";
+			writeSummary(stream, result.gpuMilliseconds[j].second);
+		}
+		stream << (result.gpuMilliseconds.empty() ? "}" : "\n      }");
+		stream << ",\n      \"peakMemoryBytes\": " << result.peakMemory << "\n    }";
+	}
+
+	stream << (results.empty() ? "]" : "\n  ]") << ",\n  \"peakMemoryBytes\": " << peakMemory << "\n}\n";
+	return static_cast<bool>(stream);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "RenderContext.h"
+#include "Profiler.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Renders a fixed number of frames of every model in a list while the camera follows a
+// scripted path at a fixed time step, so that runs of different builds draw exactly the
+// same frames. A path is a JSON file of keys between which the camera moves linearly,
+// {"keys": [{"time": 0, "position": [0, 0, -10]}, ...]}, and it starts over once the
+// last key is passed. The results are written as a JSON report. In software mode the
+// same frames are drawn on the CPU, and each model's last frame is saved as a PPM image
+// next to the report.
+class Benchmark
+{
+public:
+	struct Settings
+	{
+		std::vector<std::string> models;
+		std::string cameraPath;
+		std::string report = "benchmark.json";
+		unsigned frames = 1000;
+		unsigned warmupFrames = 10;
+		double step = 1.0 / 60.0;
+		bool quantize = false;
+		// Draw with SoftwareRenderer instead of OpenGL, and keep each model's last frame.
+		bool software = false;
+		// Size of the offscreen target when run without a window.
+		int width = 1280;
+		int height = 720;
+	};
+
+	static bool parseArguments(const std::vector<std::string>& arguments, Settings& settings, std::string& error);
+	Benchmark(const Settings& settings);
+	~Benchmark() = default;
+	bool run(RenderContext* context);
+	bool runSoftware(float screenDepth, float screenNear);
+	bool writeReport() const;
+
+private:
+	struct Key
+	{
+		double time;
+		glm::vec3 position;
+	};
+
+	struct Result
+	{
+		std::string file;
+		std::string error;
+		double loadMilliseconds;
+		double firstFrameMilliseconds;
+		double totalMilliseconds;
+		Profiler::Summary frameMilliseconds;
+		Profiler::Summary submitMilliseconds;
+		Profiler::Summary drawCalls;
+		Profiler::Summary triangles;
+		Profiler::Summary megaTrianglesPerSecond;
+		std::string image;
+		unsigned streamStalls;
+		std::vector<std::pair<std::string, Profiler::Summary>> gpuMilliseconds;
+		size_t peakMemory;
+	};
+
+	bool loadPath(const std::string& file);
+	glm::vec3 getCameraPosition(double time) const;
+	bool measure(RenderContext* context, Result& result) const;
+	bool measureSoftware(const glm::mat4& projectionMatrix, Result& result, const std::string& image) const;
+
+	Settings settings;
+	std::vector<Key> keys;
+	std::vector<Result> results;
+	std::string renderer;
+	int width;
+	int height;
+};
@@ -0,0 +1,47 @@
+#include "Benchmark.h"
+#include "HeadlessContext.h"
+#include <cstdio>
+#include <exception>
+
+// Entry point of the benchmark on machines without a window system. It takes the same
+// arguments as OpenGLWin32.exe --benchmark and renders offscreen through EGL, or with
+// --software on the CPU, where no OpenGL driver is needed.
+int main(int argc, char** argv)
+{
+	const float screenDepth = 1000.0f;
+	const float screenNear = 0.1f;
+
+	Benchmark::Settings settings;
+	std::string error;
+	if (!Benchmark::parseArguments(std::vector<std::string>(argv + 1, argv + argc), settings, error))
+	{
+		std::fprintf(stderr, "%s\nUsage: %s [--frames n] [--warmup n] [--step seconds] [--path camera.json] [--report out.json] [--size WxH] [--quantize] [--software] model...\n", error.c_str(), argv[0]);
+		return 2;
+	}
+
+	try
+	{
+		Benchmark benchmark(settings);
+		bool succeeded = false;
+		if (settings.software)
+		{
+			succeeded = benchmark.runSoftware(screenDepth, screenNear);
+		}
+		else
+		{
+			HeadlessContext context(settings.width, settings.height, screenDepth, screenNear);
+			succeeded = benchmark.run(&context);
+		}
+		if (!benchmark.writeReport())
+		{
+			std::fprintf(stderr, "Cannot write %s.\n", settings.report.c_str());
+			return 1;
+		}
+		return succeeded ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+}
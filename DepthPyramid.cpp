@@ -0,0 +1,101 @@
+#include "DepthPyramid.h"
+#include "GLState.h"
+#include <algorithm>
+
+namespace
+{
+	const int reduceGroupSize = 8;
+}
+
+DepthPyramid::DepthPyramid() :
+	depthTexture(0),
+	pyramidTexture(0),
+	viewportSize(0, 0),
+	levels(0)
+{
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	const unsigned textures[] = { depthTexture, pyramidTexture };
+	GLState::instance().deleteTextures(2, textures);
+}
+
+// Textures are immutable, so a resized viewport replaces them.
+void DepthPyramid::allocate(int width, int height)
+{
+	GLState& state = GLState::instance();
+	const unsigned textures[] = { depthTexture, pyramidTexture };
+	state.deleteTextures(2, textures);
+
+	viewportSize = glm::ivec2(width, height);
+	const int pyramidWidth = std::max(width / 2, 1);
+	const int pyramidHeight = std::max(height / 2, 1);
+	levels = 1;
+	while ((pyramidWidth >> levels) > 0 || (pyramidHeight >> levels) > 0)
+	{
+		++levels;
+	}
+
+	glGenTextures(1, &depthTexture);
+	state.bindTexture(0, GL_TEXTURE_2D, depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &pyramidTexture);
+	state.bindTexture(0, GL_TEXTURE_2D, pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, pyramidWidth, pyramidHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// The depth buffer of the read framebuffer is copied out, since a window's depth buffer
+// cannot be sampled, and then halved level by level.
+void DepthPyramid::update(const Shader& reduceShader)
+{
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (viewport[2] != viewportSize.x || viewport[3] != viewportSize.y)
+	{
+		allocate(viewport[2], viewport[3]);
+	}
+
+	GLState& state = GLState::instance();
+	state.bindTexture(0, GL_TEXTURE_2D, depthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	constexpr uint32_t sourceName = hashName("source");
+	constexpr uint32_t sourceLevelName = hashName("sourceLevel");
+
+	reduceShader.setShader();
+	glUniform1i(reduceShader.getUniform(sourceName), 0);
+
+	for (int level = 0; level < levels; ++level)
+	{
+		// Level 0 reads the copied depth, every later level the one before it.
+		state.bindTexture(0, GL_TEXTURE_2D, level == 0 ? depthTexture : pyramidTexture);
+		glUniform1i(reduceShader.getUniform(sourceLevelName), level == 0 ? 0 : level - 1);
+		glBindImageTexture(0, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		const int width = std::max((viewportSize.x / 2) >> level, 1);
+		const int height = std::max((viewportSize.y / 2) >> level, 1);
+		glDispatchCompute(static_cast<unsigned>((width + reduceGroupSize - 1) / reduceGroupSize), static_cast<unsigned>((height + reduceGroupSize - 1) / reduceGroupSize), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+}
+
+void DepthPyramid::bind(unsigned unit) const
+{
+	GLState::instance().bindTexture(unit, GL_TEXTURE_2D, pyramidTexture);
+}
+
+glm::ivec2 DepthPyramid::getViewportSize() const
+{
+	return viewportSize;
+}
+
+int DepthPyramid::getLevels() const
+{
+	return levels;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Shader.h"
+#include <glm/glm.hpp>
+
+// Mip chain of the farthest depth over ever larger screen areas, built from the depth
+// buffer of the draws so far. Level 0 is half the viewport; a bounding box whose nearest
+// depth lies behind every texel it covers at a coarse enough level is hidden.
+class DepthPyramid
+{
+public:
+	DepthPyramid();
+	~DepthPyramid();
+	DepthPyramid(const DepthPyramid&) = delete;
+	DepthPyramid& operator=(const DepthPyramid&) = delete;
+	void update(const Shader& reduceShader);
+	void bind(unsigned unit) const;
+	glm::ivec2 getViewportSize() const;
+	int getLevels() const;
+
+private:
+	void allocate(int width, int height);
+
+	unsigned depthTexture;
+	unsigned pyramidTexture;
+	glm::ivec2 viewportSize;
+	int levels;
+};
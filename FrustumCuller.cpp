@@ -0,0 +1,225 @@
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+namespace
+{
+	// Volumes are padded to a whole number of the widest vector so no loop needs a tail.
+	const size_t lanes = 8;
+	const size_t cullGrain = 4096;
+
+	// Stands in for the size of primitives without bounds, large enough that they are
+	// never culled and small enough that transforming it stays finite.
+	const float unbounded = 1e30f;
+}
+
+FrustumCuller::FrustumCuller() :
+	count(0)
+{
+}
+
+void FrustumCuller::clear()
+{
+	count = 0;
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	radius.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+// The box is moved to world space around its transformed centre; the sphere keeps the
+// box's half diagonal, scaled by the largest axis scale. A rotated box is bounded more
+// tightly by the sphere, an axis-aligned one by the box, and a volume is culled when
+// either lies outside a plane.
+void FrustumCuller::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform)
+{
+	// Any padding left by the last cull is dropped before the volume goes at the end.
+	for (std::vector<float>* values : { &centreX, &centreY, &centreZ, &radius, &extentX, &extentY, &extentZ })
+	{
+		values->resize(count + 1, 0.0f);
+	}
+	set(count++, boundsMin, boundsMax, transform);
+}
+
+// Replaces a volume in place, for an object that has moved.
+void FrustumCuller::set(size_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform)
+{
+	const bool bounded = boundsMin.x <= boundsMax.x && boundsMin.y <= boundsMax.y && boundsMin.z <= boundsMax.z;
+	const glm::vec3 localCentre = bounded ? (boundsMin + boundsMax) * 0.5f : glm::vec3(0.0f);
+	const glm::vec3 localExtent = bounded ? (boundsMax - boundsMin) * 0.5f : glm::vec3(unbounded);
+
+	const glm::vec3 centre(transform * glm::vec4(localCentre, 1.0f));
+	glm::vec3 extent(0.0f);
+	float scale = 0.0f;
+	for (int column = 0; column < 3; ++column)
+	{
+		const glm::vec3 axis(transform[column]);
+		extent += glm::abs(axis) * localExtent[column];
+		scale = std::max(scale, glm::dot(axis, axis));
+	}
+
+	centreX[index] = centre.x;
+	centreY[index] = centre.y;
+	centreZ[index] = centre.z;
+	radius[index] = bounded ? glm::length(localExtent) * std::sqrt(scale) : unbounded;
+	extentX[index] = extent.x;
+	extentY[index] = extent.y;
+	extentZ[index] = extent.z;
+}
+
+// Planes come out of the combined matrix (Gribb and Hartmann) and are normalized so that
+// plane distances can be compared with sphere radii. Normals point into the frustum.
+void FrustumCuller::extractPlanes(const glm::mat4& viewProjectionMatrix, glm::vec4 (&planes)[6])
+{
+	const glm::vec4 row0(viewProjectionMatrix[0][0], viewProjectionMatrix[1][0], viewProjectionMatrix[2][0], viewProjectionMatrix[3][0]);
+	const glm::vec4 row1(viewProjectionMatrix[0][1], viewProjectionMatrix[1][1], viewProjectionMatrix[2][1], viewProjectionMatrix[3][1]);
+	const glm::vec4 row2(viewProjectionMatrix[0][2], viewProjectionMatrix[1][2], viewProjectionMatrix[2][2], viewProjectionMatrix[3][2]);
+	const glm::vec4 row3(viewProjectionMatrix[0][3], viewProjectionMatrix[1][3], viewProjectionMatrix[2][3], viewProjectionMatrix[3][3]);
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+
+	for (glm::vec4& plane : planes)
+	{
+		const float length = glm::length(glm::vec3(plane));
+		plane = length > 0.0f ? plane * (1.0f / length) : plane;
+	}
+}
+
+size_t FrustumCuller::cull(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+	visibility.assign(count, 1);
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	const size_t padded = (count + lanes - 1) / lanes * lanes;
+	for (std::vector<float>* values : { &centreX, &centreY, &centreZ, &radius, &extentX, &extentY, &extentZ })
+	{
+		values->resize(padded, 0.0f);
+	}
+	visibility.resize(padded);
+
+	glm::vec4 planes[6];
+	extractPlanes(projectionMatrix * viewMatrix, planes);
+
+	ThreadPool::instance().parallelFor(padded, cullGrain, [&](size_t begin, size_t end)
+	{
+		cullRange(planes, begin, end);
+	});
+
+	visibility.resize(count);
+	return static_cast<size_t>(std::count(visibility.begin(), visibility.end(), static_cast<uint8_t>(1)));
+}
+
+// A volume is outside when its centre lies further behind a plane than the smaller of
+// its sphere radius and the box's projected radius on that plane's normal.
+void FrustumCuller::cullRange(const glm::vec4 (&planes)[6], size_t begin, size_t end)
+{
+#if defined(FRUSTUM_CULLER_AVX)
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	for (size_t i = begin; i < end; i += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(&centreX[i]);
+		const __m256 y = _mm256_loadu_ps(&centreY[i]);
+		const __m256 z = _mm256_loadu_ps(&centreZ[i]);
+		const __m256 r = _mm256_loadu_ps(&radius[i]);
+		const __m256 ex = _mm256_loadu_ps(&extentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&extentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&extentZ[i]);
+
+		__m256 outside = _mm256_setzero_ps();
+		for (const glm::vec4& plane : planes)
+		{
+			const __m256 nx = _mm256_set1_ps(plane.x);
+			const __m256 ny = _mm256_set1_ps(plane.y);
+			const __m256 nz = _mm256_set1_ps(plane.z);
+			const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, x), _mm256_mul_ps(ny, y)), _mm256_add_ps(_mm256_mul_ps(nz, z), _mm256_set1_ps(plane.w)));
+			const __m256 boxRadius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex), _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)), _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+			const __m256 reach = _mm256_min_ps(r, boxRadius);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		const int mask = _mm256_movemask_ps(outside);
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			visibility[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+		}
+	}
+#elif defined(FRUSTUM_CULLER_SSE)
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	for (size_t i = begin; i < end; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&centreX[i]);
+		const __m128 y = _mm_loadu_ps(&centreY[i]);
+		const __m128 z = _mm_loadu_ps(&centreZ[i]);
+		const __m128 r = _mm_loadu_ps(&radius[i]);
+		const __m128 ex = _mm_loadu_ps(&extentX[i]);
+		const __m128 ey = _mm_loadu_ps(&extentY[i]);
+		const __m128 ez = _mm_loadu_ps(&extentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (const glm::vec4& plane : planes)
+		{
+			const __m128 nx = _mm_set1_ps(plane.x);
+			const __m128 ny = _mm_set1_ps(plane.y);
+			const __m128 nz = _mm_set1_ps(plane.z);
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_add_ps(_mm_mul_ps(nz, z), _mm_set1_ps(plane.w)));
+			const __m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex), _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+			const __m128 reach = _mm_min_ps(r, boxRadius);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		const int mask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			visibility[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+		}
+	}
+#else
+	for (size_t i = begin; i < end; ++i)
+	{
+		bool outside = false;
+		for (const glm::vec4& plane : planes)
+		{
+			const float distance = plane.x * centreX[i] + plane.y * centreY[i] + plane.z * centreZ[i] + plane.w;
+			const float boxRadius = std::fabs(plane.x) * extentX[i] + std::fabs(plane.y) * extentY[i] + std::fabs(plane.z) * extentZ[i];
+			outside = outside || distance + std::min(radius[i], boxRadius) < 0.0f;
+		}
+		visibility[i] = outside ? 0 : 1;
+	}
+#endif
+}
+
+const std::vector<uint8_t>& FrustumCuller::getVisibility() const
+{
+	return visibility;
+}
+
+size_t FrustumCuller::getCount() const
+{
+	return count;
+}
+
+void FrustumCuller::getBounds(size_t index, glm::vec4& sphere, glm::vec3& extent) const
+{
+	sphere = glm::vec4(centreX[index], centreY[index], centreZ[index], radius[index]);
+	extent = glm::vec3(extentX[index], extentY[index], extentZ[index]);
+}
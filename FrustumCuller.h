@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Tests world-space bounds against the view frustum. Each volume is kept as a bounding
+// sphere and a box in structure-of-arrays form, so four volumes are tested per SSE
+// instruction (eight when built for AVX), and large sets are split over the thread pool.
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	~FrustumCuller() = default;
+	void clear();
+	void add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform);
+	void set(size_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform);
+	size_t cull(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+	const std::vector<uint8_t>& getVisibility() const;
+	size_t getCount() const;
+	void getBounds(size_t index, glm::vec4& sphere, glm::vec3& extent) const;
+	static void extractPlanes(const glm::mat4& viewProjectionMatrix, glm::vec4 (&planes)[6]);
+
+private:
+	void cullRange(const glm::vec4 (&planes)[6], size_t begin, size_t end);
+
+	size_t count;
+	std::vector<float> centreX;
+	std::vector<float> centreY;
+	std::vector<float> centreZ;
+	std::vector<float> radius;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+	std::vector<uint8_t> visibility;
+};
@@ -0,0 +1,298 @@
+#include "GLState.h"
+
+GLState::GLState() :
+	counts{}
+{
+	invalidate();
+}
+
+GLState& GLState::instance()
+{
+	static GLState state;
+	return state;
+}
+
+void GLState::invalidate()
+{
+	program = unknown;
+	vao = unknown;
+	arrayBuffer = unknown;
+	elementBuffer = unknown;
+	uniformBuffer = unknown;
+	indirectBuffer = unknown;
+	storageBuffer = unknown;
+	activeTexture = unknown;
+	for (Range& range : uniformRanges)
+	{
+		range.buffer = unknown;
+	}
+	for (Range& range : storageRanges)
+	{
+		range.buffer = unknown;
+	}
+	for (Texture& texture : textures)
+	{
+		texture.texture = unknown;
+	}
+	capabilities.clear();
+	pointSize = -1.0f;
+	clearColourKnown = false;
+}
+
+bool GLState::elide(bool current)
+{
+	if (current)
+	{
+		++counts.elided;
+	}
+	else
+	{
+		++counts.issued;
+	}
+	return current;
+}
+
+void GLState::useProgram(unsigned program)
+{
+	if (!elide(this->program == program))
+	{
+		glUseProgram(program);
+		this->program = program;
+	}
+}
+
+// The element buffer binding belongs to the vertex array, so it is unknown after a switch.
+void GLState::bindVertexArray(unsigned vao)
+{
+	if (!elide(this->vao == vao))
+	{
+		glBindVertexArray(vao);
+		this->vao = vao;
+		elementBuffer = unknown;
+	}
+}
+
+unsigned* GLState::getBufferBinding(unsigned target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+		return &arrayBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		return &elementBuffer;
+	case GL_UNIFORM_BUFFER:
+		return &uniformBuffer;
+	case GL_DRAW_INDIRECT_BUFFER:
+		return &indirectBuffer;
+	case GL_SHADER_STORAGE_BUFFER:
+		return &storageBuffer;
+	default:
+		return nullptr;
+	}
+}
+
+GLState::Range* GLState::getRangeBinding(unsigned target, unsigned index)
+{
+	if (index >= maxRangeBindings)
+	{
+		return nullptr;
+	}
+
+	switch (target)
+	{
+	case GL_UNIFORM_BUFFER:
+		return &uniformRanges[index];
+	case GL_SHADER_STORAGE_BUFFER:
+		return &storageRanges[index];
+	default:
+		return nullptr;
+	}
+}
+
+void GLState::bindBuffer(unsigned target, unsigned buffer)
+{
+	unsigned* binding = getBufferBinding(target);
+	if (binding && elide(*binding == buffer))
+	{
+		return;
+	}
+
+	if (!binding)
+	{
+		++counts.issued;
+	}
+
+	glBindBuffer(target, buffer);
+	if (binding)
+	{
+		*binding = buffer;
+	}
+}
+
+// Binding a range also replaces the generic binding of the target.
+void GLState::bindBufferRange(unsigned target, unsigned index, unsigned buffer, ptrdiff_t offset, ptrdiff_t size)
+{
+	Range* range = getRangeBinding(target, index);
+	if (range && elide(range->buffer == buffer && range->offset == offset && range->size == size))
+	{
+		return;
+	}
+
+	if (!range)
+	{
+		++counts.issued;
+	}
+
+	glBindBufferRange(target, index, buffer, offset, size);
+	if (range)
+	{
+		*range = { buffer, offset, size };
+	}
+
+	unsigned* binding = getBufferBinding(target);
+	if (binding)
+	{
+		*binding = buffer;
+	}
+}
+
+void GLState::bindTexture(unsigned unit, unsigned target, unsigned texture)
+{
+	if (unit < maxTextureUnits && elide(textures[unit].texture == texture && textures[unit].target == target))
+	{
+		return;
+	}
+
+	if (unit >= maxTextureUnits)
+	{
+		++counts.issued;
+	}
+
+	if (activeTexture != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeTexture = unit;
+		++counts.issued;
+	}
+
+	glBindTexture(target, texture);
+	if (unit < maxTextureUnits)
+	{
+		textures[unit] = { target, texture };
+	}
+}
+
+void GLState::setEnabled(unsigned capability, bool enabled)
+{
+	const auto found = capabilities.find(capability);
+	if (elide(found != capabilities.end() && found->second == enabled))
+	{
+		return;
+	}
+
+	if (enabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+	capabilities[capability] = enabled;
+}
+
+void GLState::setClearColour(const glm::vec4& colour)
+{
+	if (!elide(clearColourKnown && clearColour == colour))
+	{
+		glClearColor(colour.x, colour.y, colour.z, colour.w);
+		clearColour = colour;
+		clearColourKnown = true;
+	}
+}
+
+void GLState::setPointSize(float size)
+{
+	if (!elide(pointSize == size))
+	{
+		glPointSize(size);
+		pointSize = size;
+	}
+}
+
+// GL unbinds deleted objects, and a later object may reuse the name, so the shadow
+// bindings must forget them too.
+void GLState::deleteProgram(unsigned program)
+{
+	glDeleteProgram(program);
+	if (this->program == program)
+	{
+		this->program = unknown;
+	}
+}
+
+void GLState::deleteVertexArrays(int count, const unsigned* vaos)
+{
+	glDeleteVertexArrays(count, vaos);
+	for (int i = 0; i < count; ++i)
+	{
+		if (vao == vaos[i])
+		{
+			vao = unknown;
+			elementBuffer = unknown;
+		}
+	}
+}
+
+void GLState::deleteBuffers(int count, const unsigned* buffers)
+{
+	glDeleteBuffers(count, buffers);
+	for (int i = 0; i < count; ++i)
+	{
+		for (unsigned* binding : { &arrayBuffer, &elementBuffer, &uniformBuffer, &indirectBuffer, &storageBuffer })
+		{
+			if (*binding == buffers[i])
+			{
+				*binding = unknown;
+			}
+		}
+
+		for (Range& range : uniformRanges)
+		{
+			if (range.buffer == buffers[i])
+			{
+				range.buffer = unknown;
+			}
+		}
+
+		for (Range& range : storageRanges)
+		{
+			if (range.buffer == buffers[i])
+			{
+				range.buffer = unknown;
+			}
+		}
+	}
+}
+
+void GLState::deleteTextures(int count, const unsigned* textures)
+{
+	glDeleteTextures(count, textures);
+	for (int i = 0; i < count; ++i)
+	{
+		for (Texture& texture : this->textures)
+		{
+			if (texture.texture == textures[i])
+			{
+				texture.texture = unknown;
+			}
+		}
+	}
+}
+
+GLState::Counts GLState::takeCounts()
+{
+	const Counts taken = counts;
+	counts = {};
+	return taken;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <unordered_map>
+
+// Shadow copy of the GL bindings and switches the renderer changes per draw. Calls that
+// would set what is already current are skipped and counted. Code that changes state
+// behind its back, such as loaders building vertex arrays, calls invalidate afterwards.
+class GLState
+{
+public:
+	struct Counts
+	{
+		unsigned issued;
+		unsigned elided;
+	};
+
+	static GLState& instance();
+	void invalidate();
+	void useProgram(unsigned program);
+	void bindVertexArray(unsigned vao);
+	void bindBuffer(unsigned target, unsigned buffer);
+	void bindBufferRange(unsigned target, unsigned index, unsigned buffer, ptrdiff_t offset, ptrdiff_t size);
+	void bindTexture(unsigned unit, unsigned target, unsigned texture);
+	void setEnabled(unsigned capability, bool enabled);
+	void setClearColour(const glm::vec4& colour);
+	void setPointSize(float size);
+	void deleteProgram(unsigned program);
+	void deleteVertexArrays(int count, const unsigned* vaos);
+	void deleteBuffers(int count, const unsigned* buffers);
+	void deleteTextures(int count, const unsigned* textures);
+	Counts takeCounts();
+
+private:
+	static const unsigned unknown = ~0u;
+	static const unsigned maxTextureUnits = 32;
+	static const unsigned maxRangeBindings = 16;
+
+	struct Range
+	{
+		unsigned buffer;
+		ptrdiff_t offset;
+		ptrdiff_t size;
+	};
+
+	struct Texture
+	{
+		unsigned target;
+		unsigned texture;
+	};
+
+	GLState();
+	bool elide(bool current);
+	unsigned* getBufferBinding(unsigned target);
+	Range* getRangeBinding(unsigned target, unsigned index);
+
+	unsigned program;
+	unsigned vao;
+	unsigned arrayBuffer;
+	unsigned elementBuffer;
+	unsigned uniformBuffer;
+	unsigned indirectBuffer;
+	unsigned storageBuffer;
+	unsigned activeTexture;
+	Range uniformRanges[maxRangeBindings];
+	Range storageRanges[maxRangeBindings];
+	Texture textures[maxTextureUnits];
+	std::unordered_map<unsigned, bool> capabilities;
+	glm::vec4 clearColour;
+	float pointSize;
+	bool clearColourKnown;
+	Counts counts;
+};
@@ -0,0 +1,385 @@
+#include "GlbLoader.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	const uint32_t glbMagic = 0x46546C67;
+	const uint32_t jsonChunk = 0x4E4F534A;
+	const uint32_t binChunk = 0x004E4942;
+
+	uint32_t readUint32(const char* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+}
+
+bool GlbLoader::load(const std::string& filename, int meshIndex, std::vector<Model::Primitive>& primitives, std::vector<unsigned>& buffers)
+{
+	const size_t firstPrimitive = primitives.size();
+	const size_t firstBuffer = buffers.size();
+	if (loadMesh(filename, meshIndex, primitives, buffers))
+	{
+		return true;
+	}
+
+	// The model is not constructed when loading fails, so nothing else would delete these.
+	GLState& state = GLState::instance();
+	state.invalidate();
+	for (size_t i = firstPrimitive; i < primitives.size(); ++i)
+	{
+		state.deleteVertexArrays(1, &primitives[i].vao);
+	}
+	if (buffers.size() > firstBuffer)
+	{
+		state.deleteBuffers(static_cast<int>(buffers.size() - firstBuffer), &buffers[firstBuffer]);
+	}
+	primitives.resize(firstPrimitive);
+	buffers.resize(firstBuffer);
+	return false;
+}
+
+bool GlbLoader::loadMesh(const std::string& filename, int meshIndex, std::vector<Model::Primitive>& primitives, std::vector<unsigned>& buffers)
+{
+	MappedFile file(filename);
+	if (!file.isOpen())
+	{
+		error = "Cannot open GLB file!";
+		return false;
+	}
+
+	const char* data = file.data();
+	const size_t size = file.size();
+	if (size < 20 || readUint32(data) != glbMagic || readUint32(data + 4) != 2 || readUint32(data + 8) > size)
+	{
+		error = "Not a glTF 2.0 binary file!";
+		return false;
+	}
+
+	const size_t jsonLength = readUint32(data + 12);
+	if (readUint32(data + 16) != jsonChunk || jsonLength > size - 20)
+	{
+		error = "GLB file has no JSON chunk!";
+		return false;
+	}
+
+	JsonValue document;
+	if (!JsonValue::parse(data + 20, data + 20 + jsonLength, document, error))
+	{
+		return false;
+	}
+
+	// The BIN chunk is optional and must directly follow the JSON chunk.
+	const char* bin = nullptr;
+	size_t binSize = 0;
+	const size_t binHeader = 20 + ((jsonLength + 3) & ~static_cast<size_t>(3));
+	if (binHeader + 8 <= size && readUint32(data + binHeader + 4) == binChunk)
+	{
+		binSize = readUint32(data + binHeader);
+		bin = data + binHeader + 8;
+		if (binSize > size - binHeader - 8)
+		{
+			error = "GLB BIN chunk is truncated!";
+			return false;
+		}
+	}
+
+	const JsonValue& meshes = document["meshes"];
+	if (meshIndex < 0 || static_cast<size_t>(meshIndex) >= meshes.size())
+	{
+		error = "GLB file has no mesh " + std::to_string(meshIndex) + "!";
+		return false;
+	}
+
+	uploadedViews.assign(document["bufferViews"].size(), 0);
+
+	const JsonValue& meshPrimitives = meshes[meshIndex]["primitives"];
+	for (size_t i = 0; i < meshPrimitives.size(); ++i)
+	{
+		const JsonValue& primitive = meshPrimitives[i];
+		const JsonValue& attributes = primitive["attributes"];
+
+		if (primitive["extensions"].has("KHR_draco_mesh_compression"))
+		{
+			error = "Draco compressed GLB primitives are not supported!";
+			return false;
+		}
+
+		Accessor position;
+		if (!attributes.has("POSITION") || !readAccessor(document, static_cast<int>(attributes["POSITION"].asNumber(-1)), bin, binSize, position))
+		{
+			if (error.empty())
+			{
+				error = "GLB primitive has no POSITION attribute!";
+			}
+			return false;
+		}
+
+		if (position.components != 3)
+		{
+			error = "GLB POSITION must be VEC3!";
+			return false;
+		}
+
+		Accessor normal;
+		const bool hasNormals = attributes.has("NORMAL");
+		if (hasNormals && (!readAccessor(document, static_cast<int>(attributes["NORMAL"].asNumber(-1)), bin, binSize, normal) || normal.components != 3 || normal.count != position.count))
+		{
+			error = "GLB NORMAL accessor does not match POSITION!";
+			return false;
+		}
+
+		Accessor index;
+		const bool hasIndices = primitive.has("indices");
+		if (hasIndices)
+		{
+			if (!readAccessor(document, static_cast<int>(primitive["indices"].asNumber(-1)), bin, binSize, index) || index.components != 1 ||
+				(index.componentType != GL_UNSIGNED_BYTE && index.componentType != GL_UNSIGNED_SHORT && index.componentType != GL_UNSIGNED_INT) ||
+				document["bufferViews"][static_cast<size_t>(index.bufferView)].has("byteStride"))
+			{
+				error = "GLB indices must be tightly packed unsigned integers!";
+				return false;
+			}
+
+			if (!checkIndices(document, index, bin, position.count))
+			{
+				error = "GLB index refers to a vertex past the end of POSITION!";
+				return false;
+			}
+		}
+
+		// glTF primitive modes use the same values as the GL enums, POINTS (0) to TRIANGLE_FAN (6).
+		const int mode = static_cast<int>(primitive["mode"].asNumber(GL_TRIANGLES));
+		if (mode < GL_POINTS || mode > GL_TRIANGLE_FAN)
+		{
+			error = "GLB primitive has an invalid mode!";
+			return false;
+		}
+
+		Model::Primitive drawable;
+		glGenVertexArrays(1, &drawable.vao);
+		glBindVertexArray(drawable.vao);
+
+		const auto bindAttribute = [&](unsigned location, const Accessor& accessor)
+		{
+			const unsigned buffer = uploadBufferView(document, accessor.bufferView, GL_ARRAY_BUFFER, bin, buffers);
+			const GLsizei stride = static_cast<GLsizei>(document["bufferViews"][static_cast<size_t>(accessor.bufferView)]["byteStride"].asNumber(0));
+
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, accessor.components, accessor.componentType, accessor.normalized ? GL_TRUE : GL_FALSE, stride, reinterpret_cast<const void*>(accessor.byteOffset));
+		};
+
+		bindAttribute(0, position);
+		if (hasNormals)
+		{
+			bindAttribute(1, normal);
+		}
+		else
+		{
+			glVertexAttrib3f(1, 0.0f, 0.0f, -1.0f);
+		}
+
+		if (hasIndices)
+		{
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uploadBufferView(document, index.bufferView, GL_ELEMENT_ARRAY_BUFFER, bin, buffers));
+			drawable.indexType = index.componentType;
+			drawable.indexOffset = index.byteOffset;
+			drawable.count = static_cast<int>(index.count);
+		}
+		else
+		{
+			drawable.indexType = 0;
+			drawable.indexOffset = 0;
+			drawable.count = static_cast<int>(position.count);
+		}
+		drawable.mode = static_cast<unsigned>(mode);
+		drawable.normals = hasNormals;
+		drawable.quantized = false;
+		// Normalized positions carry their bounds in integer units, so they are left unbounded.
+		const bool bounded = position.bounded && !position.normalized;
+		drawable.boundsMin = bounded ? position.minimum : glm::vec3(1.0f);
+		drawable.boundsMax = bounded ? position.maximum : glm::vec3(-1.0f);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		primitives.push_back(drawable);
+	}
+
+	if (primitives.empty())
+	{
+		error = "GLB mesh has no primitives!";
+		return false;
+	}
+
+	return true;
+}
+
+std::string GlbLoader::getError() const
+{
+	return error;
+}
+
+bool GlbLoader::readAccessor(const JsonValue& document, int index, const char* bin, size_t binSize, Accessor& accessor)
+{
+	const JsonValue& accessors = document["accessors"];
+	if (index < 0 || static_cast<size_t>(index) >= accessors.size())
+	{
+		error = "GLB accessor index is out of range!";
+		return false;
+	}
+
+	const JsonValue& json = accessors[static_cast<size_t>(index)];
+	if (!json.has("bufferView") || json.has("sparse"))
+	{
+		error = "Sparse or empty GLB accessors are not supported!";
+		return false;
+	}
+
+	accessor.bufferView = static_cast<int>(json["bufferView"].asNumber(-1));
+	accessor.byteOffset = static_cast<size_t>(json["byteOffset"].asNumber(0));
+	accessor.componentType = static_cast<unsigned>(json["componentType"].asNumber(0));
+	accessor.components = getComponentCount(json["type"].asString());
+	accessor.count = static_cast<size_t>(json["count"].asNumber(0));
+	accessor.normalized = json["normalized"].asBool(false);
+
+	// glTF requires min and max on POSITION accessors, which saves a pass over the data.
+	const JsonValue& minimum = json["min"];
+	const JsonValue& maximum = json["max"];
+	accessor.bounded = minimum.size() >= 3 && maximum.size() >= 3;
+	for (size_t i = 0; i < 3 && accessor.bounded; ++i)
+	{
+		accessor.minimum[static_cast<int>(i)] = static_cast<float>(minimum[i].asNumber(0));
+		accessor.maximum[static_cast<int>(i)] = static_cast<float>(maximum[i].asNumber(0));
+	}
+
+	const size_t componentSize = getComponentSize(accessor.componentType);
+	if (componentSize == 0 || accessor.components == 0 || accessor.count == 0 || accessor.byteOffset % componentSize != 0)
+	{
+		error = "GLB accessor has an invalid type or alignment!";
+		return false;
+	}
+
+	const JsonValue& views = document["bufferViews"];
+	if (accessor.bufferView < 0 || static_cast<size_t>(accessor.bufferView) >= views.size())
+	{
+		error = "GLB bufferView index is out of range!";
+		return false;
+	}
+
+	const JsonValue& view = views[static_cast<size_t>(accessor.bufferView)];
+	if (view["buffer"].asNumber(-1) != 0 || document["buffers"][0].has("uri") || !bin)
+	{
+		error = "GLB data outside the BIN chunk is not supported!";
+		return false;
+	}
+
+	const size_t viewOffset = static_cast<size_t>(view["byteOffset"].asNumber(0));
+	const size_t viewLength = static_cast<size_t>(view["byteLength"].asNumber(0));
+	const size_t elementSize = componentSize * static_cast<size_t>(accessor.components);
+	const size_t stride = static_cast<size_t>(view["byteStride"].asNumber(0));
+
+	if (viewOffset > binSize || viewLength > binSize - viewOffset)
+	{
+		error = "GLB bufferView lies outside the BIN chunk!";
+		return false;
+	}
+
+	if (stride != 0 && (stride < elementSize || stride > 252 || stride % 4 != 0))
+	{
+		error = "GLB bufferView has an invalid byteStride!";
+		return false;
+	}
+
+	const size_t step = stride ? stride : elementSize;
+	if (accessor.byteOffset > viewLength || viewLength - accessor.byteOffset < elementSize || (accessor.count - 1) > (viewLength - accessor.byteOffset - elementSize) / step)
+	{
+		error = "GLB accessor lies outside its bufferView!";
+		return false;
+	}
+
+	return true;
+}
+
+unsigned GlbLoader::uploadBufferView(const JsonValue& document, int index, unsigned target, const char* bin, std::vector<unsigned>& buffers)
+{
+	unsigned& buffer = uploadedViews[static_cast<size_t>(index)];
+	if (buffer != 0)
+	{
+		return buffer;
+	}
+
+	const JsonValue& view = document["bufferViews"][static_cast<size_t>(index)];
+	const size_t offset = static_cast<size_t>(view["byteOffset"].asNumber(0));
+	const size_t length = static_cast<size_t>(view["byteLength"].asNumber(0));
+
+	// The mapped bytes are already in the layout GL expects, so they are uploaded directly.
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	glBufferData(target, static_cast<GLsizeiptr>(length), bin + offset, GL_STATIC_DRAW);
+	buffers.push_back(buffer);
+
+	return buffer;
+}
+
+bool GlbLoader::checkIndices(const JsonValue& document, const Accessor& index, const char* bin, size_t vertexCount)
+{
+	const JsonValue& view = document["bufferViews"][static_cast<size_t>(index.bufferView)];
+	const char* values = bin + static_cast<size_t>(view["byteOffset"].asNumber(0)) + index.byteOffset;
+	const size_t size = getComponentSize(index.componentType);
+	for (size_t i = 0; i < index.count; ++i)
+	{
+		uint32_t value = 0;
+		if (size == 1)
+		{
+			value = static_cast<uint8_t>(values[i]);
+		}
+		else if (size == 2)
+		{
+			uint16_t shortValue;
+			std::memcpy(&shortValue, values + i * 2, sizeof(shortValue));
+			value = shortValue;
+		}
+		else
+		{
+			value = readUint32(values + i * 4);
+		}
+
+		if (value >= vertexCount)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t GlbLoader::getComponentSize(unsigned componentType)
+{
+	switch (componentType)
+	{
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	case GL_UNSIGNED_INT:
+	case GL_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+int GlbLoader::getComponentCount(const std::string& type)
+{
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	return 0;
+}
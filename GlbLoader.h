@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Json.h"
+#include "Model.h"
+#include <string>
+#include <vector>
+
+// Binary glTF reader. Accessors are validated against the mapped BIN chunk and
+// every referenced bufferView is handed to glBufferData as-is, without conversion.
+// Index values are checked against the vertex count before anything reaches the GPU,
+// and a file that fails part way releases the vertex arrays and buffers it created.
+class GlbLoader
+{
+public:
+	GlbLoader() = default;
+	~GlbLoader() = default;
+	bool load(const std::string& filename, int meshIndex, std::vector<Model::Primitive>& primitives, std::vector<unsigned>& buffers);
+	std::string getError() const;
+
+private:
+	struct Accessor
+	{
+		int bufferView;
+		size_t byteOffset;
+		unsigned componentType;
+		int components;
+		size_t count;
+		bool normalized;
+		bool bounded;
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+	};
+
+	bool loadMesh(const std::string& filename, int meshIndex, std::vector<Model::Primitive>& primitives, std::vector<unsigned>& buffers);
+	bool readAccessor(const JsonValue& document, int index, const char* bin, size_t binSize, Accessor& accessor);
+	unsigned uploadBufferView(const JsonValue& document, int index, unsigned target, const char* bin, std::vector<unsigned>& buffers);
+	static bool checkIndices(const JsonValue& document, const Accessor& index, const char* bin, size_t vertexCount);
+	static size_t getComponentSize(unsigned componentType);
+	static int getComponentCount(const std::string& type);
+
+	std::vector<unsigned> uploadedViews;
+	std::string error;
+};
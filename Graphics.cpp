@@ -1,32 +1,107 @@
 #include "Graphics.h"
-#include <exception>
+#include "Profiler.h"
+#include "GLState.h"
+#include "NormalMatrices.h"
+#include <algorithm>
+#include <stdexcept>
 #include <glm/gtc/matrix_transform.hpp>
 
-Graphics::Graphics(OpenGL* OpenGL) :
+namespace
+{
+	// Draws missing from a visibility list are visible.
+	const std::vector<uint8_t> noVisibility;
+}
+
+Graphics::Graphics(RenderContext* renderContext) :
 	context(nullptr),
 	camera(nullptr),
 	model(nullptr),
-	shader(nullptr),
-	light(nullptr)
+	shaderCache(nullptr),
+	shaders(nullptr),
+	light(nullptr),
+	stream(nullptr),
+	frameBuffer(nullptr),
+	objectBuffer(nullptr),
+	instanceBuffer(nullptr),
+	batches(nullptr),
+	culler(nullptr),
+	depthPyramid(nullptr),
+	scene(nullptr),
+	objectsDirty(true),
+	batchesDirty(true),
+	gpuCulling(true),
+	occlusionCulling(true),
+	material(defaultMaterial),
+	pointMode(false),
+	quantizePositions(false),
+	pointBudget(1 << 21),
+	stats{}
 {
-	context = OpenGL;
+	context = renderContext;
 
 	if (!initialize())
 	{
-		throw std::exception("Cannot initialize graphics!");
+		throw std::runtime_error("Cannot initialize graphics!");
 	}
 }
 
 Graphics::~Graphics()
 {
+	Profiler::instance().releaseQueries();
+
+	if (scene)
+	{
+		delete scene;
+	}
+
+	if (depthPyramid)
+	{
+		delete depthPyramid;
+	}
+
+	if (culler)
+	{
+		delete culler;
+	}
+
+	if (batches)
+	{
+		delete batches;
+	}
+
+	if (instanceBuffer)
+	{
+		delete instanceBuffer;
+	}
+
+	if (objectBuffer)
+	{
+		delete objectBuffer;
+	}
+
+	if (frameBuffer)
+	{
+		delete frameBuffer;
+	}
+
+	if (stream)
+	{
+		delete stream;
+	}
+
 	if (light)
 	{
 		delete light;
 	}
 
-	if (shader)
+	if (shaders)
 	{
-		delete shader;
+		delete shaders;
+	}
+
+	if (shaderCache)
+	{
+		delete shaderCache;
 	}
 
 	if (model)
@@ -46,9 +121,11 @@ bool Graphics::initialize()
 	camPos = { 0.0f, 0.0f, -10.0f };
 	camera->setPosition(camPos);
 
+	shaderCache = new ShaderCache(context->getVideoCardInfo());
+
 	try
 	{
-		shader = new Shader;
+		shaders = new ShaderLibrary(shaderCache);
 	}
 	catch (const std::exception&)
 	{
@@ -56,9 +133,28 @@ bool Graphics::initialize()
 	}
 
 	light = new Light;
-	light->setDiffuseColour({ 1.0f, 1.0f, 1.0f, 1.0f });
+	light->setDiffuseColour(defaultLightColour);
 	light->setDirection({ 1.0f, 0.0f, 0.0f });
-	light->setAmbientLight({0.15f, 0.15f, 0.15f, 1.0f});
+	light->setAmbientLight(defaultAmbientLight);
+	light->setPosition(defaultLightPosition);
+
+	// Uniforms written every frame go through persistently mapped memory where it exists.
+	if (StreamBuffer::isSupported())
+	{
+		stream = new StreamBuffer(streamRegionSize);
+	}
+
+	frameBuffer = new UniformBuffer(frameBlockBinding, sizeof(FrameBlock), stream);
+	objectBuffer = new UniformBuffer(objectBlockBinding, sizeof(ObjectBlock), stream);
+	instanceBuffer = new InstanceBuffer;
+	culler = new FrustumCuller;
+	scene = new Scene;
+
+	if (BatchRenderer::isSupported())
+	{
+		batches = new BatchRenderer;
+		depthPyramid = new DepthPyramid;
+	}
 
 	return true;
 }
@@ -85,56 +181,544 @@ void Graphics::move(Direction dir)
 	camera->setPosition(camPos);
 }
 
+void Graphics::setCameraPosition(const glm::vec3& position)
+{
+	camPos = position;
+	camera->setPosition(camPos);
+}
+
+// Applies to the models loaded after it.
+void Graphics::setQuantizedPositions(bool enabled)
+{
+	quantizePositions = enabled;
+}
+
 bool Graphics::load(const std::string& file)
 {
+	Model* loaded = nullptr;
 	try
 	{
-		model = new Model(file);
+		loaded = new Model(file, 0, true, quantizePositions);
 	}
 	catch (const std::exception&)
 	{
 		return false;
 	}
 
+	return load(loaded);
+}
+
+// Takes ownership of a model, which may have been read on another thread without a
+// context; its buffers are then created here.
+bool Graphics::load(Model* loaded)
+{
+	if (!loaded->upload())
+	{
+		delete loaded;
+		return false;
+	}
+
+	if (model)
+	{
+		delete model;
+	}
+	model = loaded;
+
+	pointMode = model->isPointCloud();
+	objectsDirty = true;
+
+	// Loaders bind buffers and vertex arrays directly.
+	GLState::instance().invalidate();
+
+	// Programs for the model start compiling now and are only waited for at the first draw.
+	for (const Model::Primitive& primitive : model->getPrimitives())
+	{
+		shaders->prepare(getVariant(primitive.mode, primitive.normals, primitive.quantized, instanceBuffer->getCount() > 0, batches != nullptr));
+	}
+
+	model->attachInstances(*instanceBuffer);
 	return true;
 }
 
+void Graphics::togglePointCloud()
+{
+	if (model)
+	{
+		pointMode = !pointMode && model->buildPointCloud();
+		objectsDirty = true;
+		GLState::instance().invalidate();
+	}
+}
+
+void Graphics::changePointBudget(bool increase)
+{
+	const size_t minimumBudget = 1 << 10;
+	const size_t maximumBudget = size_t(1) << 30;
+	pointBudget = increase ? std::min(pointBudget * 2, maximumBudget) : std::max(pointBudget / 2, minimumBudget);
+}
+
+void Graphics::setInstances(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& colours)
+{
+	instanceBuffer->assign(transforms, colours);
+	batchesDirty = true;
+	if (model)
+	{
+		model->attachInstances(*instanceBuffer);
+	}
+}
+
+bool Graphics::moveInstance(size_t index, const glm::mat4& transform)
+{
+	return instanceBuffer->setTransform(index, transform);
+}
+
+bool Graphics::setInstanceColour(size_t index, const glm::vec4& colour)
+{
+	return instanceBuffer->setColour(index, colour);
+}
+
+// Lays out copies of the model on a square plate, spaced by its largest extent.
+void Graphics::toggleBuildPlate()
+{
+	if (instanceBuffer->getCount() > 0 || !model)
+	{
+		setInstances({}, {});
+		return;
+	}
+
+	const int side = 10;
+	const glm::vec4 extent = model->getPositionScale();
+	const float spacing = 2.5f * std::max(extent.x, std::max(extent.y, extent.z));
+
+	std::vector<glm::mat4> transforms;
+	std::vector<glm::vec4> colours;
+	for (int row = 0; row < side; ++row)
+	{
+		for (int column = 0; column < side; ++column)
+		{
+			const glm::vec3 offset((column - (side - 1) * 0.5f) * spacing, 0.0f, (row - (side - 1) * 0.5f) * spacing);
+			transforms.push_back(glm::translate(glm::mat4(1.0f), offset));
+			colours.push_back({ 0.3f + 0.6f * column / (side - 1), 0.5f, 0.3f + 0.6f * row / (side - 1), 1.0f });
+		}
+	}
+	setInstances(transforms, colours);
+}
+
+void Graphics::toggleGpuCulling()
+{
+	gpuCulling = !gpuCulling;
+}
+
+void Graphics::toggleOcclusionCulling()
+{
+	occlusionCulling = !occlusionCulling;
+}
+
+void Graphics::toggleClipPlane()
+{
+	// A single section plane through the origin keeps the half with positive x.
+	if (clipPlanes.empty())
+	{
+		clipPlanes.push_back({ 1.0f, 0.0f, 0.0f, 0.0f });
+	}
+	else
+	{
+		clipPlanes.clear();
+	}
+	batchesDirty = true;
+}
+
+// Each draw gets the cheapest program for what its vertices provide. Points and lines
+// without normals have no surface to derive one from and are drawn unlit.
+ShaderVariant Graphics::getVariant(unsigned mode, bool normals, bool quantized, bool instanced, bool batched) const
+{
+	ShaderVariant variant;
+	variant.normals = normals ? NormalSource::Attribute : NormalSource::Derivative;
+	if (!normals && mode < GL_TRIANGLES)
+	{
+		variant.lighting = Lighting::Unlit;
+	}
+	else
+	{
+		variant.lighting = material.x > 0.0f ? Lighting::Specular : Lighting::Diffuse;
+	}
+	variant.lightCount = 1;
+	variant.clipPlanes = static_cast<unsigned>(clipPlanes.size());
+	variant.quantized = quantized;
+	variant.instanced = instanced;
+	variant.batched = batched;
+	return variant;
+}
+
+// The model becomes a root node carrying the model matrix with one child per mesh
+// instance, so moving the model only recomputes the transforms below the root.
+void Graphics::buildScene() const
+{
+	scene->clear();
+	if (!model)
+	{
+		return;
+	}
+
+	const Scene::Node root = scene->addNode(Scene::none, glm::mat4(1.0f));
+	if (pointMode)
+	{
+		return;
+	}
+
+	const std::vector<Model::Primitive>& primitives = model->getPrimitives();
+	for (const Model::Instance& instance : model->getInstances())
+	{
+		const Model::Primitive& primitive = primitives[instance.primitive];
+		const Scene::Node node = scene->addNode(root, instance.transform, static_cast<int>(instance.primitive));
+		scene->setBounds(node, primitive.boundsMin, primitive.boundsMax);
+	}
+}
+
+void Graphics::updateObjects(const glm::mat4& modelMatrix) const
+{
+	const bool rebuild = objectsDirty;
+	if (rebuild)
+	{
+		buildScene();
+	}
+
+	if (scene->getNodeCount() > 0)
+	{
+		scene->setLocalTransform(0, modelMatrix);
+		scene->update();
+	}
+	objectsMatrix = modelMatrix;
+	objectsDirty = false;
+
+	if (rebuild)
+	{
+		rebuildObjects();
+	}
+	else
+	{
+		moveObjects();
+	}
+}
+
+// A new scene replaces every object block and culling volume, and the batches with them.
+void Graphics::rebuildObjects() const
+{
+	objects.clear();
+	culler->clear();
+
+	if (model && pointMode)
+	{
+		objects.push_back({ scene->getWorldTransform(0), glm::mat4(1.0f), defaultObjectColour, material, glm::vec4(1.0f), glm::vec4(0.0f) });
+	}
+	else if (model)
+	{
+		const glm::vec4 positionScale = model->getPositionScale();
+		const glm::vec4 positionOffset = model->getPositionOffset();
+		for (Scene::Node node = 1; node < scene->getNodeCount(); ++node)
+		{
+			objects.push_back({ scene->getWorldTransform(node), glm::mat4(1.0f), defaultObjectColour, material, positionScale, positionOffset });
+		}
+	}
+
+	if (!objects.empty())
+	{
+		computeNormalMatrices(&objects[0].modelMatrix, &objects[0].normalMatrix, objects.size(), sizeof(ObjectBlock));
+	}
+
+	// World bounds follow the object transforms, so they are rebuilt with them.
+	if (model && !pointMode)
+	{
+		for (Scene::Node node = 1; node < scene->getNodeCount(); ++node)
+		{
+			culler->add(scene->getBoundsMin(node), scene->getBoundsMax(node), scene->getWorldTransform(node));
+		}
+	}
+
+	batchesDirty = true;
+}
+
+// Only the nodes the scene update recomputed are touched. Their blocks and volumes are
+// rewritten in place and the batches keep their commands. A point cloud draws with the
+// root transform; otherwise objects are the root's children, in node order.
+void Graphics::moveObjects() const
+{
+	const Scene::Node first = pointMode ? 0 : 1;
+	moved.assign(objects.size(), 0);
+	size_t runStart = 0;
+	size_t runLength = 0;
+	bool any = false;
+	for (size_t object = 0; object <= objects.size(); ++object)
+	{
+		const Scene::Node node = static_cast<Scene::Node>(object + first);
+		if (object < objects.size() && scene->isUpdated(node))
+		{
+			const glm::mat4& transform = scene->getWorldTransform(node);
+			objects[object].modelMatrix = transform;
+			if (!pointMode)
+			{
+				culler->set(object, scene->getBoundsMin(node), scene->getBoundsMax(node), transform);
+			}
+			moved[object] = 1;
+			any = true;
+			if (runLength++ == 0)
+			{
+				runStart = object;
+			}
+			continue;
+		}
+
+		// Normal matrices are computed a run of neighbouring objects at a time.
+		if (runLength > 0)
+		{
+			computeNormalMatrices(&objects[runStart].modelMatrix, &objects[runStart].normalMatrix, runLength, sizeof(ObjectBlock));
+			runLength = 0;
+		}
+	}
+
+	if (any && batches && !batchesDirty)
+	{
+		batches->update(objects, *culler, moved);
+	}
+}
+
 bool Graphics::render() const
 {
-	glm::mat4 modelMatrix = context->getModelMatrix();
-	glm::mat4 viewMatrix = camera->getViewMatrix();
-	glm::mat4 projectionMatrix = context->getProjectionMatrix();
+	stats = {};
+	Profiler::instance().beginFrame();
 
-	glm::vec3 lightDirection = light->getDirection();
-	glm::vec4 diffuseLightColour = light->getDiffuseColor();
-	glm::vec4 ambientLight = light->getAmbientLight();
+	GLState& state = GLState::instance();
+	state.takeCounts();
+
+	if (stream)
+	{
+		stream->beginFrame();
+	}
 
 	context->beginScene();
 
 	camera->render();
 
-	shader->setShader();
-	if (!shader->setMatrices(modelMatrix, viewMatrix, projectionMatrix))
+	// Camera and light data change once per frame and are uploaded once per frame.
+	FrameBlock frame;
+	frame.viewMatrix = camera->getViewMatrix();
+	frame.projectionMatrix = context->getProjectionMatrix();
+	frame.viewProjectionMatrix = frame.projectionMatrix * frame.viewMatrix;
+	frame.cameraPosition = glm::vec4(camPos, 1.0f);
+	frame.ambientLight = light->getAmbientLight();
+	frame.lightPositions[0] = glm::vec4(light->getPosition(), 1.0f);
+	frame.lightColours[0] = light->getDiffuseColor();
+	for (size_t i = 0; i < clipPlanes.size(); ++i)
 	{
-		return false;
+		frame.clipPlanes[i] = clipPlanes[i];
 	}
+	frameBuffer->upload(&frame, 1);
+	frameBuffer->bind(0);
 
-	if (!shader->setLightPosition({ 0.0f, 0.0f, -10.0f }))
+	for (unsigned i = 0; i < maxClipPlanes; ++i)
 	{
-		return false;
+		state.setEnabled(GL_CLIP_DISTANCE0 + i, i < clipPlanes.size());
 	}
 
-	if (!shader->setObjectColour({ 0.5f, 0.5f, 0.5f, 1.0f }))
+	// Per-object blocks for every draw are uploaded together; they are only rebuilt when
+	// a transform changes.
+	const glm::mat4 modelMatrix = context->getModelMatrix();
+	if (objectsDirty || modelMatrix != objectsMatrix)
 	{
-		return false;
+		Profiler::Zone zone("objects");
+		updateObjects(modelMatrix);
 	}
 
-	if (model)
+	// Copies placed through the instance buffer repeat every draw in a single call.
+	instanceBuffer->flush();
+	const int instanceCount = static_cast<int>(instanceBuffer->getCount());
+
+	// Copies placed through the instance buffer spread beyond the bounds of a part, so
+	// parts are only culled while they are drawn once.
+	const bool culling = instanceCount == 0 && culler->getCount() > 0;
+
+	if (model && !pointMode && batches)
 	{
-		model->render();
+		if (batchesDirty && !buildBatches(instanceCount))
+		{
+			return false;
+		}
+
+		// The compute pass culls and compacts on the GPU; without it the CPU culls and
+		// compacts the same way. Occlusion culling only exists on the GPU path.
+		const bool gpu = culling && gpuCulling && batches->isGpuCullingSupported();
+		Shader* visibleShader = gpu && occlusionCulling ? shaders->getCulling(CullPass::Visible) : nullptr;
+		Shader* occlusionShader = visibleShader ? shaders->getCulling(CullPass::Occlusion) : nullptr;
+		Shader* reduceShader = occlusionShader ? shaders->getDepthReduction() : nullptr;
+		Shader* frustumShader = gpu && !reduceShader ? shaders->getCulling(CullPass::Frustum) : nullptr;
+		if (reduceShader)
+		{
+			// What was visible last frame is drawn first and becomes the occluder set for
+			// the test of everything else in the same frame.
+			{
+				Profiler::Zone zone("visible pass", true);
+				batches->cull(*visibleShader, CullPass::Visible, frame.viewProjectionMatrix, nullptr, stats);
+				batches->submit(stats, CullPass::Visible);
+			}
+			{
+				Profiler::Zone zone("depth pyramid", true);
+				depthPyramid->update(*reduceShader);
+				++stats.programChanges;
+			}
+			Profiler::Zone zone("occlusion pass", true);
+			batches->cull(*occlusionShader, CullPass::Occlusion, frame.viewProjectionMatrix, depthPyramid, stats);
+			batches->submit(stats, CullPass::Occlusion);
+		}
+		else if (frustumShader)
+		{
+			Profiler::Zone zone("draw", true);
+			batches->cull(*frustumShader, CullPass::Frustum, frame.viewProjectionMatrix, nullptr, stats);
+			batches->submit(stats);
+		}
+		else
+		{
+			Profiler::Zone zone("draw", true);
+			batches->setVisibility(culling ? cullObjects(frame) : noVisibility);
+			batches->submit(stats);
+		}
+
+		stats.visibleObjects = static_cast<unsigned>(batches->getVisibleCount());
+		stats.culledObjects = static_cast<unsigned>(batches->getDrawCount()) - stats.visibleObjects;
+		stats.occludedObjects = static_cast<unsigned>(batches->getOccludedCount());
+		return finishFrame();
+	}
+
+	stats.visibleObjects = static_cast<unsigned>(culler->getCount());
+	const std::vector<uint8_t>& visibility = culling ? cullObjects(frame) : noVisibility;
+	stats.culledObjects = static_cast<unsigned>(culler->getCount()) - stats.visibleObjects;
+
+	objectBuffer->upload(objects.data(), objects.size());
+
+	draws.clear();
+	if (model && !pointMode)
+	{
+		const std::vector<Model::Primitive>& primitives = model->getPrimitives();
+		const std::vector<Model::Instance>& instances = model->getInstances();
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			if (culling && !visibility[i])
+			{
+				continue;
+			}
+
+			const Model::Primitive& primitive = primitives[instances[i].primitive];
+			Shader* shader = shaders->get(getVariant(primitive.mode, primitive.normals, primitive.quantized, instanceCount > 0, false));
+			if (!shader)
+			{
+				return false;
+			}
+
+			draws.push_back({ shader, i });
+		}
+	}
+
+	{
+		Profiler::Zone zone("draw", true);
+		if (model && pointMode)
+		{
+			Shader* shader = shaders->get(getVariant(GL_POINTS, model->hasNormals(), false, false, false));
+			if (!shader)
+			{
+				return false;
+			}
+
+			shader->setShader();
+			++stats.programChanges;
+			objectBuffer->bind(0);
+			if (model->renderPoints(pointBudget))
+			{
+				++stats.drawCalls;
+			}
+		}
+		else if (model)
+		{
+			// Draws are grouped by program so each program is made current once per frame.
+			std::stable_sort(draws.begin(), draws.end(), [](const std::pair<Shader*, size_t>& a, const std::pair<Shader*, size_t>& b) { return a.first < b.first; });
+
+			const std::vector<Model::Instance>& instances = model->getInstances();
+			const Shader* current = nullptr;
+			for (const std::pair<Shader*, size_t>& draw : draws)
+			{
+				if (draw.first != current)
+				{
+					current = draw.first;
+					current->setShader();
+					++stats.programChanges;
+				}
+
+				objectBuffer->bind(draw.second);
+				if (instanceCount > 0)
+				{
+					model->renderInstanced(instances[draw.second].primitive, instanceCount);
+				}
+				else
+				{
+					model->render(instances[draw.second].primitive);
+				}
+				++stats.drawCalls;
+			}
+		}
+	}
+
+	return finishFrame();
+}
+
+// Commands for every part are built once and replayed until the scene changes.
+bool Graphics::buildBatches(int instanceCount) const
+{
+	batches->clear();
+
+	const std::vector<Model::Primitive>& primitives = model->getPrimitives();
+	const std::vector<Model::Instance>& instances = model->getInstances();
+	for (size_t i = 0; i < instances.size(); ++i)
+	{
+		const Model::Primitive& primitive = primitives[instances[i].primitive];
+		Shader* shader = shaders->get(getVariant(primitive.mode, primitive.normals, primitive.quantized, instanceCount > 0, true));
+		if (!shader)
+		{
+			return false;
+		}
+
+		batches->add(shader, primitive, i, static_cast<unsigned>(std::max(instanceCount, 1)));
+	}
+
+	batches->build(objects, *culler);
+	batchesDirty = false;
+	return true;
+}
+
+// Runs the CPU frustum test and records how many objects passed.
+const std::vector<uint8_t>& Graphics::cullObjects(const FrameBlock& frame) const
+{
+	Profiler::Zone zone("cull");
+	stats.visibleObjects = static_cast<unsigned>(culler->cull(frame.viewMatrix, frame.projectionMatrix));
+	return culler->getVisibility();
+}
+
+bool Graphics::finishFrame() const
+{
+	if (stream)
+	{
+		stream->endFrame();
+		stats.streamStalls = stream->takeStalls();
 	}
 
 	context->endScene();
+	Profiler::instance().endFrame();
 
+	stats.uniformLookups = shaders->takeUniformLookups();
+	const GLState::Counts counts = GLState::instance().takeCounts();
+	stats.stateCalls = counts.issued;
+	stats.elidedStateCalls = counts.elided;
 	return true;
 }
+
+const RenderStats& Graphics::getStats() const
+{
+	return stats;
+}
@@ -1,29 +1,86 @@
 #pragma once
 
-#include "OpenGL.h"
+#include "RenderContext.h"
 #include "Camera.h"
 #include "Model.h"
-#include "Shader.h"
+#include "ShaderCache.h"
+#include "ShaderLibrary.h"
 #include "Light.h"
+#include "RenderStats.h"
+#include "ShaderBlocks.h"
+#include "StreamBuffer.h"
+#include "UniformBuffer.h"
+#include "InstanceBuffer.h"
+#include "BatchRenderer.h"
+#include "FrustumCuller.h"
+#include "DepthPyramid.h"
+#include "Scene.h"
 
 enum class Direction { Left, Right, Up, Down };
 
 class Graphics
 {
 public:
-	Graphics(OpenGL* OpenGL);
+	Graphics(RenderContext* renderContext);
 	~Graphics();
 	bool render() const;
 	void move(Direction dir);
+	void setCameraPosition(const glm::vec3& position);
 	bool load(const std::string &file);
+	bool load(Model* loaded);
+	void setQuantizedPositions(bool enabled);
+	void togglePointCloud();
+	void changePointBudget(bool increase);
+	void toggleClipPlane();
+	void toggleGpuCulling();
+	void toggleOcclusionCulling();
+	void setInstances(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& colours);
+	bool moveInstance(size_t index, const glm::mat4& transform);
+	bool setInstanceColour(size_t index, const glm::vec4& colour);
+	void toggleBuildPlate();
+	const RenderStats& getStats() const;
 
 private:
+	// Room for a frame of streamed uniforms; a scene that needs more grows it once.
+	static const size_t streamRegionSize = 1 << 16;
+
 	bool initialize();
+	ShaderVariant getVariant(unsigned mode, bool normals, bool quantized, bool instanced, bool batched) const;
+	void buildScene() const;
+	void updateObjects(const glm::mat4& modelMatrix) const;
+	void rebuildObjects() const;
+	void moveObjects() const;
+	bool buildBatches(int instanceCount) const;
+	const std::vector<uint8_t>& cullObjects(const FrameBlock& frame) const;
+	bool finishFrame() const;
 
-	OpenGL* context;
+	RenderContext* context;
 	Camera* camera;
 	Model* model;
-	Shader* shader;
+	ShaderCache* shaderCache;
+	ShaderLibrary* shaders;
 	Light* light;
+	StreamBuffer* stream;
+	UniformBuffer* frameBuffer;
+	UniformBuffer* objectBuffer;
+	InstanceBuffer* instanceBuffer;
+	BatchRenderer* batches;
+	FrustumCuller* culler;
+	DepthPyramid* depthPyramid;
+	Scene* scene;
+	mutable std::vector<ObjectBlock> objects;
+	mutable std::vector<uint8_t> moved;
+	mutable glm::mat4 objectsMatrix;
+	mutable bool objectsDirty;
+	mutable bool batchesDirty;
+	bool gpuCulling;
+	bool occlusionCulling;
+	mutable std::vector<std::pair<Shader*, size_t>> draws;
+	std::vector<glm::vec4> clipPlanes;
+	glm::vec4 material;
 	glm::vec3 camPos;
+	bool pointMode;
+	bool quantizePositions;
+	size_t pointBudget;
+	mutable RenderStats stats;
 };
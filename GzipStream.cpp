@@ -0,0 +1,350 @@
+#include "GzipStream.h"
+#include "Inflater.h"
+#include <cstring>
+
+namespace
+{
+	const uint8_t headerCrc = 1 << 1;
+	const uint8_t headerExtra = 1 << 2;
+	const uint8_t headerName = 1 << 3;
+	const uint8_t headerComment = 1 << 4;
+
+	template <typename T>
+	T readValue(const char* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	struct CrcTable
+	{
+		uint32_t values[256];
+
+		CrcTable()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t crc = i;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+				}
+				values[i] = crc;
+			}
+		}
+	};
+
+	uint32_t updateCrc(uint32_t crc, const char* data, size_t size)
+	{
+		static const CrcTable table;
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+		{
+			crc = table.values[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	bool isMemberStart(const char* p, size_t size)
+	{
+		return size >= 2 && static_cast<uint8_t>(p[0]) == 0x1F && static_cast<uint8_t>(p[1]) == 0x8B;
+	}
+}
+
+GzipStream::GzipStream(const std::string& filename) :
+	file(filename),
+	isDone(false),
+	isStopping(false),
+	windowStart(0)
+{
+	if (!file.isOpen())
+	{
+		error = "Cannot open compressed file!";
+		isDone = true;
+		return;
+	}
+
+	if (file.size() >= 4 && readValue<uint32_t>(file.data()) == 0xFD2FB528)
+	{
+		error = "Zstandard compression is not supported, only gzip!";
+		isDone = true;
+		return;
+	}
+
+	size_t bodyOffset;
+	if (!readHeader(0, bodyOffset, error))
+	{
+		isDone = true;
+		return;
+	}
+
+	producer = std::thread(&GzipStream::produce, this);
+}
+
+GzipStream::~GzipStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	space.notify_all();
+
+	if (producer.joinable())
+	{
+		producer.join();
+	}
+}
+
+bool GzipStream::isOpen() const
+{
+	return producer.joinable();
+}
+
+bool GzipStream::fill(size_t minimum)
+{
+	if (available() >= minimum)
+	{
+		return true;
+	}
+
+	// Consumed bytes are dropped so the window only ever holds the unread tail plus new blocks.
+	window.erase(window.begin(), window.begin() + windowStart);
+	windowStart = 0;
+
+	std::deque<std::vector<char>> arrived;
+	while (window.size() < minimum)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [this] { return !blocks.empty() || isDone; });
+			if (blocks.empty())
+			{
+				return false;
+			}
+
+			// Blocks that are already waiting are taken too, so the parser gets larger batches.
+			arrived.swap(blocks);
+		}
+		space.notify_one();
+
+		for (std::vector<char>& block : arrived)
+		{
+			window.insert(window.end(), block.begin(), block.end());
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::vector<char>& block : arrived)
+		{
+			spareBlocks.push_back(std::move(block));
+		}
+		arrived.clear();
+	}
+
+	return true;
+}
+
+const char* GzipStream::data() const
+{
+	return window.data() + windowStart;
+}
+
+size_t GzipStream::available() const
+{
+	return window.size() - windowStart;
+}
+
+void GzipStream::consume(size_t size)
+{
+	windowStart += size;
+}
+
+bool GzipStream::drain()
+{
+	// Anything the parser did not need is discarded, but the checksum still has to be verified.
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!isDone)
+	{
+		for (std::vector<char>& block : blocks)
+		{
+			spareBlocks.push_back(std::move(block));
+		}
+		blocks.clear();
+		space.notify_one();
+		ready.wait(lock);
+	}
+
+	window.clear();
+	windowStart = 0;
+	return error.empty();
+}
+
+bool GzipStream::hasError() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !error.empty();
+}
+
+std::string GzipStream::getError() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return error;
+}
+
+bool GzipStream::readAll(const std::string& filename, std::vector<char>& out)
+{
+	GzipStream stream(filename);
+	if (!stream.isOpen())
+	{
+		return false;
+	}
+
+	while (stream.fill(stream.available() + 1))
+	{
+	}
+
+	if (stream.hasError())
+	{
+		return false;
+	}
+
+	out.assign(stream.data(), stream.data() + stream.available());
+	return true;
+}
+
+void GzipStream::produce()
+{
+	const char* data = file.data();
+	const size_t size = file.size();
+	size_t offset = 0;
+
+	// Concatenated gzip members decompress to the concatenation of their contents.
+	while (offset < size && isMemberStart(data + offset, size - offset))
+	{
+		size_t bodyOffset;
+		std::string message;
+		if (!readHeader(offset, bodyOffset, message))
+		{
+			finish(message);
+			return;
+		}
+
+		Inflater inflater(data + bodyOffset, size - bodyOffset);
+		uint32_t crc = 0;
+		uint32_t length = 0;
+		size_t produced;
+
+		do
+		{
+			std::vector<char> block;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!spareBlocks.empty())
+				{
+					block = std::move(spareBlocks.back());
+					spareBlocks.pop_back();
+				}
+			}
+
+			block.resize(blockSize);
+			produced = inflater.read(block.data(), blockSize);
+			block.resize(produced);
+
+			crc = updateCrc(crc, block.data(), produced);
+			length += static_cast<uint32_t>(produced);
+
+			if (produced > 0 && !push(block))
+			{
+				return;
+			}
+		} while (produced == blockSize);
+
+		const size_t trailer = bodyOffset + inflater.getConsumed();
+		if (!inflater.isFinished() || size - trailer < 8)
+		{
+			finish("Compressed data is corrupt or truncated!");
+			return;
+		}
+
+		if (readValue<uint32_t>(data + trailer) != crc || readValue<uint32_t>(data + trailer + 4) != length)
+		{
+			finish("Compressed data fails its checksum!");
+			return;
+		}
+
+		offset = trailer + 8;
+	}
+
+	finish(std::string());
+}
+
+bool GzipStream::readHeader(size_t offset, size_t& bodyOffset, std::string& message) const
+{
+	const char* header = file.data() + offset;
+	const size_t size = file.size() - offset;
+
+	if (size < 10 || !isMemberStart(header, size) || header[2] != 8)
+	{
+		message = "Not a gzip file!";
+		return false;
+	}
+
+	const uint8_t flags = static_cast<uint8_t>(header[3]);
+	size_t position = 10;
+
+	if (flags & headerExtra)
+	{
+		if (size - position < 2)
+		{
+			message = "Gzip header is truncated!";
+			return false;
+		}
+		position += 2 + readValue<uint16_t>(header + position);
+	}
+
+	for (uint8_t field : { headerName, headerComment })
+	{
+		if ((flags & field) && position < size)
+		{
+			const char* terminator = static_cast<const char*>(std::memchr(header + position, 0, size - position));
+			position = terminator ? static_cast<size_t>(terminator + 1 - header) : size + 1;
+		}
+	}
+
+	if (flags & headerCrc)
+	{
+		position += 2;
+	}
+
+	if (position > size)
+	{
+		message = "Gzip header is truncated!";
+		return false;
+	}
+
+	bodyOffset = offset + position;
+	return true;
+}
+
+bool GzipStream::push(std::vector<char>& block)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	space.wait(lock, [this] { return blocks.size() < queueDepth || isStopping; });
+	if (isStopping)
+	{
+		return false;
+	}
+
+	blocks.push_back(std::move(block));
+	ready.notify_one();
+	return true;
+}
+
+void GzipStream::finish(const std::string& message)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	error = message;
+	isDone = true;
+	ready.notify_all();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sequential reader over a gzip file. A producer thread inflates the mapped file into
+// a bounded queue of blocks, so at most a few blocks of uncompressed data exist at once
+// while the consumer converts what has already arrived.
+class GzipStream
+{
+public:
+	GzipStream(const std::string& filename);
+	~GzipStream();
+	GzipStream(const GzipStream&) = delete;
+	GzipStream& operator=(const GzipStream&) = delete;
+	bool isOpen() const;
+	bool fill(size_t minimum);
+	const char* data() const;
+	size_t available() const;
+	void consume(size_t size);
+	bool drain();
+	bool hasError() const;
+	std::string getError() const;
+	static bool readAll(const std::string& filename, std::vector<char>& out);
+
+private:
+	void produce();
+	bool readHeader(size_t offset, size_t& bodyOffset, std::string& message) const;
+	bool push(std::vector<char>& block);
+	void finish(const std::string& message);
+
+	static const size_t blockSize = 1 << 20;
+	static const size_t queueDepth = 4;
+
+	MappedFile file;
+	std::thread producer;
+	mutable std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable space;
+	std::deque<std::vector<char>> blocks;
+	std::vector<std::vector<char>> spareBlocks;
+	bool isDone;
+	bool isStopping;
+	std::string error;
+
+	std::vector<char> window;
+	size_t windowStart;
+};
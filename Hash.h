@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 32-bit FNV-1a. It is constexpr, so names written in code are hashed at compile time.
+constexpr uint32_t hashName(const char* text, uint32_t hash = 2166136261u)
+{
+	return *text ? hashName(text + 1, (hash ^ static_cast<uint8_t>(*text)) * 16777619u) : hash;
+}
+
+// 64-bit FNV-1a over a byte range; chain calls through seed to hash several ranges.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		seed = (seed ^ bytes[i]) * 1099511628211ull;
+	}
+	return seed;
+}
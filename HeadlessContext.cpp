@@ -0,0 +1,266 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+#include "HeadlessContext.h"
+#include "GLState.h"
+#include <EGL/eglext.h>
+
+namespace
+{
+	bool hasEglExtension(EGLDisplay display, const char* name)
+	{
+		const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+		if (!extensions)
+		{
+			return false;
+		}
+
+		const size_t length = std::strlen(name);
+		for (const char* found = std::strstr(extensions, name); found; found = std::strstr(found + length, name))
+		{
+			if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0'))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+HeadlessContext::HeadlessContext(int width, int height, float screenDepth, float screenNear) :
+	display(EGL_NO_DISPLAY),
+	surface(EGL_NO_SURFACE),
+	context(EGL_NO_CONTEXT),
+	framebuffer(0),
+	colourBuffer(0),
+	depthBuffer(0),
+	width(width),
+	height(height),
+	modelMatrix(1.0f)
+{
+	if (width <= 0 || height <= 0 || !initializeDisplay() || !initializeContext() || !initializeFramebuffer())
+	{
+		release();
+		throw std::runtime_error("Cannot create an offscreen OpenGL context!");
+	}
+
+	// Set the depth buffer to be entirely cleared to 1.0 values.
+	glClearDepth(1.0f);
+	GLState::instance().setEnabled(GL_DEPTH_TEST, true);
+
+	const float fieldOfView = static_cast<float>(M_PI) / 4.0f;
+	const float screenAspect = static_cast<float>(width) / static_cast<float>(height);
+	projectionMatrix = glm::perspective(fieldOfView, screenAspect, screenNear, screenDepth);
+
+	const char* vendorString = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+	const char* rendererString = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+	videoCardDescription = std::string(vendorString) + " - " + std::string(rendererString);
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	release();
+}
+
+void HeadlessContext::release()
+{
+	if (context != EGL_NO_CONTEXT)
+	{
+		if (framebuffer)
+		{
+			glDeleteFramebuffers(1, &framebuffer);
+			framebuffer = 0;
+		}
+
+		if (colourBuffer)
+		{
+			glDeleteRenderbuffers(1, &colourBuffer);
+			colourBuffer = 0;
+		}
+
+		if (depthBuffer)
+		{
+			glDeleteRenderbuffers(1, &depthBuffer);
+			depthBuffer = 0;
+		}
+
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+		context = EGL_NO_CONTEXT;
+	}
+
+	if (surface != EGL_NO_SURFACE)
+	{
+		eglDestroySurface(display, surface);
+		surface = EGL_NO_SURFACE;
+	}
+
+	if (display != EGL_NO_DISPLAY)
+	{
+		eglTerminate(display);
+		display = EGL_NO_DISPLAY;
+	}
+}
+
+// Mesa's surfaceless platform needs neither a display server nor a GPU device; other
+// drivers fall back to their default display.
+bool HeadlessContext::initializeDisplay()
+{
+	const auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (getPlatformDisplay && hasEglExtension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless"))
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major = 0;
+	EGLint minor = 0;
+	if (display == EGL_NO_DISPLAY || eglInitialize(display, &major, &minor) != EGL_TRUE)
+	{
+		display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	return eglBindAPI(EGL_OPENGL_API) == EGL_TRUE;
+}
+
+// The same 4.5 context as the window, or 4.0 on older drivers. Without surfaceless
+// contexts a small pbuffer stands in for the window; drawing always goes to the
+// framebuffer object.
+bool HeadlessContext::initializeContext()
+{
+	const EGLint configAttributes[] =
+	{
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	EGLConfig config = nullptr;
+	EGLint configCount = 0;
+	if (eglChooseConfig(display, configAttributes, &config, 1, &configCount) != EGL_TRUE || configCount == 0)
+	{
+		return false;
+	}
+
+	EGLint contextAttributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_NONE
+	};
+
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT)
+	{
+		contextAttributes[3] = 0;
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	}
+
+	if (context == EGL_NO_CONTEXT)
+	{
+		return false;
+	}
+
+	if (!hasEglExtension(display, "EGL_KHR_surfaceless_context"))
+	{
+		const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+		if (surface == EGL_NO_SURFACE)
+		{
+			return false;
+		}
+	}
+
+	if (eglMakeCurrent(display, surface, surface, context) != EGL_TRUE)
+	{
+		return false;
+	}
+
+	return gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)) != 0;
+}
+
+// Colour and depth match the window's pixel format: 8 bits per channel, 24 bit depth
+// and 8 bit stencil. The framebuffer stays bound for the lifetime of the context.
+bool HeadlessContext::initializeFramebuffer()
+{
+	glGenRenderbuffers(1, &colourBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colourBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		return false;
+	}
+
+	glViewport(0, 0, width, height);
+	return true;
+}
+
+void HeadlessContext::beginScene()
+{
+	GLState::instance().setClearColour({ 0.0f, 0.0f, 0.0f, 1.0f });
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// Nothing is presented; flushing hands the frame to the driver as a swap would.
+void HeadlessContext::endScene() const
+{
+	glFlush();
+}
+
+// Waits for the frame to finish. OpenGL returns rows bottom first, so they are flipped.
+void HeadlessContext::readPixels(std::vector<uint8_t>& pixels) const
+{
+	const size_t rowSize = static_cast<size_t>(width) * 4;
+	std::vector<uint8_t> rows(rowSize * height);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rows.data());
+
+	pixels.resize(rows.size());
+	for (int y = 0; y < height; ++y)
+	{
+		std::memcpy(&pixels[rowSize * y], &rows[rowSize * (height - 1 - y)], rowSize);
+	}
+}
+
+glm::mat4 HeadlessContext::getModelMatrix()
+{
+	return modelMatrix;
+}
+
+glm::mat4 HeadlessContext::getProjectionMatrix()
+{
+	return projectionMatrix;
+}
+
+std::string HeadlessContext::getVideoCardInfo() const
+{
+	return videoCardDescription;
+}
+
+int HeadlessContext::getWidth() const
+{
+	return width;
+}
+
+int HeadlessContext::getHeight() const
+{
+	return height;
+}
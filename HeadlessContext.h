@@ -0,0 +1,44 @@
+#pragma once
+
+#include "RenderContext.h"
+#include <EGL/egl.h>
+#include <cstdint>
+#include <vector>
+
+// Offscreen rendering through EGL, for machines without a display or GPU such as Mesa's
+// llvmpipe on a build server. Frames are drawn into a framebuffer object of the given
+// size and read back as RGBA8 rows, top row first.
+class HeadlessContext : public RenderContext
+{
+public:
+	HeadlessContext(int width, int height, float screenDepth, float screenNear);
+	~HeadlessContext();
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+	void beginScene() override;
+	void endScene() const override;
+	glm::mat4 getModelMatrix() override;
+	glm::mat4 getProjectionMatrix() override;
+	std::string getVideoCardInfo() const override;
+	void readPixels(std::vector<uint8_t>& pixels) const;
+	int getWidth() const;
+	int getHeight() const;
+
+private:
+	bool initializeDisplay();
+	bool initializeContext();
+	bool initializeFramebuffer();
+	void release();
+
+	EGLDisplay display;
+	EGLSurface surface;
+	EGLContext context;
+	unsigned framebuffer;
+	unsigned colourBuffer;
+	unsigned depthBuffer;
+	int width;
+	int height;
+	glm::mat4 modelMatrix;
+	glm::mat4 projectionMatrix;
+	std::string videoCardDescription;
+};
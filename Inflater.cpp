@@ -0,0 +1,419 @@
+#include "Inflater.h"
+#include <cstring>
+
+namespace
+{
+	const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	const int fastBits = 9;
+	// A 258-byte match costs at least two bits, so no stream expands by more than this,
+	// plus a few bytes of block overhead.
+	const size_t maxExpansion = 1032;
+}
+
+Inflater::Inflater(const char* data, size_t size) :
+	input(reinterpret_cast<const uint8_t*>(data)),
+	inputSize(size),
+	position(0),
+	bitBuffer(0),
+	bitCount(0),
+	paddingBits(0),
+	state(State::BlockHeader),
+	isLastBlock(false),
+	storedRemaining(0),
+	matchRemaining(0),
+	matchDistance(0),
+	totalOut(0),
+	literals{},
+	distances{},
+	window(windowSize),
+	windowPosition(0)
+{
+}
+
+size_t Inflater::read(char* out, size_t size)
+{
+	char* cursor = out;
+	char* const end = out + size;
+
+	while (cursor != end)
+	{
+		switch (state)
+		{
+		case State::BlockHeader:
+			if (isLastBlock)
+			{
+				state = State::Done;
+			}
+			else if (!beginBlock())
+			{
+				state = State::Error;
+			}
+			break;
+
+		case State::Stored:
+			if (storedRemaining == 0)
+			{
+				state = State::BlockHeader;
+				break;
+			}
+			emit(cursor, static_cast<char>(getBits(8)));
+			--storedRemaining;
+			break;
+
+		case State::Compressed:
+		{
+			if (matchRemaining > 0)
+			{
+				emit(cursor, window[(windowPosition - matchDistance) & (windowSize - 1)]);
+				--matchRemaining;
+				break;
+			}
+
+			const int symbol = decodeSymbol(literals);
+			if (symbol < 0 || symbol > 285)
+			{
+				state = State::Error;
+			}
+			else if (symbol < 256)
+			{
+				emit(cursor, static_cast<char>(symbol));
+			}
+			else if (symbol == 256)
+			{
+				state = State::BlockHeader;
+			}
+			else
+			{
+				const int lengthIndex = symbol - 257;
+				matchRemaining = lengthBase[lengthIndex] + getBits(lengthExtra[lengthIndex]);
+
+				const int distanceSymbol = decodeSymbol(distances);
+				if (distanceSymbol < 0 || distanceSymbol > 29)
+				{
+					state = State::Error;
+					break;
+				}
+
+				matchDistance = distanceBase[distanceSymbol] + getBits(distanceExtra[distanceSymbol]);
+				if (matchDistance > totalOut)
+				{
+					state = State::Error;
+				}
+			}
+		}
+			break;
+
+		case State::Done:
+		case State::Error:
+			return static_cast<size_t>(cursor - out);
+		}
+
+		// Reading past the end of the input means the stream is truncated.
+		if (bitCount < paddingBits)
+		{
+			state = State::Error;
+		}
+	}
+
+	return static_cast<size_t>(cursor - out);
+}
+
+bool Inflater::isFinished() const
+{
+	return state == State::Done || (state == State::BlockHeader && isLastBlock);
+}
+
+bool Inflater::hasError() const
+{
+	return state == State::Error;
+}
+
+size_t Inflater::getConsumed() const
+{
+	return position - static_cast<size_t>(bitCount - paddingBits) / 8;
+}
+
+// A size no stream of this length could produce is rejected before any memory is taken.
+bool Inflater::inflate(const char* data, size_t size, std::vector<char>& out, size_t expectedSize)
+{
+	if (expectedSize / maxExpansion > size)
+	{
+		return false;
+	}
+
+	Inflater inflater(data, size);
+	out.resize(expectedSize);
+	if (inflater.read(out.data(), expectedSize) != expectedSize)
+	{
+		return false;
+	}
+
+	// The stream must end exactly at the expected size.
+	char extra;
+	return inflater.read(&extra, 1) == 0 && inflater.isFinished();
+}
+
+bool Inflater::beginBlock()
+{
+	isLastBlock = getBits(1) != 0;
+	const uint32_t type = getBits(2);
+
+	switch (type)
+	{
+	case 0:
+	{
+		getBits(bitCount % 8);
+		const uint32_t length = getBits(16);
+		const uint32_t complement = getBits(16);
+		if ((length ^ 0xFFFF) != complement)
+		{
+			return false;
+		}
+		storedRemaining = length;
+		state = State::Stored;
+		return true;
+	}
+	case 1:
+		buildFixedTables();
+		state = State::Compressed;
+		return true;
+	case 2:
+		if (!readDynamicTables())
+		{
+			return false;
+		}
+		state = State::Compressed;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool Inflater::readDynamicTables()
+{
+	const int literalCount = static_cast<int>(getBits(5)) + 257;
+	const int distanceCount = static_cast<int>(getBits(5)) + 1;
+	const int codeLengthCount = static_cast<int>(getBits(4)) + 4;
+	if (literalCount > 286 || distanceCount > 30)
+	{
+		return false;
+	}
+
+	uint8_t lengths[320] = {};
+	for (int i = 0; i < codeLengthCount; ++i)
+	{
+		lengths[codeLengthOrder[i]] = static_cast<uint8_t>(getBits(3));
+	}
+
+	Huffman codeLengths;
+	if (!buildHuffman(codeLengths, lengths, 19))
+	{
+		return false;
+	}
+
+	std::memset(lengths, 0, sizeof(lengths));
+	int index = 0;
+	while (index < literalCount + distanceCount)
+	{
+		const int symbol = decodeSymbol(codeLengths);
+		if (symbol < 0)
+		{
+			return false;
+		}
+
+		if (symbol < 16)
+		{
+			lengths[index++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+
+		uint8_t value = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (index == 0)
+			{
+				return false;
+			}
+			value = lengths[index - 1];
+			repeat = 3 + static_cast<int>(getBits(2));
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + static_cast<int>(getBits(3));
+		}
+		else
+		{
+			repeat = 11 + static_cast<int>(getBits(7));
+		}
+
+		if (index + repeat > literalCount + distanceCount)
+		{
+			return false;
+		}
+
+		while (repeat-- > 0)
+		{
+			lengths[index++] = value;
+		}
+	}
+
+	// A block without an end-of-block code could never terminate.
+	if (lengths[256] == 0)
+	{
+		return false;
+	}
+
+	return buildHuffman(literals, lengths, literalCount) && buildHuffman(distances, lengths + literalCount, distanceCount);
+}
+
+void Inflater::buildFixedTables()
+{
+	uint8_t lengths[288];
+	int i = 0;
+	for (; i < 144; ++i) lengths[i] = 8;
+	for (; i < 256; ++i) lengths[i] = 9;
+	for (; i < 280; ++i) lengths[i] = 7;
+	for (; i < 288; ++i) lengths[i] = 8;
+	buildHuffman(literals, lengths, 288);
+
+	for (i = 0; i < 30; ++i) lengths[i] = 5;
+	buildHuffman(distances, lengths, 30);
+}
+
+bool Inflater::buildHuffman(Huffman& huffman, const uint8_t* lengths, int count)
+{
+	std::memset(&huffman, 0, sizeof(huffman));
+	for (int symbol = 0; symbol < count; ++symbol)
+	{
+		huffman.counts[lengths[symbol]]++;
+	}
+	huffman.counts[0] = 0;
+
+	int left = 1;
+	for (int length = 1; length < 16; ++length)
+	{
+		left <<= 1;
+		left -= huffman.counts[length];
+		if (left < 0)
+		{
+			return false;
+		}
+	}
+
+	uint16_t offsets[16] = {};
+	uint16_t nextCode[16] = {};
+	uint16_t code = 0;
+	for (int length = 1; length < 16; ++length)
+	{
+		offsets[length] = static_cast<uint16_t>(length > 1 ? offsets[length - 1] + huffman.counts[length - 1] : 0);
+		code = static_cast<uint16_t>((code + huffman.counts[length - 1]) << 1);
+		nextCode[length] = code;
+	}
+
+	for (int symbol = 0; symbol < count; ++symbol)
+	{
+		const int length = lengths[symbol];
+		if (length == 0)
+		{
+			continue;
+		}
+
+		huffman.symbols[offsets[length]++] = static_cast<uint16_t>(symbol);
+
+		// Codes short enough for the lookup table are stored bit-reversed, the order they arrive in.
+		const uint16_t symbolCode = nextCode[length]++;
+		if (length <= fastBits)
+		{
+			int reversed = 0;
+			for (int bit = 0; bit < length; ++bit)
+			{
+				reversed |= ((symbolCode >> bit) & 1) << (length - 1 - bit);
+			}
+
+			for (int entry = reversed; entry < (1 << fastBits); entry += 1 << length)
+			{
+				huffman.fast[entry] = static_cast<uint16_t>((symbol << 4) | length);
+			}
+		}
+	}
+
+	return true;
+}
+
+int Inflater::decodeSymbol(const Huffman& huffman)
+{
+	fillBits(fastBits);
+	const uint16_t entry = huffman.fast[bitBuffer & ((1 << fastBits) - 1)];
+	if (entry != 0)
+	{
+		const int length = entry & 15;
+		bitBuffer >>= length;
+		bitCount -= length;
+		return entry >> 4;
+	}
+
+	// Longer codes are decoded canonically one bit at a time.
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int length = 1; length < 16; ++length)
+	{
+		code |= static_cast<int>(getBits(1));
+		const int count = huffman.counts[length];
+		if (code - count < first)
+		{
+			return huffman.symbols[index + (code - first)];
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+uint32_t Inflater::getBits(int count)
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	fillBits(count);
+	const uint32_t value = static_cast<uint32_t>(bitBuffer & ((1ull << count) - 1));
+	bitBuffer >>= count;
+	bitCount -= count;
+	return value;
+}
+
+void Inflater::fillBits(int count)
+{
+	while (bitCount < count)
+	{
+		uint64_t byte = 0;
+		if (position < inputSize)
+		{
+			byte = input[position++];
+		}
+		else
+		{
+			paddingBits += 8;
+		}
+		bitBuffer |= byte << bitCount;
+		bitCount += 8;
+	}
+}
+
+void Inflater::emit(char*& out, char value)
+{
+	*out++ = value;
+	window[windowPosition] = value;
+	windowPosition = (windowPosition + 1) & (windowSize - 1);
+	++totalOut;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Raw DEFLATE (RFC 1951) decoder over an input held in memory. Output is produced
+// incrementally through read(), so callers can consume it in bounded blocks.
+class Inflater
+{
+public:
+	Inflater(const char* data, size_t size);
+	~Inflater() = default;
+	size_t read(char* out, size_t size);
+	bool isFinished() const;
+	bool hasError() const;
+	size_t getConsumed() const;
+	static bool inflate(const char* data, size_t size, std::vector<char>& out, size_t expectedSize);
+
+private:
+	struct Huffman
+	{
+		uint16_t counts[16];
+		uint16_t symbols[288];
+		uint16_t fast[512];
+	};
+
+	bool buildHuffman(Huffman& huffman, const uint8_t* lengths, int count);
+	int decodeSymbol(const Huffman& huffman);
+	bool beginBlock();
+	bool readDynamicTables();
+	void buildFixedTables();
+	uint32_t getBits(int count);
+	void fillBits(int count);
+	void emit(char*& out, char value);
+
+	const uint8_t* input;
+	size_t inputSize;
+	size_t position;
+	uint64_t bitBuffer;
+	int bitCount;
+	int paddingBits;
+
+	enum class State { BlockHeader, Stored, Compressed, Done, Error };
+	State state;
+	bool isLastBlock;
+	size_t storedRemaining;
+	size_t matchRemaining;
+	size_t matchDistance;
+	uint64_t totalOut;
+
+	Huffman literals;
+	Huffman distances;
+
+	static const size_t windowSize = 1 << 15;
+	std::vector<char> window;
+	size_t windowPosition;
+};
@@ -0,0 +1,157 @@
+#include "InstanceBuffer.h"
+#include "GLState.h"
+#include "NormalMatrices.h"
+#include <algorithm>
+
+InstanceBuffer::InstanceBuffer() :
+	buffer(0),
+	capacity(0)
+{
+	glGenBuffers(1, &buffer);
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	GLState::instance().deleteBuffers(1, &buffer);
+}
+
+void InstanceBuffer::assign(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& colours)
+{
+	instances.resize(transforms.size());
+	for (size_t i = 0; i < transforms.size(); ++i)
+	{
+		instances[i].transform = transforms[i];
+		instances[i].colour = i < colours.size() ? colours[i] : glm::vec4(1.0f);
+	}
+
+	if (!instances.empty())
+	{
+		computeNormalMatrices(&instances[0].transform, &instances[0].normalMatrix, instances.size(), sizeof(Instance));
+	}
+
+	dirty.clear();
+	isDirty.assign(instances.size(), false);
+
+	GLState::instance().bindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (instances.size() > capacity)
+	{
+		capacity = instances.size();
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Instance), instances.data(), GL_DYNAMIC_DRAW);
+	}
+	else if (!instances.empty())
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), instances.data());
+	}
+}
+
+void InstanceBuffer::markDirty(size_t index)
+{
+	if (!isDirty[index])
+	{
+		isDirty[index] = true;
+		dirty.push_back(index);
+	}
+}
+
+// Edits of instances that do not exist are refused.
+bool InstanceBuffer::setTransform(size_t index, const glm::mat4& transform)
+{
+	if (index >= instances.size())
+	{
+		return false;
+	}
+
+	instances[index].transform = transform;
+	markDirty(index);
+	return true;
+}
+
+bool InstanceBuffer::setColour(size_t index, const glm::vec4& colour)
+{
+	if (index >= instances.size())
+	{
+		return false;
+	}
+
+	instances[index].colour = colour;
+	markDirty(index);
+	return true;
+}
+
+// Dirty instances are sorted and joined into runs; short gaps are uploaded along with
+// their neighbours, since one larger write is cheaper than several tiny ones.
+void InstanceBuffer::flush()
+{
+	if (dirty.empty())
+	{
+		return;
+	}
+
+	const size_t maximumGap = 4;
+	std::sort(dirty.begin(), dirty.end());
+
+	GLState::instance().bindBuffer(GL_ARRAY_BUFFER, buffer);
+	size_t first = 0;
+	while (first < dirty.size())
+	{
+		size_t last = first;
+		while (last + 1 < dirty.size() && dirty[last + 1] - dirty[last] <= maximumGap)
+		{
+			++last;
+		}
+
+		const size_t begin = dirty[first];
+		const size_t count = dirty[last] - begin + 1;
+		computeNormalMatrices(&instances[begin].transform, &instances[begin].normalMatrix, count, sizeof(Instance));
+		glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(Instance), count * sizeof(Instance), &instances[begin]);
+
+		first = last + 1;
+	}
+
+	for (size_t index : dirty)
+	{
+		isDirty[index] = false;
+	}
+	dirty.clear();
+}
+
+// The transform takes four attribute slots and the normal matrix three; the unused fourth
+// normal column only keeps both matrices in the same layout.
+void InstanceBuffer::attach(unsigned vao) const
+{
+	GLState& state = GLState::instance();
+	state.bindVertexArray(vao);
+	state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	const GLsizei stride = sizeof(Instance);
+	for (unsigned column = 0; column < 4; ++column)
+	{
+		const unsigned location = firstAttribute + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offsetof(Instance, transform) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	for (unsigned column = 0; column < 3; ++column)
+	{
+		const unsigned location = firstAttribute + 4 + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offsetof(Instance, normalMatrix) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	const unsigned colourLocation = firstAttribute + 7;
+	glEnableVertexAttribArray(colourLocation);
+	glVertexAttribPointer(colourLocation, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offsetof(Instance, colour)));
+	glVertexAttribDivisor(colourLocation, 1);
+}
+
+size_t InstanceBuffer::getCount() const
+{
+	return instances.size();
+}
+
+const glm::mat4& InstanceBuffer::getTransform(size_t index) const
+{
+	return instances[index].transform;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Per-copy transforms and colours for instanced draws, read as vertex attributes 2 to 9
+// with a divisor of one. Edits only mark instances dirty; flush uploads the dirty runs,
+// so moving a few copies costs a few small writes instead of the whole buffer.
+class InstanceBuffer
+{
+public:
+	static const unsigned firstAttribute = 2;
+
+	InstanceBuffer();
+	~InstanceBuffer();
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+	void assign(const std::vector<glm::mat4>& transforms, const std::vector<glm::vec4>& colours);
+	bool setTransform(size_t index, const glm::mat4& transform);
+	bool setColour(size_t index, const glm::vec4& colour);
+	void flush();
+	void attach(unsigned vao) const;
+	size_t getCount() const;
+	const glm::mat4& getTransform(size_t index) const;
+
+private:
+	struct Instance
+	{
+		glm::mat4 transform;
+		glm::mat4 normalMatrix;
+		glm::vec4 colour;
+	};
+
+	void markDirty(size_t index);
+
+	unsigned buffer;
+	size_t capacity;
+	std::vector<Instance> instances;
+	std::vector<size_t> dirty;
+	std::vector<bool> isDirty;
+};
@@ -0,0 +1,425 @@
+#include "Json.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const JsonValue& nullValue()
+	{
+		static const JsonValue value;
+		return value;
+	}
+
+	const int maxDepth = 256;
+}
+
+class JsonValue::Parser
+{
+public:
+	Parser(const char* begin, const char* end) :
+		p(begin),
+		end(end)
+	{
+	}
+
+	bool parseDocument(JsonValue& value)
+	{
+		if (!parseValue(value, 0))
+		{
+			return false;
+		}
+
+		skipWhitespace();
+		if (p != end)
+		{
+			return fail("Unexpected trailing characters");
+		}
+		return true;
+	}
+
+	std::string error;
+
+private:
+	bool parseValue(JsonValue& value, int depth)
+	{
+		if (depth > maxDepth)
+		{
+			return fail("Document is nested too deeply");
+		}
+
+		skipWhitespace();
+		if (p == end)
+		{
+			return fail("Unexpected end of document");
+		}
+
+		switch (*p)
+		{
+		case '{':
+			return parseObject(value, depth);
+		case '[':
+			return parseArray(value, depth);
+		case '"':
+			value.type = Type::String;
+			return parseString(value.text);
+		case 't':
+			value.type = Type::Boolean;
+			value.boolean = true;
+			return parseLiteral("true");
+		case 'f':
+			value.type = Type::Boolean;
+			value.boolean = false;
+			return parseLiteral("false");
+		case 'n':
+			value.type = Type::Null;
+			return parseLiteral("null");
+		default:
+			return parseNumber(value);
+		}
+	}
+
+	bool parseObject(JsonValue& value, int depth)
+	{
+		value.type = Type::Object;
+		++p;
+
+		skipWhitespace();
+		if (p != end && *p == '}')
+		{
+			++p;
+			return true;
+		}
+
+		for (;;)
+		{
+			skipWhitespace();
+			std::string key;
+			if (p == end || *p != '"' || !parseString(key))
+			{
+				return fail("Expected an object key");
+			}
+
+			skipWhitespace();
+			if (p == end || *p != ':')
+			{
+				return fail("Expected ':'");
+			}
+			++p;
+
+			value.members.emplace_back(std::move(key), JsonValue());
+			if (!parseValue(value.members.back().second, depth + 1))
+			{
+				return false;
+			}
+
+			skipWhitespace();
+			if (p != end && *p == ',')
+			{
+				++p;
+				continue;
+			}
+			if (p != end && *p == '}')
+			{
+				++p;
+				return true;
+			}
+			return fail("Expected ',' or '}'");
+		}
+	}
+
+	bool parseArray(JsonValue& value, int depth)
+	{
+		value.type = Type::Array;
+		++p;
+
+		skipWhitespace();
+		if (p != end && *p == ']')
+		{
+			++p;
+			return true;
+		}
+
+		for (;;)
+		{
+			value.elements.emplace_back();
+			if (!parseValue(value.elements.back(), depth + 1))
+			{
+				return false;
+			}
+
+			skipWhitespace();
+			if (p != end && *p == ',')
+			{
+				++p;
+				continue;
+			}
+			if (p != end && *p == ']')
+			{
+				++p;
+				return true;
+			}
+			return fail("Expected ',' or ']'");
+		}
+	}
+
+	bool parseString(std::string& out)
+	{
+		++p;
+		while (p != end && *p != '"')
+		{
+			if (*p != '\\')
+			{
+				out += *p++;
+				continue;
+			}
+
+			if (++p == end)
+			{
+				break;
+			}
+
+			switch (*p++)
+			{
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				unsigned codePoint;
+				if (!parseHex(codePoint))
+				{
+					return fail("Invalid unicode escape");
+				}
+
+				// Combine UTF-16 surrogate pairs before encoding as UTF-8.
+				if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+				{
+					p += 2;
+					unsigned low;
+					if (!parseHex(low))
+					{
+						return fail("Invalid unicode escape");
+					}
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUtf8(out, codePoint);
+			}
+				break;
+			default:
+				return fail("Invalid escape sequence");
+			}
+		}
+
+		if (p == end)
+		{
+			return fail("Unterminated string");
+		}
+		++p;
+		return true;
+	}
+
+	bool parseHex(unsigned& value)
+	{
+		if (end - p < 4)
+		{
+			return false;
+		}
+
+		value = 0;
+		for (int i = 0; i < 4; ++i, ++p)
+		{
+			value <<= 4;
+			if (*p >= '0' && *p <= '9') value |= *p - '0';
+			else if (*p >= 'a' && *p <= 'f') value |= *p - 'a' + 10;
+			else if (*p >= 'A' && *p <= 'F') value |= *p - 'A' + 10;
+			else return false;
+		}
+		return true;
+	}
+
+	static void appendUtf8(std::string& out, unsigned codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			out += static_cast<char>(codePoint);
+		}
+		else if (codePoint < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (codePoint >> 6));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			out += static_cast<char>(0xE0 | (codePoint >> 12));
+			out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xF0 | (codePoint >> 18));
+			out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	bool parseNumber(JsonValue& value)
+	{
+		// strtod needs a terminated buffer, and numbers in JSON are short.
+		char buffer[64];
+		size_t length = 0;
+		while (p + length != end && length < sizeof(buffer) - 1 && std::strchr("+-0123456789.eE", p[length]))
+		{
+			buffer[length] = p[length];
+			++length;
+		}
+		buffer[length] = '\0';
+
+		char* parsedEnd = nullptr;
+		value.number = std::strtod(buffer, &parsedEnd);
+		if (length == 0 || parsedEnd != buffer + length)
+		{
+			return fail("Invalid value");
+		}
+
+		value.type = Type::Number;
+		p += length;
+		return true;
+	}
+
+	bool parseLiteral(const char* literal)
+	{
+		const size_t length = std::strlen(literal);
+		if (static_cast<size_t>(end - p) < length || std::strncmp(p, literal, length) != 0)
+		{
+			return fail("Invalid literal");
+		}
+		p += length;
+		return true;
+	}
+
+	void skipWhitespace()
+	{
+		while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		{
+			++p;
+		}
+	}
+
+	bool fail(const char* message)
+	{
+		error = message;
+		return false;
+	}
+
+	const char* p;
+	const char* end;
+};
+
+JsonValue::JsonValue() :
+	type(Type::Null),
+	boolean(false),
+	number(0.0)
+{
+}
+
+bool JsonValue::parse(const char* begin, const char* end, JsonValue& value, std::string& error)
+{
+	value = JsonValue();
+	Parser parser(begin, end);
+	if (!parser.parseDocument(value))
+	{
+		error = parser.error;
+		return false;
+	}
+	return true;
+}
+
+JsonValue::Type JsonValue::getType() const
+{
+	return type;
+}
+
+bool JsonValue::isNull() const
+{
+	return type == Type::Null;
+}
+
+bool JsonValue::isNumber() const
+{
+	return type == Type::Number;
+}
+
+bool JsonValue::isString() const
+{
+	return type == Type::String;
+}
+
+bool JsonValue::isArray() const
+{
+	return type == Type::Array;
+}
+
+bool JsonValue::isObject() const
+{
+	return type == Type::Object;
+}
+
+bool JsonValue::asBool(bool fallback) const
+{
+	return type == Type::Boolean ? boolean : fallback;
+}
+
+double JsonValue::asNumber(double fallback) const
+{
+	return type == Type::Number ? number : fallback;
+}
+
+const std::string& JsonValue::asString() const
+{
+	return text;
+}
+
+size_t JsonValue::size() const
+{
+	return type == Type::Array ? elements.size() : members.size();
+}
+
+bool JsonValue::has(const std::string& key) const
+{
+	for (const auto& member : members)
+	{
+		if (member.first == key)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	return index < elements.size() ? elements[index] : nullValue();
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const
+{
+	for (const auto& member : members)
+	{
+		if (member.first == key)
+		{
+			return member.second;
+		}
+	}
+	return nullValue();
+}
+
+const std::vector<std::pair<std::string, JsonValue>>& JsonValue::getMembers() const
+{
+	return members;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal read-only JSON document, enough for glTF headers and configuration files.
+class JsonValue
+{
+public:
+	enum class Type { Null, Boolean, Number, String, Array, Object };
+
+	JsonValue();
+	static bool parse(const char* begin, const char* end, JsonValue& value, std::string& error);
+	Type getType() const;
+	bool isNull() const;
+	bool isNumber() const;
+	bool isString() const;
+	bool isArray() const;
+	bool isObject() const;
+	bool asBool(bool fallback = false) const;
+	double asNumber(double fallback = 0.0) const;
+	const std::string& asString() const;
+	size_t size() const;
+	bool has(const std::string& key) const;
+	const JsonValue& operator[](size_t index) const;
+	const JsonValue& operator[](const std::string& key) const;
+	const std::vector<std::pair<std::string, JsonValue>>& getMembers() const;
+
+private:
+	class Parser;
+
+	Type type;
+	bool boolean;
+	double number;
+	std::string text;
+	std::vector<JsonValue> elements;
+	std::vector<std::pair<std::string, JsonValue>> members;
+};
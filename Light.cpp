@@ -15,6 +15,11 @@ void Light::setAmbientLight(glm::vec4 colour)
 	ambientLight = colour;
 }
 
+void Light::setPosition(glm::vec3 pos)
+{
+	position = pos;
+}
+
 glm::vec4 Light::getDiffuseColor()
 {
 	return diffuseColor;
@@ -29,3 +34,8 @@ glm::vec4 Light::getAmbientLight()
 {
 	return ambientLight;
 }
+
+glm::vec3 Light::getPosition()
+{
+	return position;
+}
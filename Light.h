@@ -11,12 +11,15 @@ public:
 	void setDiffuseColour(glm::vec4 colour);
 	void setDirection(glm::vec3 dir);
 	void setAmbientLight(glm::vec4 colour);
+	void setPosition(glm::vec3 pos);
 	glm::vec4 getDiffuseColor();
 	glm::vec3 getDirection();
 	glm::vec4 getAmbientLight();
+	glm::vec3 getPosition();
 
 private:
 	glm::vec4 diffuseColor;
 	glm::vec3 direction;
 	glm::vec4 ambientLight;
+	glm::vec3 position;
 };
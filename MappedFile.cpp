@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename) :
+	file(INVALID_HANDLE_VALUE),
+	mapping(nullptr),
+	view(nullptr),
+	length(0)
+{
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		return;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		return;
+	}
+
+	view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view)
+	{
+		length = static_cast<size_t>(fileSize.QuadPart);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (view)
+	{
+		UnmapViewOfFile(view);
+	}
+
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+}
+#else
+MappedFile::MappedFile(const std::string& filename) :
+	file(-1),
+	view(nullptr),
+	length(0)
+{
+	file = open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0)
+	{
+		return;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	if (mapping != MAP_FAILED)
+	{
+		madvise(mapping, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+		view = static_cast<const char*>(mapping);
+		length = static_cast<size_t>(status.st_size);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (view)
+	{
+		munmap(const_cast<char*>(view), length);
+	}
+
+	if (file >= 0)
+	{
+		close(file);
+	}
+}
+#endif
+
+bool MappedFile::isOpen() const
+{
+	return view != nullptr;
+}
+
+const char* MappedFile::data() const
+{
+	return view;
+}
+
+size_t MappedFile::size() const
+{
+	return length;
+}
@@ -0,0 +1,372 @@
+#include "HeadlessContext.h"
+#include "MappedFile.h"
+#include "Model.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const char* const stages[] = { "read", "parse", "weld", "normals", "index optimization", "upload", "total" };
+	const size_t pageSize = 4096;
+	const unsigned cacheSize = 16;
+
+	struct Options
+	{
+		std::vector<size_t> triangles = { 10000, 100000, 1000000, 10000000 };
+		std::vector<unsigned> threads;
+		unsigned repeat = 3;
+		std::string directory = ".";
+		std::string output = "mesh-benchmark.json";
+		bool upload = true;
+	};
+
+	bool parseList(const std::string& text, std::vector<size_t>& values)
+	{
+		values.clear();
+		size_t start = 0;
+		while (start <= text.size())
+		{
+			const size_t comma = std::min(text.find(',', start), text.size());
+			char* end = nullptr;
+			const std::string item = text.substr(start, comma - start);
+			const unsigned long long value = std::strtoull(item.c_str(), &end, 10);
+			if (item.empty() || *end != '\0' || value == 0)
+			{
+				return false;
+			}
+			values.push_back(static_cast<size_t>(value));
+			start = comma + 1;
+		}
+		return !values.empty();
+	}
+
+	bool parseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string argument = argv[i];
+			if (argument == "--no-upload")
+			{
+				options.upload = false;
+				continue;
+			}
+
+			if (i + 1 == argc)
+			{
+				return false;
+			}
+
+			const std::string value = argv[++i];
+			std::vector<size_t> list;
+			if (argument == "--triangles" && parseList(value, list))
+			{
+				options.triangles = list;
+			}
+			else if (argument == "--threads" && parseList(value, list))
+			{
+				options.threads.assign(list.begin(), list.end());
+			}
+			else if (argument == "--repeat" && parseList(value, list) && list.size() == 1)
+			{
+				options.repeat = static_cast<unsigned>(list[0]);
+			}
+			else if (argument == "--directory")
+			{
+				options.directory = value;
+			}
+			else if (argument == "--output")
+			{
+				options.output = value;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		// By default the pool is measured at every power of two up to the hardware threads.
+		if (options.threads.empty())
+		{
+			const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned count = 1; count < hardware; count *= 2)
+			{
+				options.threads.push_back(count);
+			}
+			options.threads.push_back(hardware);
+		}
+		return true;
+	}
+
+	// A rippled square grid, so that generated normals vary, with about the requested
+	// number of triangles.
+	void generateGrid(size_t triangles, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices)
+	{
+		const size_t side = std::max<size_t>(1, static_cast<size_t>(std::sqrt(triangles / 2.0)));
+		const size_t rows = std::max<size_t>(1, triangles / (2 * side));
+		const size_t columns = side;
+
+		vertices.clear();
+		indices.clear();
+		vertices.reserve((rows + 1) * (columns + 1));
+		indices.reserve(rows * columns * 6);
+		for (size_t row = 0; row <= rows; ++row)
+		{
+			for (size_t column = 0; column <= columns; ++column)
+			{
+				const float x = static_cast<float>(column) / columns * 2.0f - 1.0f;
+				const float y = static_cast<float>(row) / rows * 2.0f - 1.0f;
+				vertices.emplace_back(x, y, 0.05f * std::sin(x * 20.0f) * std::cos(y * 20.0f));
+			}
+		}
+
+		for (size_t row = 0; row < rows; ++row)
+		{
+			for (size_t column = 0; column < columns; ++column)
+			{
+				const unsigned int corner = static_cast<unsigned int>(row * (columns + 1) + column);
+				const unsigned int above = corner + static_cast<unsigned int>(columns + 1);
+				const unsigned int quad[] = { corner, corner + 1, above + 1, corner, above + 1, above };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	bool writePly(const std::string& file, const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices)
+	{
+		std::ofstream stream(file, std::ios::binary);
+		stream << "ply\nformat binary_little_endian 1.0\nelement vertex " << vertices.size() <<
+			"\nproperty float x\nproperty float y\nproperty float z\nelement face " << indices.size() / 3 <<
+			"\nproperty list uchar int vertex_indices\nend_header\n";
+		stream.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(glm::vec3));
+
+		std::vector<char> faces(indices.size() / 3 * 13);
+		for (size_t i = 0; i < indices.size() / 3; ++i)
+		{
+			faces[i * 13] = 3;
+			std::memcpy(&faces[i * 13 + 1], &indices[i * 3], 3 * sizeof(unsigned int));
+		}
+		stream.write(faces.data(), faces.size());
+		return static_cast<bool>(stream);
+	}
+
+	bool writeStl(const std::string& file, const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices)
+	{
+		std::ofstream stream(file, std::ios::binary);
+		char header[80] = "binary STL written by MeshBenchmark";
+		const uint32_t count = static_cast<uint32_t>(indices.size() / 3);
+		stream.write(header, sizeof(header));
+		stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+		std::vector<char> records(static_cast<size_t>(count) * 50, 0);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3& a = vertices[indices[i * 3]];
+			const glm::vec3& b = vertices[indices[i * 3 + 1]];
+			const glm::vec3& c = vertices[indices[i * 3 + 2]];
+			const glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+			char* record = &records[i * 50];
+			std::memcpy(record, &normal, sizeof(glm::vec3));
+			std::memcpy(record + 12, &a, sizeof(glm::vec3));
+			std::memcpy(record + 24, &b, sizeof(glm::vec3));
+			std::memcpy(record + 36, &c, sizeof(glm::vec3));
+		}
+		stream.write(records.data(), records.size());
+		return static_cast<bool>(stream);
+	}
+
+	// Maps the file and touches every page, as a loader reading it would.
+	size_t readFile(const std::string& file)
+	{
+		MappedFile mapped(file);
+		volatile char touched = 0;
+		for (size_t offset = 0; offset < mapped.size(); offset += pageSize)
+		{
+			touched = mapped.data()[offset];
+		}
+		static_cast<void>(touched);
+		return mapped.isOpen() ? mapped.size() : 0;
+	}
+
+	// Average number of cache misses per triangle for a FIFO post-transform cache.
+	double getCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount)
+	{
+		std::vector<uint8_t> cached(vertexCount, 0);
+		std::deque<unsigned int> fifo;
+		size_t misses = 0;
+		for (const unsigned int index : indices)
+		{
+			if (cached[index])
+			{
+				continue;
+			}
+
+			++misses;
+			cached[index] = 1;
+			fifo.push_back(index);
+			if (fifo.size() > cacheSize)
+			{
+				cached[fifo.front()] = 0;
+				fifo.pop_front();
+			}
+		}
+		return indices.size() < 3 ? 0.0 : static_cast<double>(misses) / (indices.size() / 3);
+	}
+}
+
+// Times every stage of loading a model, for synthetic binary PLY and STL files of growing
+// size and for a range of thread counts: reading the file, parsing it, welding, normal
+// generation, index optimization and the upload, which runs against an offscreen context
+// when one can be created. Files are written before they are measured, so they are read
+// from the page cache. Each stage reports its median over the repeats, in milliseconds,
+// as a JSON file:
+//   MeshBenchmark [--triangles n,...] [--threads n,...] [--repeat n] [--directory dir]
+//                 [--output out.json] [--no-upload]
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "Usage: %s [--triangles n,...] [--threads n,...] [--repeat n] [--directory dir] [--output out.json] [--no-upload]\n", argv[0]);
+		return 2;
+	}
+
+	std::ofstream report(options.output);
+	if (!report)
+	{
+		std::fprintf(stderr, "Cannot write %s.\n", options.output.c_str());
+		return 1;
+	}
+
+	HeadlessContext* context = nullptr;
+	if (options.upload)
+	{
+		try
+		{
+			context = new HeadlessContext(64, 64, 1000.0f, 0.1f);
+		}
+		catch (const std::exception& e)
+		{
+			std::fprintf(stderr, "%s Uploads are not measured.\n", e.what());
+		}
+	}
+
+	report << "{\n  \"renderer\": ";
+	if (context)
+	{
+		report << '"' << context->getVideoCardInfo() << '"';
+	}
+	else
+	{
+		report << "null";
+	}
+	report << ",\n  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n  \"repeat\": " << options.repeat << ",\n  \"results\": [";
+
+	Profiler& profiler = Profiler::instance();
+	bool first = true;
+	int status = 0;
+	for (const size_t triangles : options.triangles)
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<unsigned int> indices;
+		generateGrid(triangles, vertices, indices);
+
+		const std::string formats[] = { "ply", "stl" };
+		for (const std::string& format : formats)
+		{
+			const std::string file = options.directory + "/mesh-benchmark-" + std::to_string(triangles) + "." + format;
+			if (!(format == "ply" ? writePly(file, vertices, indices) : writeStl(file, vertices, indices)))
+			{
+				std::fprintf(stderr, "Cannot write %s.\n", file.c_str());
+				status = 1;
+				continue;
+			}
+
+			for (const unsigned threads : options.threads)
+			{
+				ThreadPool::instance().resize(threads);
+				profiler.clear();
+
+				size_t fileBytes = 0;
+				size_t loadedVertices = 0;
+				double cacheMissRatio = 0.0;
+				bool loaded = true;
+				for (unsigned run = 0; run < options.repeat && loaded; ++run)
+				{
+					{
+						Profiler::Zone zone("model/read");
+						fileBytes = readFile(file);
+					}
+
+					try
+					{
+						const auto start = std::chrono::high_resolution_clock::now();
+						Model model(file, 0, context != nullptr);
+						if (context)
+						{
+							glFinish();
+						}
+						profiler.record("cpu/model/total", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+						loadedVertices = model.getVertices().size();
+						if (run == 0)
+						{
+							cacheMissRatio = getCacheMissRatio(model.getIndices(), loadedVertices);
+						}
+					}
+					catch (const std::exception& e)
+					{
+						std::fprintf(stderr, "%s: %s\n", file.c_str(), e.what());
+						loaded = false;
+						status = 1;
+					}
+				}
+
+				report << (first ? "\n" : ",\n") << "    { \"format\": \"" << format << "\", \"triangles\": " << indices.size() / 3 <<
+					", \"threads\": " << threads << ", \"fileBytes\": " << fileBytes << ", \"vertices\": " << loadedVertices <<
+					", \"acmr\": " << cacheMissRatio << ", \"milliseconds\": {";
+				for (size_t stage = 0; stage < sizeof(stages) / sizeof(stages[0]); ++stage)
+				{
+					const Profiler::Summary summary = profiler.getSummary(std::string("cpu/model/") + stages[stage]);
+					report << (stage > 0 ? ", " : " ") << '"' << stages[stage] << "\": ";
+					const bool measured = context != nullptr || std::strcmp(stages[stage], "upload") != 0;
+					if (summary.samples > 0 && loaded && measured)
+					{
+						report << summary.p50;
+					}
+					else
+					{
+						report << "null";
+					}
+				}
+				report << " } }";
+				report.flush();
+				first = false;
+			}
+
+			std::remove(file.c_str());
+		}
+	}
+
+	report << "\n  ]\n}\n";
+	ThreadPool::instance().resize(std::max(1u, std::thread::hardware_concurrency()));
+
+	if (context)
+	{
+		delete context;
+	}
+
+	return report ? status : 1;
+}
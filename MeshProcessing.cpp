@@ -0,0 +1,333 @@
+#include "MeshProcessing.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define MESH_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+#define MESH_PREFETCH(address)
+#endif
+
+namespace
+{
+	const size_t vertexGrain = 1 << 16;
+	const uint64_t emptySlot = ~0ull;
+	const size_t maxWeldVertices = size_t(1) << 30;
+	// Vertices whose table slots are fetched ahead of being inserted.
+	const size_t prefetchDistance = 32;
+	const uint32_t cacheSize = 16;
+}
+
+size_t weldVertices(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	const size_t count = vertices.size();
+
+	// Table slots are remembered as 32-bit numbers, which bounds the table size.
+	if (count == 0 || count >= maxWeldVertices)
+	{
+		return count;
+	}
+
+	const bool hasNormals = normals.size() == count;
+	const auto hash = [&](size_t vertex)
+	{
+		uint32_t words[6];
+		std::memcpy(words, &vertices[vertex], sizeof(glm::vec3));
+		std::memcpy(words + 3, hasNormals ? &normals[vertex] : &vertices[vertex], sizeof(glm::vec3));
+		uint64_t value = 0;
+		for (const uint32_t word : words)
+		{
+			value = (value ^ word) * 0x9E3779B97F4A7C15ull;
+		}
+		value ^= value >> 29;
+		value *= 0xBF58476D1CE4E5B9ull;
+		return value ^ (value >> 32);
+	};
+	const auto equal = [&](size_t a, size_t b)
+	{
+		return std::memcmp(&vertices[a], &vertices[b], sizeof(glm::vec3)) == 0 &&
+			(!hasNormals || std::memcmp(&normals[a], &normals[b], sizeof(glm::vec3)) == 0);
+	};
+
+	size_t tableSize = 1;
+	while (tableSize < count * 2)
+	{
+		tableSize <<= 1;
+	}
+	const size_t mask = tableSize - 1;
+
+	// A slot holds the upper half of a vertex's hash above its index, so that most
+	// mismatches are rejected without reading another vertex.
+	ThreadPool& pool = ThreadPool::instance();
+	std::unique_ptr<std::atomic<uint64_t>[]> table(new std::atomic<uint64_t>[tableSize]);
+	pool.parallelFor(tableSize, vertexGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			table[i].store(emptySlot, std::memory_order_relaxed);
+		}
+	});
+
+	// Every distinct vertex settles in the table as the lowest index that carries it,
+	// however the threads interleave, which keeps the result deterministic. Each vertex
+	// remembers its slot until the table is complete.
+	std::vector<uint32_t> representatives(count);
+	pool.parallelFor(count, vertexGrain, [&](size_t begin, size_t end)
+	{
+		uint64_t hashes[prefetchDistance];
+		for (size_t first = begin; first < end; first += prefetchDistance)
+		{
+			const size_t last = std::min(first + prefetchDistance, end);
+			for (size_t i = first; i < last; ++i)
+			{
+				hashes[i - first] = hash(i);
+				MESH_PREFETCH(&table[hashes[i - first] & mask]);
+			}
+
+			for (size_t i = first; i < last; ++i)
+			{
+				const uint64_t tag = hashes[i - first] & ~uint64_t(0xFFFFFFFF);
+				const uint64_t entry = tag | i;
+				size_t slot = hashes[i - first] & mask;
+				for (;; slot = (slot + 1) & mask)
+				{
+					uint64_t current = table[slot].load();
+					if (current == emptySlot && table[slot].compare_exchange_strong(current, entry))
+					{
+						break;
+					}
+
+					// A slot only ever changes to an equal vertex once it is taken.
+					if ((current & ~uint64_t(0xFFFFFFFF)) == tag && equal(current & 0xFFFFFFFF, i))
+					{
+						while (entry < current && !table[slot].compare_exchange_weak(current, entry))
+						{
+						}
+						break;
+					}
+				}
+				representatives[i] = static_cast<uint32_t>(slot);
+			}
+		}
+	});
+
+	pool.parallelFor(count, vertexGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (i + prefetchDistance < end)
+			{
+				MESH_PREFETCH(&table[representatives[i + prefetchDistance]]);
+			}
+			representatives[i] = static_cast<uint32_t>(table[representatives[i]].load(std::memory_order_relaxed));
+		}
+	});
+	table.reset();
+
+	// Survivors are numbered in order by counting them per chunk first.
+	const size_t chunks = (count + vertexGrain - 1) / vertexGrain;
+	std::vector<size_t> chunkStarts(chunks + 1, 0);
+	pool.parallelFor(chunks, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			size_t survivors = 0;
+			for (size_t i = chunk * vertexGrain; i < std::min(count, (chunk + 1) * vertexGrain); ++i)
+			{
+				survivors += representatives[i] == i ? 1 : 0;
+			}
+			chunkStarts[chunk + 1] = survivors;
+		}
+	});
+	for (size_t chunk = 0; chunk < chunks; ++chunk)
+	{
+		chunkStarts[chunk + 1] += chunkStarts[chunk];
+	}
+
+	const size_t welded = chunkStarts[chunks];
+	std::vector<uint32_t> remap(count);
+	std::vector<glm::vec3> weldedVertices(welded);
+	std::vector<glm::vec3> weldedNormals(hasNormals ? welded : 0);
+	pool.parallelFor(chunks, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			uint32_t next = static_cast<uint32_t>(chunkStarts[chunk]);
+			for (size_t i = chunk * vertexGrain; i < std::min(count, (chunk + 1) * vertexGrain); ++i)
+			{
+				if (representatives[i] == i)
+				{
+					weldedVertices[next] = vertices[i];
+					if (hasNormals)
+					{
+						weldedNormals[next] = normals[i];
+					}
+					remap[i] = next++;
+				}
+			}
+		}
+	});
+
+	pool.parallelFor(indices.size(), vertexGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			indices[i] = remap[representatives[indices[i]]];
+		}
+	});
+
+	vertices.swap(weldedVertices);
+	if (hasNormals)
+	{
+		normals.swap(weldedNormals);
+	}
+	return welded;
+}
+
+void generateNormals(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices, std::vector<glm::vec3>& normals)
+{
+	normals.assign(vertices.size(), glm::vec3(0.0f));
+
+	// Area-weighted face normals are accumulated per vertex, then normalized in parallel.
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const glm::vec3& a = vertices[indices[i]];
+		const glm::vec3& b = vertices[indices[i + 1]];
+		const glm::vec3& c = vertices[indices[i + 2]];
+		const glm::vec3 faceNormal = glm::cross(b - a, c - a);
+
+		normals[indices[i]] += faceNormal;
+		normals[indices[i + 1]] += faceNormal;
+		normals[indices[i + 2]] += faceNormal;
+	}
+
+	ThreadPool::instance().parallelFor(normals.size(), vertexGrain, [&normals](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const float length = glm::length(normals[i]);
+			normals[i] = length > 0.0f ? normals[i] / length : glm::vec3(0.0f, 0.0f, -1.0f);
+		}
+	});
+}
+
+// Triangles are emitted in fans around one vertex at a time. The next fan is the
+// neighbour that will still be cached once its remaining triangles are drawn, preferring
+// the one cached longest; with none, the most recently used vertex that still has
+// triangles, and failing that the next such vertex in index order.
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		++offsets[indices[i] + 1];
+	}
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		offsets[vertex + 1] += offsets[vertex];
+	}
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> live(vertexCount);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		live[vertex] = offsets[vertex + 1] - offsets[vertex];
+	}
+
+	const size_t none = ~size_t(0);
+	std::vector<uint32_t> stamps(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<unsigned int> ordered;
+	ordered.reserve(indices.size());
+
+	uint32_t time = cacheSize + 1;
+	size_t cursor = 0;
+	size_t fanning = 0;
+	while (fanning != none)
+	{
+		candidates.clear();
+		for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; ++k)
+		{
+			const uint32_t triangle = adjacency[k];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+
+			for (size_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t vertex = indices[triangle * 3 + corner];
+				ordered.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				--live[vertex];
+				if (time - stamps[vertex] > cacheSize)
+				{
+					stamps[vertex] = time++;
+				}
+			}
+			emitted[triangle] = 1;
+		}
+
+		fanning = none;
+		int64_t bestPriority = -1;
+		for (const uint32_t vertex : candidates)
+		{
+			if (live[vertex] == 0)
+			{
+				continue;
+			}
+
+			const int64_t age = time - stamps[vertex];
+			const int64_t priority = age + 2 * static_cast<int64_t>(live[vertex]) <= cacheSize ? age : 0;
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = vertex;
+			}
+		}
+
+		while (fanning == none && !deadEnds.empty())
+		{
+			const uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[vertex] > 0)
+			{
+				fanning = vertex;
+			}
+		}
+
+		while (fanning == none && cursor < vertexCount)
+		{
+			if (live[cursor] > 0)
+			{
+				fanning = cursor;
+			}
+			++cursor;
+		}
+	}
+
+	// A trailing partial triangle is kept where it was.
+	ordered.insert(ordered.end(), indices.begin() + triangleCount * 3, indices.end());
+	indices.swap(ordered);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Merges vertices whose position and normal are bitwise equal and points the indices at
+// the survivors, which keep the order in which they first appear. Triangle soups such as
+// STL shrink to the vertices they share without losing their facet normals. Runs on the
+// thread pool and gives the same result for any number of threads. Returns the number
+// of vertices left.
+size_t weldVertices(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+
+// Area-weighted vertex normals of an indexed triangle list.
+void generateNormals(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices, std::vector<glm::vec3>& normals);
+
+// Reorders triangles so that vertices are reused while they are still in the
+// post-transform cache, with the Tipsify algorithm of Sander, Nehab and Barczak.
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
@@ -1,79 +1,564 @@
 #include "Model.h"
+#include "GLState.h"
+#include "GlbLoader.h"
+#include "GzipStream.h"
+#include "MeshProcessing.h"
+#include "PlyLoader.h"
+#include "Profiler.h"
+#include "StlLoader.h"
+#include "ThreeMfLoader.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
-#include <exception>
+#include <stdexcept>
 
-Model::Model(const std::string &modelFilename, int meshIndex):
+namespace
+{
+	const unsigned assimpFlags = aiProcess_CalcTangentSpace |
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType;
+}
+
+// Without upload the model keeps its data on the CPU only and needs no OpenGL context,
+// for the software renderer; formats whose loaders upload as they read are refused.
+// Quantization stores positions of meshes built on the CPU in 16 bits, which trades
+// precision for memory, so it is only used when asked for.
+Model::Model(const std::string &modelFilename, int meshIndex, bool upload, bool quantize):
 	vao(0),
 	vertVbo(0),
 	normVbo(0),
-	ebo(0)
+	ebo(0),
+	pointCloud(nullptr),
+	positionScale(1.0f, 1.0f, 1.0f, 0.0f),
+	positionOffset(0.0f),
+	uploaded(upload),
+	quantize(quantize),
+	triangleList(false),
+	separateTriangles(false)
 {
-	if (!loadModel(modelFilename, meshIndex))
+	// Every stage is timed by the profiler, so their cost can be followed per mesh size.
+	{
+		Profiler::Zone zone("model/parse");
+		if (!loadModel(modelFilename, meshIndex))
+		{
+			throw std::runtime_error("Cannot load model file!");
+		}
+	}
+
+	// Loaders that upload their own buffers leave the CPU arrays empty.
+	if (!vertices.empty())
+	{
+		// Triangle soups share their corners once welded, and triangle lists read natively
+		// are reordered for the post-transform cache.
+		if (separateTriangles)
+		{
+			Profiler::Zone zone("model/weld");
+			weldVertices(vertices, normals, indices);
+		}
+
+		if (normals.empty() && !indices.empty())
+		{
+			Profiler::Zone zone("model/normals");
+			generateNormals(vertices, indices, normals);
+		}
+
+		if (triangleList && !indices.empty())
+		{
+			Profiler::Zone zone("model/index optimization");
+			optimizeVertexCache(indices, vertices.size());
+		}
+
+		computePositionRange();
+		{
+			Profiler::Zone zone("model/upload");
+			initializeBuffers();
+		}
+		computeBounds();
+	}
+
+	// Files without faces are drawn as sorted point clouds from the start.
+	if (indices.empty() && !vertices.empty() && uploaded)
 	{
-		throw std::exception("Cannot load model file!");
+		buildPointCloud();
 	}
 
-	initializeBuffers();
+	// Formats without a scene graph draw every primitive once, untransformed.
+	if (instances.empty())
+	{
+		for (size_t i = 0; i < primitives.size(); ++i)
+		{
+			instances.push_back({ i, glm::mat4(1.0f) });
+		}
+	}
 }
 
 Model::~Model()
 {
+	if (pointCloud)
+	{
+		delete pointCloud;
+	}
+
+	if (!uploaded)
+	{
+		return;
+	}
+
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glDeleteBuffers(1, &vertVbo);
+	GLState& state = GLState::instance();
+	state.bindBuffer(GL_ARRAY_BUFFER, 0);
+	state.deleteBuffers(1, &vertVbo);
 
-	glBindVertexArray(0);
-	glDeleteVertexArrays(1, &vao);
-	glDeleteBuffers(1, &normVbo);
-	glDeleteBuffers(1, &ebo);
+	state.bindVertexArray(0);
+	state.deleteVertexArrays(1, &vao);
+	state.deleteBuffers(1, &normVbo);
+	state.deleteBuffers(1, &ebo);
+
+	for (const Primitive& primitive : primitives)
+	{
+		if (primitive.vao != vao)
+		{
+			state.deleteVertexArrays(1, &primitive.vao);
+		}
+	}
+
+	if (!buffers.empty())
+	{
+		state.deleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+	}
 }
 
-void Model::render() const
+void Model::render(size_t primitive) const
 {
-	glBindVertexArray(vao);
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	const Primitive& draw = primitives[primitive];
+
+	// The vertex array stays bound, so consecutive draws of one primitive bind it once.
+	GLState::instance().bindVertexArray(draw.vao);
+	if (draw.indexType)
+	{
+		glDrawElements(draw.mode, draw.count, draw.indexType, reinterpret_cast<const void*>(draw.indexOffset));
+	}
+	else
+	{
+		glDrawArrays(draw.mode, 0, draw.count);
+	}
+}
+
+void Model::renderInstanced(size_t primitive, int instanceCount) const
+{
+	const Primitive& draw = primitives[primitive];
+
+	GLState::instance().bindVertexArray(draw.vao);
+	if (draw.indexType)
+	{
+		glDrawElementsInstanced(draw.mode, draw.count, draw.indexType, reinterpret_cast<const void*>(draw.indexOffset), instanceCount);
+	}
+	else
+	{
+		glDrawArraysInstanced(draw.mode, 0, draw.count, instanceCount);
+	}
+}
+
+// Every vertex array of the model reads the same instance attributes; primitives that
+// share a vertex array are attached once.
+void Model::attachInstances(const InstanceBuffer& instanceBuffer) const
+{
+	std::vector<unsigned> attached;
+	for (const Primitive& primitive : primitives)
+	{
+		if (std::find(attached.begin(), attached.end(), primitive.vao) == attached.end())
+		{
+			instanceBuffer.attach(primitive.vao);
+			attached.push_back(primitive.vao);
+		}
+	}
+}
+
+bool Model::renderPoints(size_t budget) const
+{
+	if (!pointCloud)
+	{
+		return false;
+	}
+
+	pointCloud->render(budget);
+	return true;
+}
+
+bool Model::buildPointCloud()
+{
+	// Points are drawn untransformed, so models placed by instances cannot be shown as clouds.
+	if (pointCloud || !uploaded || vertices.empty() || primitives.size() != 1)
+	{
+		return pointCloud != nullptr;
+	}
+
+	pointCloud = new PointCloud(vertices, normals);
+	return true;
+}
+
+bool Model::isPointCloud() const
+{
+	return indices.empty() && pointCloud != nullptr;
+}
+
+const std::vector<Model::Instance>& Model::getInstances() const
+{
+	return instances;
+}
+
+const std::vector<Model::Primitive>& Model::getPrimitives() const
+{
+	return primitives;
+}
+
+bool Model::hasNormals() const
+{
+	return !normals.empty();
+}
+
+glm::vec4 Model::getPositionScale() const
+{
+	return positionScale;
+}
+
+glm::vec4 Model::getPositionOffset() const
+{
+	return positionOffset;
+}
+
+const std::vector<glm::vec3>& Model::getVertices() const
+{
+	return vertices;
+}
+
+const std::vector<glm::vec3>& Model::getNormals() const
+{
+	return normals;
+}
+
+const std::vector<unsigned int>& Model::getIndices() const
+{
+	return indices;
+}
+
+// A model read without a context creates its buffers here, on the thread that owns the
+// context, once it has been handed over.
+bool Model::upload()
+{
+	if (uploaded)
+	{
+		return true;
+	}
+
+	uploaded = true;
+	if (!vertices.empty())
+	{
+		createBuffers();
+		for (Primitive& primitive : primitives)
+		{
+			if (primitive.vao == 0)
+			{
+				primitive.vao = vao;
+			}
+		}
+	}
+
+	if (indices.empty() && !vertices.empty())
+	{
+		buildPointCloud();
+	}
+	return true;
 }
 
 void Model::initializeBuffers()
+{
+	if (uploaded)
+	{
+		createBuffers();
+	}
+
+	// Loaders that split the shared buffers into ranges leave the vertex array to us.
+	if (!primitives.empty())
+	{
+		for (Primitive& primitive : primitives)
+		{
+			if (primitive.vao == 0)
+			{
+				primitive.vao = vao;
+				primitive.normals = !normals.empty();
+				primitive.quantized = quantize;
+			}
+		}
+		return;
+	}
+
+	Primitive primitive;
+	primitive.vao = vao;
+	primitive.indexOffset = 0;
+	primitive.normals = !normals.empty();
+	primitive.quantized = quantize;
+	if (indices.empty())
+	{
+		primitive.mode = GL_POINTS;
+		primitive.indexType = 0;
+		primitive.count = static_cast<int>(vertices.size());
+	}
+	else
+	{
+		primitive.mode = GL_TRIANGLES;
+		primitive.indexType = GL_UNSIGNED_INT;
+		primitive.count = static_cast<int>(indices.size());
+	}
+	primitives.push_back(primitive);
+}
+
+void Model::createBuffers()
 {
 	glGenVertexArrays(1, &vao);
 	glGenBuffers(1, &vertVbo);
 	glGenBuffers(1, &normVbo);
 	glGenBuffers(1, &ebo);
-	
+
 	glBindVertexArray(vao);
-	glBindBuffer(GL_ARRAY_BUFFER, vertVbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+	uploadPositions();
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-	
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, normVbo);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	if (!indices.empty())
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	}
+
+	if (normals.empty())
+	{
+		// Point clouds without normals are lit as if every point faced the default camera.
+		glVertexAttrib3f(1, 0.0f, 0.0f, -1.0f);
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, normVbo);
+		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+// The bounding box of the mesh, which quantized positions are relative to.
+void Model::computePositionRange()
+{
+	glm::vec3 minimum = vertices.front();
+	glm::vec3 maximum = vertices.front();
+	for (const glm::vec3& vertex : vertices)
+	{
+		minimum = glm::min(minimum, vertex);
+		maximum = glm::max(maximum, vertex);
+	}
+
+	const glm::vec3 centre = (minimum + maximum) * 0.5f;
+	glm::vec3 extent = (maximum - minimum) * 0.5f;
+	extent = glm::vec3(extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f, extent.z > 0.0f ? extent.z : 1.0f);
+	positionScale = glm::vec4(extent, 0.0f);
+	positionOffset = glm::vec4(centre, 0.0f);
+}
+
+// Quantized positions are stored as 16-bit normalized integers relative to the bounding
+// box, eight bytes per vertex with the padding instead of twelve; the vertex shader
+// scales them back with positionScale and positionOffset. Otherwise they are uploaded
+// as floats, unchanged.
+void Model::uploadPositions()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, vertVbo);
+	glEnableVertexAttribArray(0);
+	if (!quantize)
+	{
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+		return;
+	}
+
+	const glm::vec3 centre(positionOffset);
+	const glm::vec3 extent(positionScale);
+
+	// The fourth component only pads each position to eight bytes.
+	std::vector<int16_t> quantized(vertices.size() * 4);
+	const glm::vec3 factor = glm::vec3(32767.0f) / extent;
+	ThreadPool::instance().parallelFor(vertices.size(), 1 << 16, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const glm::vec3 value = (vertices[i] - centre) * factor;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				quantized[i * 4 + axis] = static_cast<int16_t>(std::lround(std::max(-32767.0f, std::min(value[axis], 32767.0f))));
+			}
+			quantized[i * 4 + 3] = 0;
+		}
+	});
+
+	glBufferData(GL_ARRAY_BUFFER, quantized.size() * sizeof(int16_t), quantized.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, 4 * sizeof(int16_t), nullptr);
+}
+
+// A single primitive covers every vertex and reuses the box found for quantization;
+// ranges of a shared index buffer are bounded by the vertices they reference.
+void Model::computeBounds()
+{
+	if (primitives.size() == 1)
+	{
+		primitives[0].boundsMin = glm::vec3(positionOffset - positionScale);
+		primitives[0].boundsMax = glm::vec3(positionOffset + positionScale);
+		return;
+	}
+
+	ThreadPool::instance().parallelFor(primitives.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			Primitive& primitive = primitives[i];
+			if (primitive.indexType != GL_UNSIGNED_INT || primitive.count <= 0)
+			{
+				primitive.boundsMin = glm::vec3(positionOffset - positionScale);
+				primitive.boundsMax = glm::vec3(positionOffset + positionScale);
+				continue;
+			}
+
+			const size_t first = primitive.indexOffset / sizeof(unsigned int);
+			glm::vec3 minimum = vertices[indices[first]];
+			glm::vec3 maximum = minimum;
+			for (size_t index = first; index < first + static_cast<size_t>(primitive.count); ++index)
+			{
+				minimum = glm::min(minimum, vertices[indices[index]]);
+				maximum = glm::max(maximum, vertices[indices[index]]);
+			}
+			primitive.boundsMin = minimum;
+			primitive.boundsMax = maximum;
+		}
+	});
 }
 
 bool Model::loadModel(const std::string &filename, int meshIndex)
 {
+	const std::string extension = getExtension(filename);
+
+	if (extension == ".ply")
+	{
+		PlyLoader loader;
+		if (loader.load(filename, vertices, normals, indices))
+		{
+			triangleList = true;
+			return true;
+		}
+
+		// ASCII and big-endian files are still handled by Assimp.
+		vertices.clear();
+		normals.clear();
+		indices.clear();
+	}
+	else if (extension == ".stl")
+	{
+		StlLoader loader;
+		if (loader.load(filename, vertices, normals, indices))
+		{
+			triangleList = true;
+			separateTriangles = true;
+			return true;
+		}
+
+		// ASCII files are still handled by Assimp.
+		vertices.clear();
+		normals.clear();
+		indices.clear();
+	}
+	else if (needsContext(filename))
+	{
+		if (!uploaded)
+		{
+			return false;
+		}
+
+		GlbLoader loader;
+		return loader.load(filename, meshIndex, primitives, buffers);
+	}
+	else if (extension == ".3mf")
+	{
+		ThreeMfLoader loader;
+		return loader.load(filename, vertices, indices, primitives, instances);
+	}
+	else if (extension == ".gz")
+	{
+		return loadCompressed(filename, meshIndex);
+	}
+
+	return loadAssimp(filename, meshIndex);
+}
+
+bool Model::loadCompressed(const std::string& filename, int meshIndex)
+{
+	const std::string extension = getExtension(filename.substr(0, filename.size() - 3));
+
+	// Binary PLY and STL are converted while the producer thread is still decompressing.
+	{
+		GzipStream stream(filename);
+		if (!stream.isOpen())
+		{
+			return false;
+		}
+
+		if (extension == ".ply")
+		{
+			PlyLoader loader;
+			if (loader.load(stream, vertices, normals, indices))
+			{
+				triangleList = true;
+				return true;
+			}
+		}
+		else if (extension == ".stl")
+		{
+			StlLoader loader;
+			if (loader.load(stream, vertices, normals, indices))
+			{
+				triangleList = true;
+				separateTriangles = true;
+				return true;
+			}
+		}
+	}
+
+	// Anything else is decompressed into memory and handed to Assimp.
+	vertices.clear();
+	normals.clear();
+	indices.clear();
+
+	std::vector<char> data;
+	if (!GzipStream::readAll(filename, data))
+	{
+		return false;
+	}
+
 	Assimp::Importer importer;
+	const std::string hint = extension.empty() ? std::string() : extension.substr(1);
+	return readScene(importer.ReadFileFromMemory(data.data(), data.size(), assimpFlags, hint.c_str()), meshIndex);
+}
 
-	const aiScene* scene = importer.ReadFile(filename,
-		aiProcess_CalcTangentSpace |
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_SortByPType);
+bool Model::loadAssimp(const std::string& filename, int meshIndex)
+{
+	Assimp::Importer importer;
+	return readScene(importer.ReadFile(filename, assimpFlags), meshIndex);
+}
 
+bool Model::readScene(const aiScene* scene, int meshIndex)
+{
 	if (!scene) 
 	{
-		std::string error = importer.GetErrorString();
 		return false;
 	}
 
@@ -107,3 +592,23 @@ bool Model::loadModel(const std::string &filename, int meshIndex)
 
 	return true;
 }
+
+// Files whose loaders upload as they read, such as glTF binaries, can only be loaded
+// with upload, on a thread whose OpenGL context is current.
+bool Model::needsContext(const std::string& filename)
+{
+	return getExtension(filename) == ".glb";
+}
+
+std::string Model::getExtension(const std::string& filename)
+{
+	const size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return std::string();
+	}
+
+	std::string extension = filename.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension;
+}
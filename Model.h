@@ -1,6 +1,8 @@
 #pragma once
 
 #include "glad/glad.h"
+#include "InstanceBuffer.h"
+#include "PointCloud.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -10,20 +12,73 @@
 class Model
 {
 public:
-	Model(const std::string& modelFilename, int meshIndex = 0);
+	struct Primitive
+	{
+		unsigned vao;
+		unsigned mode;
+		unsigned indexType;
+		size_t indexOffset;
+		int count;
+		bool normals;
+		bool quantized;
+		// Bounds in model space; a minimum above the maximum marks a primitive without bounds.
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	struct Instance
+	{
+		size_t primitive;
+		glm::mat4 transform;
+	};
+
+	Model(const std::string& modelFilename, int meshIndex = 0, bool upload = true, bool quantize = false);
 	~Model();
-	void render() const;
+	bool upload();
+	void render(size_t primitive) const;
+	void renderInstanced(size_t primitive, int instanceCount) const;
+	void attachInstances(const InstanceBuffer& instanceBuffer) const;
+	bool renderPoints(size_t budget) const;
+	bool buildPointCloud();
+	bool isPointCloud() const;
+	const std::vector<Instance>& getInstances() const;
+	const std::vector<Primitive>& getPrimitives() const;
+	bool hasNormals() const;
+	glm::vec4 getPositionScale() const;
+	glm::vec4 getPositionOffset() const;
+	const std::vector<glm::vec3>& getVertices() const;
+	const std::vector<glm::vec3>& getNormals() const;
+	const std::vector<unsigned int>& getIndices() const;
+	static bool needsContext(const std::string& filename);
 
 private:
+	void computePositionRange();
 	void initializeBuffers();
+	void createBuffers();
+	void uploadPositions();
+	void computeBounds();
 	bool loadModel(const std::string & filename, int meshIndex);
+	bool loadCompressed(const std::string& filename, int meshIndex);
+	bool loadAssimp(const std::string& filename, int meshIndex);
+	bool readScene(const aiScene* scene, int meshIndex);
+	static std::string getExtension(const std::string& filename);
 
 	unsigned vao;
 	unsigned vertVbo;
 	unsigned normVbo;
 	unsigned ebo;
+	PointCloud* pointCloud;
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+	bool uploaded;
+	bool quantize;
+	bool triangleList;
+	bool separateTriangles;
 	
 	std::vector<glm::vec3> vertices;
 	std::vector<glm::vec3> normals;
 	std::vector<unsigned int> indices;
+	std::vector<Primitive> primitives;
+	std::vector<Instance> instances;
+	std::vector<unsigned> buffers;
 };
@@ -0,0 +1,118 @@
+#include "NormalMatrices.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define NORMAL_MATRICES_SSE
+#endif
+
+namespace
+{
+	const glm::mat4& modelAt(const glm::mat4* models, size_t index, size_t stride)
+	{
+		return *reinterpret_cast<const glm::mat4*>(reinterpret_cast<const char*>(models) + index * stride);
+	}
+
+	glm::mat4& normalAt(glm::mat4* normals, size_t index, size_t stride)
+	{
+		return *reinterpret_cast<glm::mat4*>(reinterpret_cast<char*>(normals) + index * stride);
+	}
+
+	// The inverse transpose of a 3x3 matrix is its cofactor matrix over the determinant,
+	// and the cofactor columns are cross products of the other two columns.
+	void computeNormalMatrix(const glm::mat4& model, glm::mat4& normal)
+	{
+		const glm::vec3 c0(model[0]);
+		const glm::vec3 c1(model[1]);
+		const glm::vec3 c2(model[2]);
+		const glm::vec3 r0 = glm::cross(c1, c2);
+		const float determinant = glm::dot(c0, r0);
+		const float scale = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+		normal[0] = glm::vec4(r0 * scale, 0.0f);
+		normal[1] = glm::vec4(glm::cross(c2, c0) * scale, 0.0f);
+		normal[2] = glm::vec4(glm::cross(c0, c1) * scale, 0.0f);
+		normal[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+#ifdef NORMAL_MATRICES_SSE
+	struct Vector
+	{
+		__m128 x;
+		__m128 y;
+		__m128 z;
+	};
+
+	Vector cross(const Vector& a, const Vector& b)
+	{
+		return
+		{
+			_mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+			_mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+			_mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x))
+		};
+	}
+
+	// Column j of four matrices, transposed so each register holds one component of all four.
+	Vector loadColumn(const glm::mat4* const (&matrices)[4], int column)
+	{
+		__m128 a = _mm_loadu_ps(&(*matrices[0])[column][0]);
+		__m128 b = _mm_loadu_ps(&(*matrices[1])[column][0]);
+		__m128 c = _mm_loadu_ps(&(*matrices[2])[column][0]);
+		__m128 d = _mm_loadu_ps(&(*matrices[3])[column][0]);
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		return { a, b, c };
+	}
+
+	void storeColumn(glm::mat4* const (&matrices)[4], int column, const Vector& value, __m128 scale)
+	{
+		__m128 a = _mm_mul_ps(value.x, scale);
+		__m128 b = _mm_mul_ps(value.y, scale);
+		__m128 c = _mm_mul_ps(value.z, scale);
+		__m128 d = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		_mm_storeu_ps(&(*matrices[0])[column][0], a);
+		_mm_storeu_ps(&(*matrices[1])[column][0], b);
+		_mm_storeu_ps(&(*matrices[2])[column][0], c);
+		_mm_storeu_ps(&(*matrices[3])[column][0], d);
+	}
+#endif
+}
+
+void computeNormalMatrices(const glm::mat4* models, glm::mat4* normals, size_t count, size_t stride)
+{
+	size_t i = 0;
+
+#ifdef NORMAL_MATRICES_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		const glm::mat4* const sources[4] = { &modelAt(models, i, stride), &modelAt(models, i + 1, stride), &modelAt(models, i + 2, stride), &modelAt(models, i + 3, stride) };
+		glm::mat4* const targets[4] = { &normalAt(normals, i, stride), &normalAt(normals, i + 1, stride), &normalAt(normals, i + 2, stride), &normalAt(normals, i + 3, stride) };
+
+		const Vector c0 = loadColumn(sources, 0);
+		const Vector c1 = loadColumn(sources, 1);
+		const Vector c2 = loadColumn(sources, 2);
+		const Vector r0 = cross(c1, c2);
+		const Vector r1 = cross(c2, c0);
+		const Vector r2 = cross(c0, c1);
+
+		// Singular matrices get a zero normal matrix, as in the scalar path.
+		const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0.x, r0.x), _mm_mul_ps(c0.y, r0.y)), _mm_mul_ps(c0.z, r0.z));
+		const __m128 scale = _mm_and_ps(_mm_div_ps(one, determinant), _mm_cmpneq_ps(determinant, zero));
+
+		storeColumn(targets, 0, r0, scale);
+		storeColumn(targets, 1, r1, scale);
+		storeColumn(targets, 2, r2, scale);
+		for (glm::mat4* target : targets)
+		{
+			(*target)[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		computeNormalMatrix(modelAt(models, i, stride), normalAt(normals, i, stride));
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Writes the inverse transpose of the upper 3x3 of each model matrix, widened to a mat4
+// as the Object block stores it. Both arrays advance by stride bytes per element so
+// they can point into interleaved per-object records. Four matrices are solved at once
+// with SSE where available.
+void computeNormalMatrices(const glm::mat4* models, glm::mat4* normals, size_t count, size_t stride);
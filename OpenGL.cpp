@@ -2,12 +2,15 @@
 #include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 #include "OpenGL.h"
+#include "GLState.h"
 
 OpenGL::OpenGL(HWND parent) :
 	wglChoosePixelFormatARB(nullptr),
 	wglCreateContextAttribsARB(nullptr),
 	wglSwapIntervalEXT(nullptr),
 	projectionMatrix{},
+	depth(0.0f),
+	nearPlane(0.0f),
 	deviceContext(nullptr),
 	renderingContext(nullptr)
 {
@@ -147,17 +150,23 @@ bool OpenGL::initializeOpenGl(HWND hwnd, int screenWidth, int screenHeight, floa
 		return false;
 	}
 
-	// Set the 4.0 version of OpenGL in the attribute list.
+	// Ask for OpenGL 4.5 so batched drawing is available; 4.0 remains the minimum.
 	attributeList[0] = WGL_CONTEXT_MAJOR_VERSION_ARB;
 	attributeList[1] = 4;
 	attributeList[2] = WGL_CONTEXT_MINOR_VERSION_ARB;
-	attributeList[3] = 0;
+	attributeList[3] = 5;
 
 	// Null terminate the attribute list.
 	attributeList[4] = 0;
 
-	// Create a OpenGL 4.0 rendering context.
+	// Create a OpenGL 4.5 rendering context, or a 4.0 one on older drivers.
 	renderingContext = wglCreateContextAttribsARB(deviceContext, nullptr, attributeList);
+	if (renderingContext == nullptr)
+	{
+		attributeList[3] = 0;
+		renderingContext = wglCreateContextAttribsARB(deviceContext, nullptr, attributeList);
+	}
+
 	if (renderingContext == nullptr)
 	{
 		return false;
@@ -178,13 +187,15 @@ bool OpenGL::initializeOpenGl(HWND hwnd, int screenWidth, int screenHeight, floa
 	glClearDepth(1.0f);
 
 	// Enable depth testing.
-	glEnable(GL_DEPTH_TEST);
+	GLState::instance().setEnabled(GL_DEPTH_TEST, true);
 
 	// Set the field of view and screen aspect ratio.
 	const float fieldOfView = static_cast<float>(M_PI) / 4.0f;
 	const float screenAspect = static_cast<float>(screenWidth) / static_cast<float>(screenHeight);
 
 	// Build the perspective projection matrix.
+	depth = screenDepth;
+	nearPlane = screenNear;
 	projectionMatrix = glm::perspective(fieldOfView, screenAspect, screenNear, screenDepth);
 
 	// Get the name of the video card.
@@ -213,10 +224,32 @@ bool OpenGL::initializeOpenGl(HWND hwnd, int screenWidth, int screenHeight, floa
 	return true;
 }
 
+// Binds the context to the calling thread, or releases it so another thread can take it.
+bool OpenGL::makeCurrent(bool current)
+{
+	return wglMakeCurrent(current ? deviceContext : nullptr, current ? renderingContext : nullptr) == TRUE;
+}
+
+// Called on the thread that owns the context with the new client area of the window.
+void OpenGL::resize(int screenWidth, int screenHeight)
+{
+	if (screenWidth <= 0 || screenHeight <= 0)
+	{
+		return;
+	}
+
+	glViewport(0, 0, screenWidth, screenHeight);
+
+	// Set the field of view and screen aspect ratio.
+	const float fieldOfView = static_cast<float>(M_PI) / 4.0f;
+	const float screenAspect = static_cast<float>(screenWidth) / static_cast<float>(screenHeight);
+	projectionMatrix = glm::perspective(fieldOfView, screenAspect, nearPlane, depth);
+}
+
 void OpenGL::beginScene()
 {
 	// Set the color to clear the screen to.
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	GLState::instance().setClearColour({ 0.0f, 0.0f, 0.0f, 1.0f });
 
 	// Clear the screen and depth buffer.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1,23 +1,23 @@
 #pragma once
 
 #include <windows.h>
-#include "glad/glad.h"
+#include "RenderContext.h"
 #include "WGL/wgl.h"
-#include <glm/glm.hpp>
-#include <string>
 
-class OpenGL
+class OpenGL : public RenderContext
 {
 public:
 	OpenGL(HWND parent);
 	~OpenGL();
 	bool initializeExtensions(HWND hwnd);
 	bool initializeOpenGl(HWND hwnd, int screenWidth, int screenHeight, float screenDepth, float screenNear, bool vsync);
-	static void beginScene();
-	void endScene() const;
-	glm::mat4 getModelMatrix();
-	glm::mat4 getProjectionMatrix();
-	std::string getVideoCardInfo() const;
+	bool makeCurrent(bool current);
+	void resize(int screenWidth, int screenHeight);
+	void beginScene() override;
+	void endScene() const override;
+	glm::mat4 getModelMatrix() override;
+	glm::mat4 getProjectionMatrix() override;
+	std::string getVideoCardInfo() const override;
 
 private:
 	bool loadExtensionList();
@@ -30,5 +30,7 @@ private:
 	PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT;
 	glm::mat4 modelMatrix;
 	glm::mat4 projectionMatrix;
+	float depth;
+	float nearPlane;
 	std::string videoCardDescription;
 };
@@ -1,6 +1,11 @@
 #include "framework.h"
 #include "OpenGLWin32.h"
 #include "Application.h"
+#include "atlstr.h"
+#include <shellapi.h>
+#include <algorithm>
+#include <string>
+#include <vector>
 
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
@@ -12,7 +17,41 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     UNREFERENCED_PARAMETER(lpCmdLine);
 	UNREFERENCED_PARAMETER(nCmdShow);
 
+	std::vector<std::string> arguments;
+	int argumentCount = 0;
+	LPWSTR* argumentList = CommandLineToArgvW(GetCommandLineW(), &argumentCount);
+	if (argumentList)
+	{
+		for (int i = 1; i < argumentCount; ++i)
+		{
+			arguments.push_back(std::string(CW2A(argumentList[i])));
+		}
+		LocalFree(argumentList);
+	}
+
+	// OpenGLWin32.exe --benchmark [options] model... measures instead of opening the viewer.
+	if (!arguments.empty() && arguments[0] == "--benchmark")
+	{
+		Benchmark::Settings settings;
+		std::string error;
+		if (!Benchmark::parseArguments(std::vector<std::string>(arguments.begin() + 1, arguments.end()), settings, error))
+		{
+			MessageBoxA(nullptr, error.c_str(), "Benchmark", MB_OK);
+			return 2;
+		}
+
+		Application* app = new Application(true);
+		const bool succeeded = app->benchmark(settings);
+		delete app;
+
+		return succeeded ? 0 : 1;
+	}
+
+	// --continuous draws every frame instead of only when something changed, and
+	// --quantize loads meshes with 16-bit positions.
 	Application* app = new Application;	
+	app->setContinuous(std::find(arguments.begin(), arguments.end(), "--continuous") != arguments.end());
+	app->setQuantizedPositions(std::find(arguments.begin(), arguments.end(), "--quantize") != arguments.end());
 	app->run();
 	delete app;
 
@@ -0,0 +1,822 @@
+#include "PlyLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+	const size_t vertexGrain = 1 << 16;
+	const size_t faceGrain = 1 << 15;
+
+	template <typename T>
+	T readValue(const char* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+}
+
+PlyLoader::PlyLoader() :
+	headerSize(0)
+{
+}
+
+bool PlyLoader::load(const std::string& filename, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	MappedFile file(filename);
+	if (!file.isOpen())
+	{
+		error = "Cannot open PLY file!";
+		return false;
+	}
+
+	if (!parseHeader(file.data(), file.size()))
+	{
+		return false;
+	}
+
+	const char* body = file.data() + headerSize;
+	const char* end = file.data() + file.size();
+	size_t vertexCount = 0;
+	bool hasVertices = false;
+
+	for (const Element& element : elements)
+	{
+		if (element.name == "vertex")
+		{
+			VertexLayout layout;
+			if (!getVertexLayout(element, layout))
+			{
+				return false;
+			}
+
+			if (element.count > static_cast<size_t>(end - body) / layout.stride)
+			{
+				error = "PLY vertex data is truncated!";
+				return false;
+			}
+
+			resizeVertices(element.count, layout, vertices, normals);
+			convertVertices(body, 0, element.count, layout, vertices, normals);
+
+			body += element.count * layout.stride;
+			vertexCount = element.count;
+			hasVertices = true;
+		}
+		else if (element.name == "face")
+		{
+			if (!hasVertices)
+			{
+				error = "PLY faces precede the vertex element!";
+				return false;
+			}
+
+			FaceLayout layout;
+			if (!getFaceLayout(element, layout))
+			{
+				return false;
+			}
+
+			body = convertFaces(body, end, element.count, vertexCount, layout, indices);
+		}
+		else
+		{
+			body = skipElement(body, end, element, element.count);
+			if (!body)
+			{
+				error = "PLY " + element.name + " data is truncated!";
+			}
+		}
+
+		if (!body)
+		{
+			return false;
+		}
+	}
+
+	if (!hasVertices)
+	{
+		error = "PLY file has no vertex element!";
+		return false;
+	}
+
+	return true;
+}
+
+bool PlyLoader::load(GzipStream& stream, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	// The header is limited to the first megabyte, as it is for mapped files.
+	stream.fill(1 << 20);
+	if (!parseHeader(stream.data(), stream.available()))
+	{
+		return false;
+	}
+	stream.consume(headerSize);
+
+	size_t vertexCount = 0;
+	bool hasVertices = false;
+
+	// Each element is converted in whatever whole records have been decompressed so far.
+	for (const Element& element : elements)
+	{
+		if (element.name == "vertex")
+		{
+			VertexLayout layout;
+			if (!getVertexLayout(element, layout))
+			{
+				return false;
+			}
+
+			resizeVertices(element.count, layout, vertices, normals);
+			for (size_t done = 0; done < element.count;)
+			{
+				if (!stream.fill(layout.stride))
+				{
+					error = stream.hasError() ? stream.getError() : "PLY vertex data is truncated!";
+					return false;
+				}
+
+				const size_t count = std::min(element.count - done, stream.available() / layout.stride);
+				convertVertices(stream.data(), done, count, layout, vertices, normals);
+				stream.consume(count * layout.stride);
+				done += count;
+			}
+
+			vertexCount = element.count;
+			hasVertices = true;
+		}
+		else if (element.name == "face")
+		{
+			if (!hasVertices)
+			{
+				error = "PLY faces precede the vertex element!";
+				return false;
+			}
+
+			FaceLayout layout;
+			if (!getFaceLayout(element, layout))
+			{
+				return false;
+			}
+
+			const size_t triangleSize = layout.prefixSize + getTypeSize(layout.countType) + 3 * getTypeSize(layout.indexType) + layout.suffixSize;
+			for (size_t done = 0; done < element.count;)
+			{
+				const char* body = stream.data();
+				const char* end = body + stream.available();
+				size_t count = std::min(element.count - done, stream.available() / triangleSize);
+				const char* next = count > 0 ? convertTriangles(body, end, count, vertexCount, layout, indices) : nullptr;
+
+				if (!next)
+				{
+					count = countFaces(body, end, element.count - done, layout);
+					if (count == 0)
+					{
+						if (!stream.fill(stream.available() + 1))
+						{
+							error = stream.hasError() ? stream.getError() : "PLY face data is truncated!";
+							return false;
+						}
+						continue;
+					}
+
+					next = convertFaces(body, end, count, vertexCount, layout, indices);
+					if (!next)
+					{
+						return false;
+					}
+				}
+
+				stream.consume(static_cast<size_t>(next - body));
+				done += count;
+			}
+		}
+		else
+		{
+			for (size_t done = 0; done < element.count;)
+			{
+				const size_t count = element.stride > 0 ? std::min(element.count - done, stream.available() / element.stride) : 1;
+				const char* next = count > 0 ? skipElement(stream.data(), stream.data() + stream.available(), element, count) : nullptr;
+				if (next)
+				{
+					stream.consume(static_cast<size_t>(next - stream.data()));
+					done += count;
+				}
+				else if (!stream.fill(stream.available() + 1))
+				{
+					error = stream.hasError() ? stream.getError() : "PLY " + element.name + " data is truncated!";
+					return false;
+				}
+			}
+		}
+	}
+
+	if (!stream.drain())
+	{
+		error = stream.getError();
+		return false;
+	}
+
+	if (!hasVertices)
+	{
+		error = "PLY file has no vertex element!";
+		return false;
+	}
+
+	return true;
+}
+
+std::string PlyLoader::getError() const
+{
+	return error;
+}
+
+bool PlyLoader::parseHeader(const char* data, size_t size)
+{
+	if (size < 4 || std::strncmp(data, "ply", 3) != 0)
+	{
+		error = "Not a PLY file!";
+		return false;
+	}
+
+	const char marker[] = "end_header";
+	const char* last = data + std::min<size_t>(size, 1 << 20);
+	const char* found = std::search(data, last, marker, marker + sizeof(marker) - 1);
+	if (found == last)
+	{
+		error = "PLY header is not terminated!";
+		return false;
+	}
+
+	const char* bodyStart = std::find(found, last, '\n');
+	if (bodyStart == last)
+	{
+		error = "PLY header is not terminated!";
+		return false;
+	}
+	headerSize = static_cast<size_t>(bodyStart + 1 - data);
+
+	std::istringstream header(std::string(data, found));
+	std::string line;
+	bool hasFormat = false;
+	elements.clear();
+
+	while (std::getline(header, line))
+	{
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+
+		if (keyword == "format")
+		{
+			std::string format;
+			tokens >> format;
+			if (format != "binary_little_endian")
+			{
+				error = "Only binary little-endian PLY is read natively!";
+				return false;
+			}
+			hasFormat = true;
+		}
+		else if (keyword == "element")
+		{
+			Element element;
+			tokens >> element.name >> element.count;
+			if (tokens.fail())
+			{
+				error = "Malformed PLY element: " + line;
+				return false;
+			}
+			element.stride = 0;
+			elements.push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			if (elements.empty())
+			{
+				error = "PLY property outside of an element!";
+				return false;
+			}
+
+			Property property;
+			std::string type;
+			tokens >> type;
+			property.isList = type == "list";
+			property.countType = Type::Invalid;
+			if (property.isList)
+			{
+				std::string countType;
+				tokens >> countType >> type;
+				property.countType = parseType(countType);
+			}
+			tokens >> property.name;
+			property.type = parseType(type);
+			property.offset = 0;
+
+			if (tokens.fail() || property.type == Type::Invalid || (property.isList && property.countType == Type::Invalid))
+			{
+				error = "Malformed PLY property: " + line;
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+
+	if (!hasFormat)
+	{
+		error = "PLY header has no format line!";
+		return false;
+	}
+
+	// Fixed-size elements get a stride and per-property offsets; elements with lists keep a stride of zero.
+	for (Element& element : elements)
+	{
+		size_t offset = 0;
+		bool hasList = false;
+		for (Property& property : element.properties)
+		{
+			hasList = hasList || property.isList;
+			property.offset = offset;
+			offset += getTypeSize(property.type);
+		}
+		element.stride = hasList ? 0 : offset;
+	}
+
+	return true;
+}
+
+bool PlyLoader::getVertexLayout(const Element& element, VertexLayout& layout)
+{
+	if (element.stride == 0)
+	{
+		error = "PLY vertices with list properties are not supported!";
+		return false;
+	}
+
+	const char* positionNames[3] = { "x", "y", "z" };
+	const char* normalNames[3] = { "nx", "ny", "nz" };
+	for (int i = 0; i < 3; ++i)
+	{
+		layout.position[i] = nullptr;
+		layout.normal[i] = nullptr;
+		for (const Property& property : element.properties)
+		{
+			if (property.name == positionNames[i])
+			{
+				layout.position[i] = &property;
+			}
+			else if (property.name == normalNames[i])
+			{
+				layout.normal[i] = &property;
+			}
+		}
+	}
+
+	if (!layout.position[0] || !layout.position[1] || !layout.position[2])
+	{
+		error = "PLY vertices have no x, y and z properties!";
+		return false;
+	}
+
+	if (!layout.normal[0] || !layout.normal[1] || !layout.normal[2])
+	{
+		layout.normal[0] = layout.normal[1] = layout.normal[2] = nullptr;
+	}
+
+	layout.stride = element.stride;
+	return true;
+}
+
+bool PlyLoader::getFaceLayout(const Element& element, FaceLayout& layout)
+{
+	const Property* list = nullptr;
+	layout.prefixSize = 0;
+	layout.suffixSize = 0;
+
+	for (const Property& property : element.properties)
+	{
+		if (property.isList)
+		{
+			if (list || (property.name != "vertex_indices" && property.name != "vertex_index"))
+			{
+				error = "Unsupported PLY face list: " + property.name;
+				return false;
+			}
+			list = &property;
+		}
+		else if (list)
+		{
+			layout.suffixSize += getTypeSize(property.type);
+		}
+		else
+		{
+			layout.prefixSize += getTypeSize(property.type);
+		}
+	}
+
+	if (!list || list->type == Type::Float32 || list->type == Type::Float64 ||
+		list->countType == Type::Float32 || list->countType == Type::Float64)
+	{
+		error = "PLY faces have no integer vertex index list!";
+		return false;
+	}
+
+	layout.countType = list->countType;
+	layout.indexType = list->type;
+	return true;
+}
+
+void PlyLoader::resizeVertices(size_t count, const VertexLayout& layout, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals)
+{
+	vertices.resize(count);
+	if (layout.normal[0])
+	{
+		normals.resize(count);
+	}
+	else
+	{
+		normals.clear();
+	}
+}
+
+void PlyLoader::convertVertices(const char* body, size_t first, size_t count, const VertexLayout& layout, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals) const
+{
+	const auto readFloat = [](const char* p, Type type) -> float
+	{
+		switch (type)
+		{
+		case Type::Int8: return static_cast<float>(readValue<int8_t>(p));
+		case Type::UInt8: return static_cast<float>(readValue<uint8_t>(p));
+		case Type::Int16: return static_cast<float>(readValue<int16_t>(p));
+		case Type::UInt16: return static_cast<float>(readValue<uint16_t>(p));
+		case Type::Int32: return static_cast<float>(readValue<int32_t>(p));
+		case Type::UInt32: return static_cast<float>(readValue<uint32_t>(p));
+		case Type::Float32: return readValue<float>(p);
+		case Type::Float64: return static_cast<float>(readValue<double>(p));
+		default: return 0.0f;
+		}
+	};
+
+	// Most scanners write x, y, z (and nx, ny, nz) as consecutive floats, which can be copied as a whole.
+	const auto isPacked = [](const Property* const* properties)
+	{
+		return properties[0]->type == Type::Float32 && properties[1]->type == Type::Float32 && properties[2]->type == Type::Float32 &&
+			properties[1]->offset == properties[0]->offset + 4 && properties[2]->offset == properties[0]->offset + 8;
+	};
+
+	const bool hasNormals = layout.normal[0] != nullptr;
+	const bool packedPositions = isPacked(layout.position);
+	const bool packedNormals = hasNormals && isPacked(layout.normal);
+
+	ThreadPool::instance().parallelFor(count, vertexGrain, [&](size_t begin, size_t end)
+	{
+		const char* record = body + begin * layout.stride;
+		for (size_t i = first + begin; i < first + end; ++i, record += layout.stride)
+		{
+			if (packedPositions)
+			{
+				std::memcpy(&vertices[i], record + layout.position[0]->offset, sizeof(glm::vec3));
+			}
+			else
+			{
+				vertices[i].x = readFloat(record + layout.position[0]->offset, layout.position[0]->type);
+				vertices[i].y = readFloat(record + layout.position[1]->offset, layout.position[1]->type);
+				vertices[i].z = readFloat(record + layout.position[2]->offset, layout.position[2]->type);
+			}
+
+			if (packedNormals)
+			{
+				std::memcpy(&normals[i], record + layout.normal[0]->offset, sizeof(glm::vec3));
+			}
+			else if (hasNormals)
+			{
+				normals[i].x = readFloat(record + layout.normal[0]->offset, layout.normal[0]->type);
+				normals[i].y = readFloat(record + layout.normal[1]->offset, layout.normal[1]->type);
+				normals[i].z = readFloat(record + layout.normal[2]->offset, layout.normal[2]->type);
+			}
+		}
+	});
+}
+
+const char* PlyLoader::convertFaces(const char* body, const char* end, size_t count, size_t vertexCount, const FaceLayout& layout, std::vector<unsigned int>& indices)
+{
+	// Scans almost always contain only triangles, which gives every face record the same size.
+	const char* next = convertTriangles(body, end, count, vertexCount, layout, indices);
+	if (next)
+	{
+		return next;
+	}
+
+	const size_t countSize = getTypeSize(layout.countType);
+	const size_t indexSize = getTypeSize(layout.indexType);
+	const size_t threads = ThreadPool::instance().getThreadCount();
+	const size_t chunkSize = std::max<size_t>(count / (threads * 8) + 1, faceGrain);
+	const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	const auto readCount = [&layout](const char* p) -> int64_t
+	{
+		switch (layout.countType)
+		{
+		case Type::Int8: return readValue<int8_t>(p);
+		case Type::UInt8: return readValue<uint8_t>(p);
+		case Type::Int16: return readValue<int16_t>(p);
+		case Type::UInt16: return readValue<uint16_t>(p);
+		case Type::Int32: return readValue<int32_t>(p);
+		case Type::UInt32: return readValue<uint32_t>(p);
+		default: return -1;
+		}
+	};
+
+	// Face records have variable size, so a sequential pass finds where each chunk starts
+	// and how many indices it produces before the chunks are triangulated in parallel.
+	std::vector<const char*> chunkStart(chunkCount);
+	std::vector<size_t> chunkFirstIndex(chunkCount + 1);
+	const char* record = body;
+	size_t total = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (i % chunkSize == 0)
+		{
+			chunkStart[i / chunkSize] = record;
+			chunkFirstIndex[i / chunkSize] = total;
+		}
+
+		if (static_cast<size_t>(end - record) < layout.prefixSize + countSize)
+		{
+			error = "PLY face data is truncated!";
+			return nullptr;
+		}
+
+		const int64_t corners = readCount(record + layout.prefixSize);
+		if (corners < 0)
+		{
+			error = "PLY face has a negative vertex count!";
+			return nullptr;
+		}
+
+		const size_t recordSize = layout.prefixSize + countSize + static_cast<size_t>(corners) * indexSize + layout.suffixSize;
+		if (static_cast<size_t>(end - record) < recordSize)
+		{
+			error = "PLY face data is truncated!";
+			return nullptr;
+		}
+
+		if (corners >= 3)
+		{
+			total += static_cast<size_t>(corners - 2) * 3;
+		}
+		record += recordSize;
+	}
+	chunkFirstIndex[chunkCount] = total;
+
+	const size_t base = indices.size();
+	indices.resize(base + total);
+	std::atomic<bool> isValid(true);
+
+	ThreadPool::instance().parallelFor(chunkCount, 1, [&](size_t begin, size_t chunkEnd)
+	{
+		for (size_t chunk = begin; chunk < chunkEnd; ++chunk)
+		{
+			const char* p = chunkStart[chunk];
+			unsigned int* out = indices.data() + base + chunkFirstIndex[chunk];
+			const size_t last = std::min(count, (chunk + 1) * chunkSize);
+
+			for (size_t i = chunk * chunkSize; i < last; ++i)
+			{
+				const size_t corners = static_cast<size_t>(readCount(p + layout.prefixSize));
+				const char* list = p + layout.prefixSize + countSize;
+
+				const auto readIndex = [&](size_t corner) -> unsigned int
+				{
+					const char* value = list + corner * indexSize;
+					int64_t index;
+					switch (layout.indexType)
+					{
+					case Type::Int8: index = readValue<int8_t>(value); break;
+					case Type::UInt8: index = readValue<uint8_t>(value); break;
+					case Type::Int16: index = readValue<int16_t>(value); break;
+					case Type::UInt16: index = readValue<uint16_t>(value); break;
+					case Type::Int32: index = readValue<int32_t>(value); break;
+					default: index = readValue<uint32_t>(value); break;
+					}
+
+					if (index < 0 || static_cast<size_t>(index) >= vertexCount)
+					{
+						isValid = false;
+						return 0;
+					}
+					return static_cast<unsigned int>(index);
+				};
+
+				// Polygons are triangulated as fans around their first corner.
+				for (size_t corner = 2; corner < corners; ++corner)
+				{
+					*out++ = readIndex(0);
+					*out++ = readIndex(corner - 1);
+					*out++ = readIndex(corner);
+				}
+
+				p = list + corners * indexSize + layout.suffixSize;
+			}
+		}
+	});
+
+	if (!isValid)
+	{
+		error = "PLY face references a vertex out of range!";
+		return nullptr;
+	}
+
+	return record;
+}
+
+const char* PlyLoader::convertTriangles(const char* body, const char* end, size_t count, size_t vertexCount, const FaceLayout& layout, std::vector<unsigned int>& indices)
+{
+	const size_t countSize = getTypeSize(layout.countType);
+	const size_t indexSize = getTypeSize(layout.indexType);
+	const size_t recordSize = layout.prefixSize + countSize + 3 * indexSize + layout.suffixSize;
+
+	if (count > static_cast<size_t>(end - body) / recordSize)
+	{
+		return nullptr;
+	}
+
+	// Every record is checked at its fixed-stride position. The first non-triangle record
+	// is always at its true position, so any mixed file fails here and takes the scanning path.
+	const size_t base = indices.size();
+	indices.resize(base + count * 3);
+	std::atomic<bool> isTriangleList(true);
+
+	ThreadPool::instance().parallelFor(count, faceGrain, [&](size_t begin, size_t last)
+	{
+		const char* record = body + begin * recordSize;
+		unsigned int* out = indices.data() + base + begin * 3;
+
+		for (size_t i = begin; i < last && isTriangleList; ++i, record += recordSize)
+		{
+			const char* countValue = record + layout.prefixSize;
+			uint32_t corners;
+			switch (layout.countType)
+			{
+			case Type::Int8: case Type::UInt8: corners = readValue<uint8_t>(countValue); break;
+			case Type::Int16: case Type::UInt16: corners = readValue<uint16_t>(countValue); break;
+			default: corners = readValue<uint32_t>(countValue); break;
+			}
+
+			if (corners != 3)
+			{
+				isTriangleList = false;
+				return;
+			}
+
+			const char* list = countValue + countSize;
+			for (size_t corner = 0; corner < 3; ++corner)
+			{
+				const char* value = list + corner * indexSize;
+				int64_t index;
+				switch (layout.indexType)
+				{
+				case Type::Int8: index = readValue<int8_t>(value); break;
+				case Type::UInt8: index = readValue<uint8_t>(value); break;
+				case Type::Int16: index = readValue<int16_t>(value); break;
+				case Type::UInt16: index = readValue<uint16_t>(value); break;
+				case Type::Int32: index = readValue<int32_t>(value); break;
+				default: index = readValue<uint32_t>(value); break;
+				}
+
+				if (index < 0 || static_cast<size_t>(index) >= vertexCount)
+				{
+					isTriangleList = false;
+					return;
+				}
+				*out++ = static_cast<unsigned int>(index);
+			}
+		}
+	});
+
+	if (!isTriangleList)
+	{
+		indices.resize(base);
+		return nullptr;
+	}
+
+	return body + count * recordSize;
+}
+
+size_t PlyLoader::countFaces(const char* body, const char* end, size_t count, const FaceLayout& layout) const
+{
+	const size_t countSize = getTypeSize(layout.countType);
+	const size_t indexSize = getTypeSize(layout.indexType);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (static_cast<size_t>(end - body) < layout.prefixSize + countSize)
+		{
+			return i;
+		}
+
+		const char* countValue = body + layout.prefixSize;
+		size_t corners;
+		switch (layout.countType)
+		{
+		case Type::Int8: case Type::UInt8: corners = readValue<uint8_t>(countValue); break;
+		case Type::Int16: case Type::UInt16: corners = readValue<uint16_t>(countValue); break;
+		default: corners = readValue<uint32_t>(countValue); break;
+		}
+
+		const size_t recordSize = layout.prefixSize + countSize + corners * indexSize + layout.suffixSize;
+		if (static_cast<size_t>(end - body) < recordSize)
+		{
+			return i;
+		}
+		body += recordSize;
+	}
+
+	return count;
+}
+
+const char* PlyLoader::skipElement(const char* body, const char* end, const Element& element, size_t count) const
+{
+	if (element.stride > 0)
+	{
+		if (count > static_cast<size_t>(end - body) / element.stride)
+		{
+			return nullptr;
+		}
+		return body + count * element.stride;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (const Property& property : element.properties)
+		{
+			size_t size = getTypeSize(property.type);
+			if (property.isList)
+			{
+				const size_t countSize = getTypeSize(property.countType);
+				if (static_cast<size_t>(end - body) < countSize)
+				{
+					return nullptr;
+				}
+
+				uint32_t count;
+				switch (countSize)
+				{
+				case 1: count = readValue<uint8_t>(body); break;
+				case 2: count = readValue<uint16_t>(body); break;
+				default: count = readValue<uint32_t>(body); break;
+				}
+				body += countSize;
+				size *= count;
+			}
+
+			if (static_cast<size_t>(end - body) < size)
+			{
+				return nullptr;
+			}
+			body += size;
+		}
+	}
+
+	return body;
+}
+
+PlyLoader::Type PlyLoader::parseType(const std::string& name)
+{
+	if (name == "char" || name == "int8") return Type::Int8;
+	if (name == "uchar" || name == "uint8") return Type::UInt8;
+	if (name == "short" || name == "int16") return Type::Int16;
+	if (name == "ushort" || name == "uint16") return Type::UInt16;
+	if (name == "int" || name == "int32") return Type::Int32;
+	if (name == "uint" || name == "uint32") return Type::UInt32;
+	if (name == "float" || name == "float32") return Type::Float32;
+	if (name == "double" || name == "float64") return Type::Float64;
+	return Type::Invalid;
+}
+
+size_t PlyLoader::getTypeSize(Type type)
+{
+	switch (type)
+	{
+	case Type::Int8:
+	case Type::UInt8:
+		return 1;
+	case Type::Int16:
+	case Type::UInt16:
+		return 2;
+	case Type::Int32:
+	case Type::UInt32:
+	case Type::Float32:
+		return 4;
+	case Type::Float64:
+		return 8;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "GzipStream.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Native reader for binary little-endian PLY. The body is memory mapped and
+// converted straight into the arrays Model uploads, split across the thread pool.
+// Compressed files are converted block by block as they are decompressed.
+class PlyLoader
+{
+public:
+	PlyLoader();
+	~PlyLoader() = default;
+	bool load(const std::string& filename, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+	bool load(GzipStream& stream, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+	std::string getError() const;
+
+private:
+	enum class Type { Invalid, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+	struct Property
+	{
+		std::string name;
+		Type type;
+		Type countType;
+		bool isList;
+		size_t offset;
+	};
+
+	struct Element
+	{
+		std::string name;
+		size_t count;
+		std::vector<Property> properties;
+		size_t stride;
+	};
+
+	struct VertexLayout
+	{
+		const Property* position[3];
+		const Property* normal[3];
+		size_t stride;
+	};
+
+	struct FaceLayout
+	{
+		Type countType;
+		Type indexType;
+		size_t prefixSize;
+		size_t suffixSize;
+	};
+
+	bool parseHeader(const char* data, size_t size);
+	bool getVertexLayout(const Element& element, VertexLayout& layout);
+	bool getFaceLayout(const Element& element, FaceLayout& layout);
+	static void resizeVertices(size_t count, const VertexLayout& layout, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals);
+	void convertVertices(const char* body, size_t first, size_t count, const VertexLayout& layout, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals) const;
+	const char* convertFaces(const char* body, const char* end, size_t count, size_t vertexCount, const FaceLayout& layout, std::vector<unsigned int>& indices);
+	const char* convertTriangles(const char* body, const char* end, size_t count, size_t vertexCount, const FaceLayout& layout, std::vector<unsigned int>& indices);
+	size_t countFaces(const char* body, const char* end, size_t count, const FaceLayout& layout) const;
+	const char* skipElement(const char* body, const char* end, const Element& element, size_t count) const;
+	static Type parseType(const std::string& name);
+	static size_t getTypeSize(Type type);
+
+	std::vector<Element> elements;
+	size_t headerSize;
+	std::string error;
+};
@@ -0,0 +1,272 @@
+#include "PointCloud.h"
+#include "GLState.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+
+namespace
+{
+	const size_t pointGrain = 1 << 16;
+
+	// Spreads the low 21 bits of value so that two zero bits follow each one.
+	uint64_t spreadBits(uint64_t value)
+	{
+		value &= 0x1FFFFF;
+		value = (value | (value << 32)) & 0x1F00000000FFFF;
+		value = (value | (value << 16)) & 0x1F0000FF0000FF;
+		value = (value | (value << 8)) & 0x100F00F00F00F00F;
+		value = (value | (value << 4)) & 0x10C30C30C30C30C3;
+		value = (value | (value << 2)) & 0x1249249249249249;
+		return value;
+	}
+
+	size_t greatestCommonDivisor(size_t a, size_t b)
+	{
+		while (b != 0)
+		{
+			const size_t remainder = a % b;
+			a = b;
+			b = remainder;
+		}
+		return a;
+	}
+
+	int highestBit(uint64_t value)
+	{
+		int bit = -1;
+		while (value)
+		{
+			value >>= 1;
+			++bit;
+		}
+		return bit;
+	}
+}
+
+PointCloud::PointCloud(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals) :
+	vao(0),
+	vbo(0),
+	pointCount(vertices.size())
+{
+	const std::vector<unsigned int> order = buildOrder(vertices);
+	const bool hasNormals = normals.size() == vertices.size();
+	const size_t floatsPerPoint = hasNormals ? 6 : 3;
+
+	std::vector<float> buffer(pointCount * floatsPerPoint);
+	ThreadPool::instance().parallelFor(pointCount, pointGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			float* out = buffer.data() + i * floatsPerPoint;
+			const glm::vec3& position = vertices[order[i]];
+			out[0] = position.x;
+			out[1] = position.y;
+			out[2] = position.z;
+
+			if (hasNormals)
+			{
+				const glm::vec3& normal = normals[order[i]];
+				out[3] = normal.x;
+				out[4] = normal.y;
+				out[5] = normal.z;
+			}
+		}
+	});
+
+	const GLsizei stride = static_cast<GLsizei>(floatsPerPoint * sizeof(float));
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(float), buffer.data(), GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+
+	if (hasNormals)
+	{
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(3 * sizeof(float)));
+	}
+	else
+	{
+		glVertexAttrib3f(1, 0.0f, 0.0f, -1.0f);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+PointCloud::~PointCloud()
+{
+	GLState::instance().deleteVertexArrays(1, &vao);
+	GLState::instance().deleteBuffers(1, &vbo);
+}
+
+void PointCloud::render(size_t budget) const
+{
+	const size_t count = std::min(budget, pointCount);
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Sparser subsets are drawn with larger points to keep surfaces closed.
+	const float density = static_cast<float>(pointCount) / static_cast<float>(count);
+	GLState& state = GLState::instance();
+	state.setPointSize(std::min(4.0f, std::sqrt(density)));
+	state.bindVertexArray(vao);
+	glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+	state.setPointSize(1.0f);
+}
+
+size_t PointCloud::getPointCount() const
+{
+	return pointCount;
+}
+
+std::vector<unsigned int> PointCloud::buildOrder(const std::vector<glm::vec3>& vertices)
+{
+	const size_t count = vertices.size();
+	ThreadPool& pool = ThreadPool::instance();
+	const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(pool.getThreadCount(), count / pointGrain));
+
+	// Bounds are reduced per chunk, then combined.
+	std::vector<glm::vec3> lower(chunkCount, glm::vec3(INFINITY));
+	std::vector<glm::vec3> upper(chunkCount, glm::vec3(-INFINITY));
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			for (size_t i = chunk * count / chunkCount; i < (chunk + 1) * count / chunkCount; ++i)
+			{
+				lower[chunk] = glm::min(lower[chunk], vertices[i]);
+				upper[chunk] = glm::max(upper[chunk], vertices[i]);
+			}
+		}
+	});
+
+	glm::vec3 minimum = lower[0];
+	glm::vec3 maximum = upper[0];
+	for (size_t chunk = 1; chunk < chunkCount; ++chunk)
+	{
+		minimum = glm::min(minimum, lower[chunk]);
+		maximum = glm::max(maximum, upper[chunk]);
+	}
+
+	// A cubic grid keeps octree cells cubic however the bounds are shaped.
+	const glm::vec3 extent = maximum - minimum;
+	const float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-20f));
+	const float scale = static_cast<float>((1 << maxLevel) - 1) / size;
+
+	std::vector<std::pair<uint64_t, unsigned int>> sorted(count);
+	pool.parallelFor(count, pointGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const glm::vec3 cell = (vertices[i] - minimum) * scale;
+			const uint64_t code = spreadBits(static_cast<uint64_t>(cell.x)) |
+				(spreadBits(static_cast<uint64_t>(cell.y)) << 1) |
+				(spreadBits(static_cast<uint64_t>(cell.z)) << 2);
+			sorted[i] = std::make_pair(code, static_cast<unsigned int>(i));
+		}
+	});
+
+	// Morton order: chunks are sorted in parallel, then merged pairwise.
+	std::vector<size_t> bounds(chunkCount + 1);
+	for (size_t chunk = 0; chunk <= chunkCount; ++chunk)
+	{
+		bounds[chunk] = chunk * count / chunkCount;
+	}
+
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			std::sort(sorted.begin() + bounds[chunk], sorted.begin() + bounds[chunk + 1]);
+		}
+	});
+
+	for (size_t width = 1; width < chunkCount; width *= 2)
+	{
+		const size_t merges = (chunkCount + 2 * width - 1) / (2 * width);
+		pool.parallelFor(merges, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t merge = begin; merge < end; ++merge)
+			{
+				const size_t first = merge * 2 * width;
+				const size_t middle = std::min(first + width, chunkCount);
+				const size_t last = std::min(first + 2 * width, chunkCount);
+				std::inplace_merge(sorted.begin() + bounds[first], sorted.begin() + bounds[middle], sorted.begin() + bounds[last]);
+			}
+		});
+	}
+
+	// A point belongs to the coarsest level whose cell it is the first to enter. Sorted
+	// neighbours share a cell at level L exactly when their codes agree above bit 3 * (maxLevel - L).
+	std::vector<unsigned char> levels(count);
+	pool.parallelFor(count, pointGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (i == 0)
+			{
+				levels[i] = 0;
+				continue;
+			}
+
+			// Duplicate points never enter a new cell and go last.
+			const uint64_t difference = sorted[i].first ^ sorted[i - 1].first;
+			levels[i] = static_cast<unsigned char>(difference == 0 ? maxLevel + 1 : maxLevel - highestBit(difference) / 3);
+		}
+	});
+
+	std::vector<size_t> levelStart(maxLevel + 3, 0);
+	for (unsigned char level : levels)
+	{
+		++levelStart[level + 1];
+	}
+	std::partial_sum(levelStart.begin(), levelStart.end(), levelStart.begin());
+
+	std::vector<unsigned int> byLevel(count);
+	std::vector<size_t> cursor(levelStart.begin(), levelStart.end() - 1);
+	for (size_t i = 0; i < count; ++i)
+	{
+		byLevel[cursor[levels[i]]++] = sorted[i].second;
+	}
+
+	// A budget usually ends partway through a level. Stepping through the level with a
+	// stride coprime to its size spreads that partial level over the whole cloud instead
+	// of filling one region first.
+	std::vector<unsigned int> order(count);
+	for (int level = 0; level <= maxLevel + 1; ++level)
+	{
+		const size_t first = levelStart[level];
+		const size_t size = levelStart[level + 1] - first;
+		if (size == 0)
+		{
+			continue;
+		}
+
+		size_t stride = static_cast<size_t>(static_cast<double>(size) * 0.6180339887) | 1;
+		while (greatestCommonDivisor(stride, size) != 1)
+		{
+			stride += 2;
+		}
+
+		pool.parallelFor(size, pointGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t j = begin; j < end; ++j)
+			{
+				order[first + j] = byLevel[first + (j * stride) % size];
+			}
+		});
+	}
+
+	return order;
+}
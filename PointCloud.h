@@ -0,0 +1,28 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// GPU point buffer in nested octree order: the points that first occupy each cell of a
+// 2^L grid come before every point of level L + 1, so any prefix of the buffer is an
+// evenly spread subsample and a frame simply draws as many points as its budget allows.
+class PointCloud
+{
+public:
+	PointCloud(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals);
+	~PointCloud();
+	PointCloud(const PointCloud&) = delete;
+	PointCloud& operator=(const PointCloud&) = delete;
+	void render(size_t budget) const;
+	size_t getPointCount() const;
+
+private:
+	static const int maxLevel = 21;
+
+	static std::vector<unsigned int> buildOrder(const std::vector<glm::vec3>& vertices);
+
+	unsigned vao;
+	unsigned vbo;
+	size_t pointCount;
+};
@@ -0,0 +1,308 @@
+#include "Profiler.h"
+#include "RenderContext.h"
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+// ARB_pipeline_statistics_query; the loader header predates the extension.
+#ifndef GL_VERTICES_SUBMITTED_ARB
+#define GL_VERTICES_SUBMITTED_ARB 0x82EE
+#define GL_PRIMITIVES_SUBMITTED_ARB 0x82EF
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+namespace
+{
+	const unsigned statisticTargets[] = { GL_VERTICES_SUBMITTED_ARB, GL_PRIMITIVES_SUBMITTED_ARB, GL_FRAGMENT_SHADER_INVOCATIONS_ARB };
+	const char* const statisticNames[] = { "gpu/vertices", "gpu/primitives", "gpu/fragments" };
+
+	double elapsedMilliseconds(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Nearest-rank percentile of sorted samples.
+	double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		const size_t rank = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[std::min(rank, sorted.size() - 1)];
+	}
+}
+
+Profiler::Zone::Zone(const char* name, bool gpu) :
+	name(name),
+	start(std::chrono::high_resolution_clock::now()),
+	timed(gpu && Profiler::instance().beginTimer(name))
+{
+}
+
+Profiler::Zone::~Zone()
+{
+	Profiler& profiler = Profiler::instance();
+	if (timed)
+	{
+		profiler.endTimer();
+	}
+	profiler.record(std::string("cpu/") + name, elapsedMilliseconds(start));
+}
+
+Profiler::Profiler() :
+	frames{},
+	frameIndex(0),
+	inFrame(false),
+	timerActive(false),
+	queriesSupported(false),
+	statisticsSupported(false),
+	checked(false)
+{
+}
+
+Profiler& Profiler::instance()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+// Called with the context current. Results of the frame that last used this slot of
+// the ring are taken if they are ready; otherwise they are dropped rather than waited for.
+void Profiler::beginFrame()
+{
+	if (inFrame)
+	{
+		endFrame();
+	}
+
+	if (!checked)
+	{
+		queriesSupported = glGenQueries && glBeginQuery && glGetQueryObjectui64v;
+		statisticsSupported = queriesSupported && RenderContext::hasExtension("GL_ARB_pipeline_statistics_query");
+		checked = true;
+	}
+
+	FrameQueries& frame = frames[frameIndex % frameLatency];
+	collect(frame);
+	frame.used = 0;
+	frame.names.clear();
+	frame.statisticsIssued = false;
+
+	if (statisticsSupported)
+	{
+		if (frame.statistics[0] == 0)
+		{
+			glGenQueries(statisticCount, frame.statistics);
+		}
+
+		for (int i = 0; i < statisticCount; ++i)
+		{
+			glBeginQuery(statisticTargets[i], frame.statistics[i]);
+		}
+		frame.statisticsIssued = true;
+	}
+
+	frameStart = std::chrono::high_resolution_clock::now();
+	inFrame = true;
+}
+
+void Profiler::endFrame()
+{
+	if (!inFrame)
+	{
+		return;
+	}
+
+	FrameQueries& frame = frames[frameIndex % frameLatency];
+	if (frame.statisticsIssued)
+	{
+		for (int i = 0; i < statisticCount; ++i)
+		{
+			glEndQuery(statisticTargets[i]);
+		}
+	}
+
+	frame.pending = frame.statisticsIssued || frame.used > 0;
+	record("cpu/frame", elapsedMilliseconds(frameStart));
+	++frameIndex;
+	inFrame = false;
+}
+
+// GPU zones only exist inside a frame, and only one at a time.
+bool Profiler::beginTimer(const char* name)
+{
+	if (!inFrame || timerActive || !queriesSupported)
+	{
+		return false;
+	}
+
+	FrameQueries& frame = frames[frameIndex % frameLatency];
+	if (frame.used == frame.timers.size())
+	{
+		unsigned query = 0;
+		glGenQueries(1, &query);
+		frame.timers.push_back(query);
+	}
+
+	frame.names.push_back(name);
+	glBeginQuery(GL_TIME_ELAPSED, frame.timers[frame.used++]);
+	timerActive = true;
+	return true;
+}
+
+void Profiler::endTimer()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	timerActive = false;
+}
+
+void Profiler::collect(FrameQueries& frame)
+{
+	if (!frame.pending)
+	{
+		return;
+	}
+	frame.pending = false;
+
+	// Queries complete in order, so the last one issued decides for the whole frame.
+	const unsigned last = frame.statisticsIssued ? frame.statistics[statisticCount - 1] : frame.timers[frame.used - 1];
+	unsigned available = 0;
+	glGetQueryObjectuiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < frame.used; ++i)
+	{
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(frame.timers[i], GL_QUERY_RESULT, &nanoseconds);
+		record("gpu/" + frame.names[i], nanoseconds * 1e-6);
+	}
+
+	if (frame.statisticsIssued)
+	{
+		for (int i = 0; i < statisticCount; ++i)
+		{
+			GLuint64 count = 0;
+			glGetQueryObjectui64v(frame.statistics[i], GL_QUERY_RESULT, &count);
+			record(statisticNames[i], static_cast<double>(count));
+		}
+	}
+}
+
+// Thread safe, so zones may also be opened on worker threads.
+void Profiler::record(const std::string& series, double value)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	History& history = histories[series];
+	if (history.samples.size() < historySize)
+	{
+		history.samples.push_back(value);
+	}
+	else
+	{
+		history.samples[history.next] = value;
+	}
+	history.next = (history.next + 1) % historySize;
+}
+
+Profiler::Summary Profiler::getSummary(const std::string& series) const
+{
+	std::vector<double> samples;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto found = histories.find(series);
+		if (found == histories.end())
+		{
+			return Summary{};
+		}
+		samples = found->second.samples;
+	}
+
+	return summarize(std::move(samples));
+}
+
+Profiler::Summary Profiler::summarize(std::vector<double> samples)
+{
+	if (samples.empty())
+	{
+		return Summary{};
+	}
+
+	std::sort(samples.begin(), samples.end());
+	Summary summary;
+	summary.samples = samples.size();
+	summary.mean = 0.0;
+	for (double sample : samples)
+	{
+		summary.mean += sample;
+	}
+	summary.mean /= samples.size();
+	summary.p50 = percentile(samples, 0.50);
+	summary.p95 = percentile(samples, 0.95);
+	summary.p99 = percentile(samples, 0.99);
+	summary.max = samples.back();
+	return summary;
+}
+
+std::vector<std::string> Profiler::getSeries() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::string> names;
+	for (const auto& history : histories)
+	{
+		names.push_back(history.first);
+	}
+	return names;
+}
+
+// One line per series: times are in milliseconds, pipeline statistics in counts per frame.
+bool Profiler::dump(const std::string& filename) const
+{
+	std::ofstream file(filename);
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "series,samples,mean,p50,p95,p99,max\n";
+	for (const std::string& series : getSeries())
+	{
+		const Summary summary = getSummary(series);
+		file << series << ',' << summary.samples << ',' << summary.mean << ',' << summary.p50 << ',' << summary.p95 << ',' << summary.p99 << ',' << summary.max << '\n';
+	}
+	return static_cast<bool>(file);
+}
+
+// Drops every series and the results of frames already ended, so that runs measured one
+// after another do not mix. Called on the thread of the context.
+void Profiler::clear()
+{
+	for (FrameQueries& frame : frames)
+	{
+		frame.pending = false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	histories.clear();
+}
+
+// Called before the context goes away; the next frame would create the queries again.
+void Profiler::releaseQueries()
+{
+	for (FrameQueries& frame : frames)
+	{
+		if (!frame.timers.empty())
+		{
+			glDeleteQueries(static_cast<GLsizei>(frame.timers.size()), frame.timers.data());
+		}
+
+		if (frame.statistics[0] != 0)
+		{
+			glDeleteQueries(statisticCount, frame.statistics);
+		}
+		frame = FrameQueries{};
+	}
+
+	inFrame = false;
+	timerActive = false;
+	checked = false;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Frame-time instrumentation. A zone times its scope on the CPU and, when asked, on the
+// GPU with a GL_TIME_ELAPSED query; GPU zones do not nest, so one opened inside another
+// is only timed on the CPU. Queries live in a ring a few frames deep and are only read
+// once the driver reports them available, so reading never stalls the pipeline. With
+// ARB_pipeline_statistics_query each frame also counts the vertices and primitives
+// submitted and the fragment shader invocations. Every series keeps its most recent
+// samples, from which percentiles are taken.
+class Profiler
+{
+public:
+	struct Summary
+	{
+		size_t samples;
+		double mean;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	class Zone
+	{
+	public:
+		Zone(const char* name, bool gpu = false);
+		~Zone();
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* name;
+		std::chrono::high_resolution_clock::time_point start;
+		bool timed;
+	};
+
+	static Profiler& instance();
+	void beginFrame();
+	void endFrame();
+	void record(const std::string& series, double value);
+	Summary getSummary(const std::string& series) const;
+	static Summary summarize(std::vector<double> samples);
+	std::vector<std::string> getSeries() const;
+	bool dump(const std::string& filename) const;
+	void clear();
+	void releaseQueries();
+
+private:
+	static const size_t historySize = 1024;
+	static const size_t frameLatency = 4;
+	static const int statisticCount = 3;
+
+	struct History
+	{
+		std::vector<double> samples;
+		size_t next;
+	};
+
+	// The queries issued in one frame, reused when the ring comes back to it.
+	struct FrameQueries
+	{
+		std::vector<unsigned> timers;
+		std::vector<std::string> names;
+		size_t used;
+		unsigned statistics[statisticCount];
+		bool statisticsIssued;
+		bool pending;
+	};
+
+	Profiler();
+	~Profiler() = default;
+	bool beginTimer(const char* name);
+	void endTimer();
+	void collect(FrameQueries& frame);
+
+	mutable std::mutex mutex;
+	std::map<std::string, History> histories;
+	FrameQueries frames[frameLatency];
+	size_t frameIndex;
+	bool inFrame;
+	bool timerActive;
+	bool queriesSupported;
+	bool statisticsSupported;
+	bool checked;
+	std::chrono::high_resolution_clock::time_point frameStart;
+};
@@ -0,0 +1,33 @@
+#include "RenderContext.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <EGL/egl.h>
+#endif
+
+bool RenderContext::hasExtension(const char* name)
+{
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; ++i)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<unsigned>(i)));
+		if (extension && std::strcmp(extension, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Entry points that glad does not load, such as those of newer extensions.
+void* RenderContext::getProcAddress(const char* name)
+{
+#ifdef _WIN32
+	return reinterpret_cast<void*>(wglGetProcAddress(name));
+#else
+	return reinterpret_cast<void*>(eglGetProcAddress(name));
+#endif
+}
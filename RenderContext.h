@@ -0,0 +1,21 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include <string>
+
+// What Graphics needs from the platform: a current OpenGL context, somewhere to draw
+// each frame and the scene-wide matrices. OpenGL provides it for a WGL window and
+// HeadlessContext for an offscreen framebuffer without a display.
+class RenderContext
+{
+public:
+	virtual ~RenderContext() = default;
+	virtual void beginScene() = 0;
+	virtual void endScene() const = 0;
+	virtual glm::mat4 getModelMatrix() = 0;
+	virtual glm::mat4 getProjectionMatrix() = 0;
+	virtual std::string getVideoCardInfo() const = 0;
+	static bool hasExtension(const char* name);
+	static void* getProcAddress(const char* name);
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+// Counters gathered over one frame.
+struct RenderStats
+{
+	unsigned drawCalls;
+	unsigned programChanges;
+	unsigned uniformLookups;
+	unsigned stateCalls;
+	unsigned elidedStateCalls;
+	unsigned visibleObjects;
+	unsigned culledObjects;
+	unsigned occludedObjects;
+	unsigned streamStalls;
+};
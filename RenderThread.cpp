@@ -0,0 +1,336 @@
+#include "RenderThread.h"
+#include <exception>
+#include <stdexcept>
+
+RenderThread::RenderThread(OpenGL* renderContext, HWND window) :
+	context(renderContext),
+	window(window),
+	graphics(nullptr),
+	wake(nullptr),
+	clientSize(0),
+	appliedSize(0),
+	stopping(false),
+	loadFinished(false),
+	loadedModel(nullptr),
+	continuous(false),
+	quantize(false),
+	redraw(true),
+	statsTime(0)
+{
+	wake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (!wake)
+	{
+		throw std::runtime_error("Cannot create the render thread event!");
+	}
+
+	// The context moves to the new thread, which reports whether Graphics could be created.
+	context->makeCurrent(false);
+	std::promise<void> started;
+	std::future<void> result = started.get_future();
+	thread = std::thread(&RenderThread::run, this, std::move(started));
+	try
+	{
+		result.get();
+	}
+	catch (...)
+	{
+		thread.join();
+		CloseHandle(wake);
+		context->makeCurrent(true);
+		throw;
+	}
+}
+
+RenderThread::~RenderThread()
+{
+	stopping = true;
+	SetEvent(wake);
+	thread.join();
+	CloseHandle(wake);
+
+	// The context is released on the thread that created it.
+	context->makeCurrent(true);
+}
+
+// A full queue drops moves and redraws rather than wait for the render thread. Other
+// commands go to the overflow list, and once it holds any, the commands after them
+// follow so that they are applied in order.
+bool RenderThread::post(RenderCommand command)
+{
+	if (isDroppable(command.type))
+	{
+		if (!commands.push(command))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		if (!overflow.empty() || !commands.push(command))
+		{
+			overflow.push_back(command);
+		}
+	}
+
+	SetEvent(wake);
+	return true;
+}
+
+// Only the latest size is applied, however many arrive between frames.
+void RenderThread::resize(int width, int height)
+{
+	clientSize = static_cast<uint32_t>(width & 0xffff) << 16 | static_cast<uint32_t>(height & 0xffff);
+	SetEvent(wake);
+}
+
+// Only the latest file asked for is read; a request is never lost to a full queue.
+void RenderThread::load(const std::string& file)
+{
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requestedFile = file;
+	}
+	SetEvent(wake);
+}
+
+bool RenderThread::isDroppable(RenderCommand::Type type)
+{
+	return type == RenderCommand::Type::Redraw || type == RenderCommand::Type::Move;
+}
+
+bool RenderThread::takeStats(RenderStats& latest)
+{
+	return stats.pop(latest);
+}
+
+void RenderThread::run(std::promise<void> started)
+{
+	try
+	{
+		if (!context->makeCurrent(true))
+		{
+			throw std::runtime_error("Cannot make the OpenGL context current on the render thread!");
+		}
+		graphics = new Graphics(context);
+	}
+	catch (...)
+	{
+		context->makeCurrent(false);
+		started.set_exception(std::current_exception());
+		return;
+	}
+	started.set_value();
+
+	while (!stopping)
+	{
+		RenderCommand command;
+		while (commands.pop(command))
+		{
+			execute(command);
+		}
+		takeRequests();
+
+		if (loadFinished)
+		{
+			finishLoad();
+		}
+
+		if (redraw || continuous)
+		{
+			redraw = false;
+			if (!graphics->render())
+			{
+				PostMessage(window, WM_RENDER_FAILED, 0, 0);
+				break;
+			}
+			publishStats();
+		}
+		else
+		{
+			// Commands, finished loads and shutdown all set the event, which stays set
+			// until this wait consumes it, so none of them is missed.
+			WaitForSingleObject(wake, INFINITE);
+		}
+	}
+
+	if (loader.joinable())
+	{
+		loader.join();
+		if (loadedModel)
+		{
+			delete loadedModel;
+		}
+	}
+
+	delete graphics;
+	graphics = nullptr;
+	context->makeCurrent(false);
+}
+
+void RenderThread::execute(const RenderCommand& command)
+{
+	redraw = true;
+	switch (command.type)
+	{
+	case RenderCommand::Type::Move:
+		graphics->move(static_cast<Direction>(command.first));
+		break;
+
+	case RenderCommand::Type::TogglePointCloud:
+		graphics->togglePointCloud();
+		break;
+
+	case RenderCommand::Type::ToggleClipPlane:
+		graphics->toggleClipPlane();
+		break;
+
+	case RenderCommand::Type::ToggleBuildPlate:
+		graphics->toggleBuildPlate();
+		break;
+
+	case RenderCommand::Type::ToggleGpuCulling:
+		graphics->toggleGpuCulling();
+		break;
+
+	case RenderCommand::Type::ToggleOcclusionCulling:
+		graphics->toggleOcclusionCulling();
+		break;
+
+	case RenderCommand::Type::ChangePointBudget:
+		graphics->changePointBudget(command.first != 0);
+		break;
+
+	case RenderCommand::Type::SetContinuous:
+		continuous = command.first != 0;
+		break;
+
+	case RenderCommand::Type::SetQuantizedPositions:
+		quantize = command.first != 0;
+		graphics->setQuantizedPositions(quantize);
+		break;
+
+	case RenderCommand::Type::Redraw:
+	default:
+		break;
+	}
+}
+
+// Overflowed commands come after everything in the queue, then the latest size and file.
+void RenderThread::takeRequests()
+{
+	std::vector<RenderCommand> pending;
+	std::string file;
+	{
+		// Commands only join the queue under this lock while the overflow list is empty,
+		// so everything still queued is older than what overflowed.
+		std::lock_guard<std::mutex> lock(requestMutex);
+		if (!overflow.empty())
+		{
+			RenderCommand command;
+			while (commands.pop(command))
+			{
+				pending.push_back(command);
+			}
+			pending.insert(pending.end(), overflow.begin(), overflow.end());
+			overflow.clear();
+		}
+		file.swap(requestedFile);
+	}
+
+	for (const RenderCommand& command : pending)
+	{
+		execute(command);
+	}
+
+	const uint32_t size = clientSize;
+	if (size != appliedSize)
+	{
+		appliedSize = size;
+		context->resize(static_cast<int>(size >> 16), static_cast<int>(size & 0xffff));
+		redraw = true;
+	}
+
+	// Only the latest file asked for during a load is read after it. Files that need the
+	// context are loaded here, in order with the others.
+	if (!file.empty())
+	{
+		redraw = true;
+		if (loader.joinable())
+		{
+			queuedFile = file;
+		}
+		else
+		{
+			startLoad(file);
+		}
+	}
+}
+
+// The file is parsed and welded without a context; only its buffers are created here.
+// Formats whose loaders upload as they read are loaded on this thread instead.
+void RenderThread::startLoad(const std::string& file)
+{
+	if (Model::needsContext(file))
+	{
+		if (!graphics->load(file))
+		{
+			PostMessage(window, WM_RENDER_LOAD_FAILED, 0, 0);
+		}
+		return;
+	}
+
+	loadedModel = nullptr;
+	loadFinished = false;
+	const bool quantized = quantize;
+	loader = std::thread([this, file, quantized]()
+	{
+		try
+		{
+			loadedModel = new Model(file, 0, false, quantized);
+		}
+		catch (const std::exception&)
+		{
+			loadedModel = nullptr;
+		}
+		loadFinished = true;
+		SetEvent(wake);
+	});
+}
+
+void RenderThread::finishLoad()
+{
+	loader.join();
+	loadFinished = false;
+
+	// A file the loader thread could not read is not tried again here.
+	const bool loaded = loadedModel && graphics->load(loadedModel);
+	loadedModel = nullptr;
+	if (!loaded)
+	{
+		PostMessage(window, WM_RENDER_LOAD_FAILED, 0, 0);
+	}
+
+	if (!queuedFile.empty())
+	{
+		startLoad(queuedFile);
+		queuedFile.clear();
+	}
+	redraw = true;
+}
+
+// Last frame's counters go to the window once a second.
+void RenderThread::publishStats()
+{
+	const ULONGLONG now = GetTickCount64();
+	if (now - statsTime < 1000)
+	{
+		return;
+	}
+
+	statsTime = now;
+	if (stats.push(graphics->getStats()))
+	{
+		PostMessage(window, WM_RENDER_STATS, 0, 0);
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "OpenGL.h"
+#include "Graphics.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Messages the render thread posts to the window it draws into.
+const UINT WM_RENDER_STATS = WM_APP + 1;
+const UINT WM_RENDER_LOAD_FAILED = WM_APP + 2;
+const UINT WM_RENDER_FAILED = WM_APP + 3;
+
+struct RenderCommand
+{
+	enum class Type { Redraw, Move, TogglePointCloud, ToggleClipPlane, ToggleBuildPlate, ToggleGpuCulling, ToggleOcclusionCulling, ChangePointBudget, SetContinuous, SetQuantizedPositions };
+
+	Type type;
+	// Direction or flag, depending on the type.
+	int first;
+	int second;
+};
+
+// Owns the OpenGL context and Graphics on a thread of its own, so the window's thread
+// stays responsive through modal dialogs and loads and never waits on the GPU. Commands
+// arrive through a lock-free queue and are applied between frames, and the thread
+// sleeps while nothing changes unless rendering is continuous. Only moves and redraws
+// are dropped when the queue is full; other commands wait in an overflow list. The
+// client size and the file to load are not queued at all: each is a slot that holds
+// the latest request until the thread takes it. Models are read on a
+// loader thread and only their buffers are created here, so drawing goes on while a
+// file is parsed; formats that upload as they read are loaded here, and a file that
+// fails on the loader thread is reported without a second try. Counters go back
+// through a second queue, announced by a message.
+class RenderThread
+{
+public:
+	RenderThread(OpenGL* renderContext, HWND window);
+	~RenderThread();
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+	bool post(RenderCommand command);
+	void resize(int width, int height);
+	void load(const std::string& file);
+	bool takeStats(RenderStats& stats);
+
+private:
+	static const size_t commandCapacity = 256;
+	static const size_t statsCapacity = 16;
+
+	static bool isDroppable(RenderCommand::Type type);
+	void run(std::promise<void> started);
+	void takeRequests();
+	void execute(const RenderCommand& command);
+	void startLoad(const std::string& file);
+	void finishLoad();
+	void publishStats();
+
+	OpenGL* context;
+	HWND window;
+	Graphics* graphics;
+	SpscQueue<RenderCommand, commandCapacity> commands;
+	std::mutex requestMutex;
+	std::vector<RenderCommand> overflow;
+	std::string requestedFile;
+	std::atomic<uint32_t> clientSize;
+	uint32_t appliedSize;
+	SpscQueue<RenderStats, statsCapacity> stats;
+	HANDLE wake;
+	std::atomic<bool> stopping;
+	std::thread thread;
+	std::thread loader;
+	std::atomic<bool> loadFinished;
+	Model* loadedModel;
+	std::string queuedFile;
+	bool continuous;
+	bool quantize;
+	bool redraw;
+	ULONGLONG statsTime;
+};
@@ -0,0 +1,260 @@
+#include "Scene.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define SCENE_SSE
+#endif
+
+namespace
+{
+	const size_t transformGrain = 4096;
+	const size_t clean = ~size_t(0);
+
+	// Each result column is the parent's columns weighted by one column of the local
+	// transform, which keeps four lanes busy without shuffles.
+	void multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4& world)
+	{
+#ifdef SCENE_SSE
+		const __m128 c0 = _mm_loadu_ps(&parent[0][0]);
+		const __m128 c1 = _mm_loadu_ps(&parent[1][0]);
+		const __m128 c2 = _mm_loadu_ps(&parent[2][0]);
+		const __m128 c3 = _mm_loadu_ps(&parent[3][0]);
+		for (int column = 0; column < 4; ++column)
+		{
+			const float* weights = &local[column][0];
+			const __m128 sum = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(weights[0])), _mm_mul_ps(c1, _mm_set1_ps(weights[1]))),
+				_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(weights[2])), _mm_mul_ps(c3, _mm_set1_ps(weights[3]))));
+			_mm_storeu_ps(&world[column][0], sum);
+		}
+#else
+		world = parent * local;
+#endif
+	}
+}
+
+Scene::Scene() :
+	firstDirty(clean),
+	firstUpdated(clean),
+	sorted(true)
+{
+}
+
+void Scene::clear()
+{
+	parents.clear();
+	depths.clear();
+	localTransforms.clear();
+	worldTransforms.clear();
+	boundsMin.clear();
+	boundsMax.clear();
+	meshes.clear();
+	dirty.clear();
+	updated.clear();
+	slots.clear();
+	levelStarts.clear();
+	sorted = true;
+	firstDirty = clean;
+	firstUpdated = clean;
+}
+
+// Parents must already exist, which keeps the graph acyclic. Bounds start out empty, as
+// a minimum above the maximum.
+Scene::Node Scene::addNode(Node parent, const glm::mat4& localTransform, int mesh)
+{
+	const uint32_t parentSlot = parent == none ? none : slots[parent];
+	const uint32_t depth = parent == none ? 0 : depths[parentSlot] + 1;
+
+	// Appending keeps the depth order unless the new node is shallower than the last one,
+	// but the level ranges always have to be counted again.
+	sorted = sorted && (depths.empty() || depth >= depths.back());
+	levelStarts.clear();
+
+	const Node node = static_cast<Node>(slots.size());
+	slots.push_back(static_cast<uint32_t>(parents.size()));
+	parents.push_back(parentSlot);
+	depths.push_back(depth);
+	localTransforms.push_back(localTransform);
+	worldTransforms.push_back(localTransform);
+	boundsMin.push_back(glm::vec3(1.0f));
+	boundsMax.push_back(glm::vec3(-1.0f));
+	meshes.push_back(mesh);
+	firstDirty = std::min(firstDirty, parents.size());
+	dirty.push_back(1);
+	updated.push_back(0);
+	return node;
+}
+
+void Scene::setLocalTransform(Node node, const glm::mat4& localTransform)
+{
+	const uint32_t slot = slots[node];
+	localTransforms[slot] = localTransform;
+	dirty[slot] = 1;
+	firstDirty = std::min<size_t>(firstDirty, slot);
+}
+
+void Scene::setBounds(Node node, const glm::vec3& minimum, const glm::vec3& maximum)
+{
+	boundsMin[slots[node]] = minimum;
+	boundsMax[slots[node]] = maximum;
+}
+
+// A stable counting sort by depth, after which handles and parent links are remapped.
+void Scene::sort()
+{
+	const uint32_t maxDepth = depths.empty() ? 0 : *std::max_element(depths.begin(), depths.end());
+	std::vector<size_t> starts(maxDepth + 2, 0);
+	for (uint32_t depth : depths)
+	{
+		++starts[depth + 1];
+	}
+	for (size_t depth = 1; depth < starts.size(); ++depth)
+	{
+		starts[depth] += starts[depth - 1];
+	}
+	levelStarts = starts;
+
+	std::vector<uint32_t> order(depths.size());
+	for (size_t slot = 0; slot < depths.size(); ++slot)
+	{
+		order[slot] = static_cast<uint32_t>(starts[depths[slot]]++);
+	}
+
+	const auto permute = [&order](auto& values)
+	{
+		typename std::remove_reference<decltype(values)>::type sortedValues(values.size());
+		for (size_t slot = 0; slot < values.size(); ++slot)
+		{
+			sortedValues[order[slot]] = values[slot];
+		}
+		values.swap(sortedValues);
+	};
+
+	for (uint32_t& parent : parents)
+	{
+		parent = parent == none ? none : order[parent];
+	}
+	for (uint32_t& slot : slots)
+	{
+		slot = order[slot];
+	}
+
+	permute(parents);
+	permute(depths);
+	permute(localTransforms);
+	permute(worldTransforms);
+	permute(boundsMin);
+	permute(boundsMax);
+	permute(meshes);
+	permute(dirty);
+	updated.assign(dirty.size(), 0);
+	firstDirty = 0;
+	sorted = true;
+}
+
+// Each depth is one parallel job, after the depth above it is complete. A node is
+// recomputed when its own transform changed or its parent was recomputed at the depth
+// above, which is also what isUpdated reports. Nodes before the first change are never
+// visited. Returns the number of world transforms recomputed.
+size_t Scene::update()
+{
+	if (firstDirty == clean)
+	{
+		firstUpdated = clean;
+		return 0;
+	}
+
+	if (!sorted || levelStarts.empty())
+	{
+		sort();
+	}
+	const size_t start = firstDirty;
+	firstUpdated = start;
+
+	// Raw pointers keep the inner loop free of reloads through the vectors.
+	const uint32_t* parentSlots = parents.data();
+	const glm::mat4* locals = localTransforms.data();
+	glm::mat4* worlds = worldTransforms.data();
+	uint8_t* flags = dirty.data();
+	uint8_t* changed = updated.data();
+	std::atomic<size_t> recomputed(0);
+	for (size_t level = 0; level + 1 < levelStarts.size(); ++level)
+	{
+		if (levelStarts[level + 1] <= start)
+		{
+			continue;
+		}
+
+		const size_t first = std::max(levelStarts[level], start);
+		ThreadPool::instance().parallelFor(levelStarts[level + 1] - first, transformGrain, [=, &recomputed](size_t begin, size_t end)
+		{
+			size_t count = 0;
+			for (size_t slot = first + begin; slot < first + end; ++slot)
+			{
+				const uint32_t parent = parentSlots[slot];
+				const bool inherited = parent != none && parent >= start && changed[parent];
+				changed[slot] = flags[slot] | static_cast<uint8_t>(inherited);
+				if (!changed[slot])
+				{
+					continue;
+				}
+
+				if (parent == none)
+				{
+					worlds[slot] = locals[slot];
+				}
+				else
+				{
+					multiply(worlds[parent], locals[slot], worlds[slot]);
+				}
+				flags[slot] = 0;
+				++count;
+			}
+			recomputed += count;
+		});
+	}
+
+	firstDirty = clean;
+	return recomputed;
+}
+
+// Whether the last update recomputed the node's world transform.
+bool Scene::isUpdated(Node node) const
+{
+	const uint32_t slot = slots[node];
+	return slot >= firstUpdated && slot < updated.size() && updated[slot] != 0;
+}
+
+const glm::mat4& Scene::getLocalTransform(Node node) const
+{
+	return localTransforms[slots[node]];
+}
+
+const glm::mat4& Scene::getWorldTransform(Node node) const
+{
+	return worldTransforms[slots[node]];
+}
+
+glm::vec3 Scene::getBoundsMin(Node node) const
+{
+	return boundsMin[slots[node]];
+}
+
+glm::vec3 Scene::getBoundsMax(Node node) const
+{
+	return boundsMax[slots[node]];
+}
+
+int Scene::getMesh(Node node) const
+{
+	return meshes[slots[node]];
+}
+
+size_t Scene::getNodeCount() const
+{
+	return slots.size();
+}
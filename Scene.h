@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Flat scene graph. Nodes are stored as structure-of-arrays ordered by depth, so every
+// parent comes before its children and each depth is one contiguous range whose world
+// transforms are independent of each other and are computed in parallel. Only nodes at
+// or below a changed local transform are recomputed. Nodes are named by handles that
+// stay valid when adding nodes reorders the storage.
+class Scene
+{
+public:
+	typedef uint32_t Node;
+	static const Node none = ~0u;
+
+	Scene();
+	~Scene() = default;
+	void clear();
+	Node addNode(Node parent, const glm::mat4& localTransform, int mesh = -1);
+	void setLocalTransform(Node node, const glm::mat4& localTransform);
+	void setBounds(Node node, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	size_t update();
+	bool isUpdated(Node node) const;
+	const glm::mat4& getLocalTransform(Node node) const;
+	const glm::mat4& getWorldTransform(Node node) const;
+	glm::vec3 getBoundsMin(Node node) const;
+	glm::vec3 getBoundsMax(Node node) const;
+	int getMesh(Node node) const;
+	size_t getNodeCount() const;
+
+private:
+	void sort();
+
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> depths;
+	std::vector<glm::mat4> localTransforms;
+	std::vector<glm::mat4> worldTransforms;
+	std::vector<glm::vec3> boundsMin;
+	std::vector<glm::vec3> boundsMax;
+	std::vector<int> meshes;
+	std::vector<uint8_t> dirty;
+	std::vector<uint8_t> updated;
+	std::vector<uint32_t> slots;
+	std::vector<size_t> levelStarts;
+	size_t firstDirty;
+	size_t firstUpdated;
+	bool sorted;
+};
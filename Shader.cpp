@@ -1,104 +1,235 @@
 #include "Shader.h"
-#include "resource.h"
-#include "OpenGL.h"
+#include "GLState.h"
+#include "RenderContext.h"
+#include "ShaderCache.h"
+#include <algorithm>
+#include <cstring>
 
-Shader::Shader(): 
+Shader::Shader(const char* vertexSource, const char* fragmentSource, const std::string& defines, const ShaderCache* cache) :
 	vertexShader(0), 
 	fragmentShader(0),
-	program(0)
+	computeShader(0),
+	program(0),
+	cache(cache),
+	cacheKey(0),
+	restored(false),
+	uniformLookups(0)
 {
-	HRSRC hRes = FindResource(nullptr, MAKEINTRESOURCE(IDR_SHADER_V), L"SHADER");
-	LPVOID vs = nullptr;
-	if (hRes)
+	program = glCreateProgram();
+
+	if (cache)
 	{
-		const HGLOBAL hData = LoadResource(nullptr, hRes);
-		if (hData)
+		cacheKey = cache->getKey(vertexSource, fragmentSource, defines);
+		restored = cache->load(cacheKey, program);
+		if (restored)
 		{
-			vs = LockResource(hData);
+			return;
 		}
 	}
 
-	LPVOID fs = nullptr;
-	hRes = FindResource(nullptr, MAKEINTRESOURCE(IDR_SHADER_F), L"SHADER");
-	if (hRes)
+	vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource, defines);
+	fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource, defines);
+
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+
+	glBindAttribLocation(program, 0, "inputPosition");
+	glBindAttribLocation(program, 1, "inputTexCoord");
+	glBindAttribLocation(program, 2, "inputNormal");
+
+	if (cache)
 	{
-		const HGLOBAL hData = LoadResource(nullptr, hRes);
-		if (hData)
-		{
-			fs = LockResource(hData);
-		}
+		cache->prepare(program);
 	}
 
-	if (!vs || !fs)
+	// Statuses are not queried here, so drivers with parallel compilation keep working.
+	glLinkProgram(program);
+}
+
+Shader::Shader(const char* computeSource, const std::string& defines, const ShaderCache* cache) :
+	vertexShader(0),
+	fragmentShader(0),
+	computeShader(0),
+	program(0),
+	cache(cache),
+	cacheKey(0),
+	restored(false),
+	uniformLookups(0)
+{
+	program = glCreateProgram();
+
+	if (cache)
 	{
-		throw std::exception("Cannot read shader files!");
+		cacheKey = cache->getKey(computeSource, "", defines);
+		restored = cache->load(cacheKey, program);
+		if (restored)
+		{
+			return;
+		}
 	}
 
-	if (!initializeShader(static_cast<char*>(vs), static_cast<char*>(fs)))
+	computeShader = compileShader(GL_COMPUTE_SHADER, computeSource, defines);
+	glAttachShader(program, computeShader);
+
+	if (cache)
 	{
-		throw std::exception(error.c_str());
+		cache->prepare(program);
 	}
+
+	glLinkProgram(program);
 }
 
 Shader::~Shader()
 {
-	glDetachShader(program, vertexShader);
-	glDetachShader(program, fragmentShader);
+	// Programs restored from the binary cache have no shader objects.
+	if (vertexShader)
+	{
+		glDetachShader(program, vertexShader);
+		glDeleteShader(vertexShader);
+	}
+
+	if (fragmentShader)
+	{
+		glDetachShader(program, fragmentShader);
+		glDeleteShader(fragmentShader);
+	}
 
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+	if (computeShader)
+	{
+		glDetachShader(program, computeShader);
+		glDeleteShader(computeShader);
+	}
 
-	glDeleteProgram(program);
+	GLState::instance().deleteProgram(program);
 }
 
 void Shader::setShader() const
 {
-	glUseProgram(program);	
+	GLState::instance().useProgram(program);
 }
 
-bool Shader::initializeShader(const char* vertexShaderBuffer, const char* fragmentShaderBuffer)
+// The defines go right after the #version line, which must stay the first statement.
+// Defines that start with their own #version line replace the one in the source.
+unsigned Shader::compileShader(unsigned type, const char* source, const std::string& defines)
 {
-	int status;
+	const char* body = std::strchr(source, '\n');
+	body = body ? body + 1 : source + std::strlen(source);
 
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	const bool ownVersion = defines.compare(0, 8, "#version") == 0;
+	const char* sources[] = { source, defines.c_str(), body };
+	const int lengths[] = { ownVersion ? 0 : static_cast<int>(body - source), static_cast<int>(defines.size()), -1 };
 
-	glShaderSource(vertexShader, 1, &vertexShaderBuffer, nullptr);
-	glShaderSource(fragmentShader, 1, &fragmentShaderBuffer, nullptr);
+	const unsigned shader = glCreateShader(type);
+	glShaderSource(shader, 3, sources, lengths);
+	glCompileShader(shader);
+	return shader;
+}
 
-	glCompileShader(vertexShader);
-	glCompileShader(fragmentShader);
+bool Shader::finish()
+{
+	int status;
 
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &status);
-	if(status != 1)
+	if (!restored)
 	{
-		getShaderError(vertexShader);
-		return false;
+		for (unsigned shader : { vertexShader, fragmentShader, computeShader })
+		{
+			if (!shader)
+			{
+				continue;
+			}
+
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+			if(status != 1)
+			{
+				getShaderError(shader);
+				return false;
+			}
+		}
+
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if(status != 1)
+		{
+			getProgramError(program);
+			return false;
+		}
+
+		if (cache)
+		{
+			cache->store(cacheKey, program);
+		}
 	}
 
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &status);
-	if(status != 1)
+	return reflect();
+}
+
+// Active uniforms, attributes and uniform blocks are read once after linking and kept
+// sorted by name hash, so locations are found without asking the driver.
+bool Shader::reflect()
+{
+	int count = 0;
+	int maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::string name(static_cast<size_t>(maxLength) + 1, '\0');
+	for (int i = 0; i < count; ++i)
 	{
-		getShaderError(fragmentShader);
-		return false;
+		int length = 0;
+		Variable variable;
+		glGetActiveUniform(program, i, static_cast<int>(name.size()), &length, &variable.size, &variable.type, &name[0]);
+
+		// Uniform blocks have no location of their own.
+		variable.location = glGetUniformLocation(program, name.c_str());
+		++uniformLookups;
+		if (variable.location == -1)
+		{
+			continue;
+		}
+
+		// Arrays are reported as "name[0]" and are looked up by their plain name.
+		const std::string plainName = name.substr(0, std::min<size_t>(static_cast<size_t>(length), name.find('[')));
+		variable.name = hashName(plainName.c_str());
+		uniforms.push_back(variable);
 	}
 
-	program = glCreateProgram();
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
 
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
+	name.assign(static_cast<size_t>(maxLength) + 1, '\0');
+	for (int i = 0; i < count; ++i)
+	{
+		int length = 0;
+		Variable variable;
+		glGetActiveAttrib(program, i, static_cast<int>(name.size()), &length, &variable.size, &variable.type, &name[0]);
+		variable.location = glGetAttribLocation(program, name.c_str());
+		variable.name = hashName(std::string(name.c_str(), static_cast<size_t>(length)).c_str());
+		attributes.push_back(variable);
+	}
 
-	glBindAttribLocation(program, 0, "inputPosition");
-	glBindAttribLocation(program, 1, "inputTexCoord");
-	glBindAttribLocation(program, 2, "inputNormal");
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
 
-	glLinkProgram(program);
+	name.assign(static_cast<size_t>(maxLength) + 1, '\0');
+	for (int i = 0; i < count; ++i)
+	{
+		int length = 0;
+		Variable variable;
+		glGetActiveUniformBlockName(program, i, static_cast<int>(name.size()), &length, &name[0]);
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &variable.size);
+		variable.name = hashName(std::string(name.c_str(), static_cast<size_t>(length)).c_str());
+		variable.location = i;
+		variable.type = 0;
+		blocks.push_back(variable);
+	}
 
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
-	if(status != 1)
+	for (std::vector<Variable>* table : { &uniforms, &attributes, &blocks })
 	{
-		getProgramError(program);
-		return false;
+		std::sort(table->begin(), table->end(), [](const Variable& a, const Variable& b) { return a.name < b.name; });
+		if (std::adjacent_find(table->begin(), table->end(), [](const Variable& a, const Variable& b) { return a.name == b.name; }) != table->end())
+		{
+			error = "Two shader variable names share a hash!";
+			return false;
+		}
 	}
 
 	return true;
@@ -124,64 +255,52 @@ void Shader::getProgramError(unsigned int programId)
 	glGetProgramInfoLog(programId, logSize, nullptr, &error[0]);
 }
 
-bool Shader::setMatrices(glm::mat4 modelMatrix, glm::mat4 viewMatrix, glm::mat4 projectionMatrix) const
+bool Shader::bindBlock(uint32_t name, unsigned binding) const
 {
-	unsigned int location = glGetUniformLocation(program, "modelMatrix");
-	if(location == -1)
+	const int index = find(blocks, name);
+	if (index == -1)
 	{
 		return false;
 	}
-	glUniformMatrix4fv(location, 1, false, &modelMatrix[0][0]);
-
-	location = glGetUniformLocation(program, "viewMatrix");
-	if(location == -1)
-	{
-		return false;
-	}
-	glUniformMatrix4fv(location, 1, false, &viewMatrix[0][0]);
-
-	location = glGetUniformLocation(program, "projectionMatrix");
-	if(location == -1)
-	{
-		return false;
-	}
-	glUniformMatrix4fv(location, 1, false, &projectionMatrix[0][0]);
 
+	glUniformBlockBinding(program, static_cast<unsigned>(index), binding);
 	return true;
 }
 
-bool Shader::setLightPosition(glm::vec3 pos) const
+// Storage blocks only exist in GLSL 4.30 programs and are bound by name when needed.
+bool Shader::bindStorageBlock(const char* name, unsigned binding) const
 {
-	unsigned location = glGetUniformLocation(program, "lightPos");
-	if (location == -1)
+	const unsigned index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name);
+	if (index == GL_INVALID_INDEX)
 	{
 		return false;
 	}
 
-	glUniform3fv(location, 1, &pos[0]);
-
-	location = glGetUniformLocation(program, "viewPos");
-	if (location == -1)
-	{
-		return false;
-	}
-
-	glUniform3fv(location, 1, &pos[0]);
-
+	glShaderStorageBlockBinding(program, index, binding);
 	return true;
 }
 
-bool Shader::setObjectColour(glm::vec4 colour) const
+int Shader::getUniform(uint32_t name) const
 {
-	unsigned location = glGetUniformLocation(program, "objColour");
-	if (location == -1)
-	{
-		return false;
-	}
+	return find(uniforms, name);
+}
 
-	glUniform4fv(location, 1, &colour[0]);
+int Shader::getAttribute(uint32_t name) const
+{
+	return find(attributes, name);
+}
 
-	return true;
+unsigned Shader::takeUniformLookups()
+{
+	const unsigned lookups = uniformLookups;
+	uniformLookups = 0;
+	return lookups;
+}
+
+int Shader::find(const std::vector<Variable>& table, uint32_t name)
+{
+	const auto found = std::lower_bound(table.begin(), table.end(), name, [](const Variable& variable, uint32_t key) { return variable.name < key; });
+	return found != table.end() && found->name == name ? found->location : -1;
 }
 
 std::string Shader::getError()
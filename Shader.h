@@ -1,26 +1,57 @@
 #pragma once
 
+#include "Hash.h"
 #include <glm/glm.hpp>
 #include <string>
+#include <vector>
 
+class ShaderCache;
+
+// One linked program, either a vertex and fragment pair or a single compute shader.
+// Compiling and linking are only submitted by the constructor; finish waits for the
+// driver, checks the result and reads the program's interface.
 class Shader
 {
 public:
-	Shader();
+	Shader(const char* vertexSource, const char* fragmentSource, const std::string& defines, const ShaderCache* cache = nullptr);
+	Shader(const char* computeSource, const std::string& defines, const ShaderCache* cache = nullptr);
 	~Shader();
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+	bool finish();
 	void setShader() const;
-	bool setMatrices(glm::mat4 modelMatrix, glm::mat4 viewMatrix, glm::mat4 projectionMatrix) const;
-	bool setLightPosition(glm::vec3 pos) const;
-	bool setObjectColour(glm::vec4 colour) const;
+	bool bindBlock(uint32_t name, unsigned binding) const;
+	bool bindStorageBlock(const char* name, unsigned binding) const;
+	int getUniform(uint32_t name) const;
+	int getAttribute(uint32_t name) const;
+	unsigned takeUniformLookups();
 	std::string getError();
 
 private:
-	bool initializeShader(const char*, const char*);
+	struct Variable
+	{
+		uint32_t name;
+		int location;
+		unsigned type;
+		int size;
+	};
+
+	static unsigned compileShader(unsigned type, const char* source, const std::string& defines);
 	void getShaderError(unsigned int);
 	void getProgramError(unsigned int);
+	bool reflect();
+	static int find(const std::vector<Variable>& table, uint32_t name);
 	
 	unsigned int vertexShader;
 	unsigned int fragmentShader;
+	unsigned int computeShader;
 	unsigned int program;
+	const ShaderCache* cache;
+	uint64_t cacheKey;
+	bool restored;
+	std::vector<Variable> uniforms;
+	std::vector<Variable> attributes;
+	std::vector<Variable> blocks;
+	unsigned uniformLookups;
 	std::string error;
 };
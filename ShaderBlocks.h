@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// CPU mirrors of the std140 uniform blocks declared in light.vert and light.frag.
+// Members are vec4 and mat4 only, so the C++ layout matches std140 without padding.
+// The array sizes are written out in both shaders and must follow these constants.
+
+const unsigned frameBlockBinding = 0;
+const unsigned objectBlockBinding = 1;
+const unsigned objectStorageBinding = 0;
+const unsigned drawIndexStorageBinding = 1;
+const unsigned maxLights = 4;
+const unsigned maxClipPlanes = 4;
+
+struct FrameBlock
+{
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::mat4 viewProjectionMatrix;
+	glm::vec4 cameraPosition;
+	glm::vec4 ambientLight;
+	glm::vec4 lightPositions[maxLights];
+	glm::vec4 lightColours[maxLights];
+	glm::vec4 clipPlanes[maxClipPlanes];
+};
+
+// material holds the specular strength and exponent; positionScale and positionOffset
+// expand quantized positions back to model space.
+struct ObjectBlock
+{
+	glm::mat4 modelMatrix;
+	glm::mat4 normalMatrix;
+	glm::vec4 objColour;
+	glm::vec4 material;
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+};
+
+// Object and light defaults of a new scene, shared by Graphics and the software path of
+// the benchmark so both render the same image.
+const glm::vec4 defaultObjectColour(0.5f, 0.5f, 0.5f, 1.0f);
+const glm::vec4 defaultMaterial(0.5f, 32.0f, 0.0f, 0.0f);
+const glm::vec4 defaultAmbientLight(0.15f, 0.15f, 0.15f, 1.0f);
+const glm::vec3 defaultLightPosition(0.0f, 0.0f, -10.0f);
+const glm::vec4 defaultLightColour(1.0f, 1.0f, 1.0f, 1.0f);
@@ -0,0 +1,185 @@
+#include "ShaderCache.h"
+#include "Hash.h"
+#include "glad/glad.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const uint32_t cacheMagic = 0x42504C47;
+
+#ifdef _WIN32
+	const char pathSeparator = '\\';
+
+	void createDirectory(const std::string& path)
+	{
+		CreateDirectoryA(path.c_str(), nullptr);
+	}
+#else
+	const char pathSeparator = '/';
+
+	void createDirectory(const std::string& path)
+	{
+		mkdir(path.c_str(), 0755);
+	}
+#endif
+
+	// The per-user cache location: local application data on Windows and the XDG cache
+	// directory elsewhere. Empty when the environment names neither.
+	std::string getCacheRoot()
+	{
+#ifdef _WIN32
+		const char* localAppData = std::getenv("LOCALAPPDATA");
+		return localAppData ? std::string(localAppData) : std::string();
+#else
+		const char* cacheHome = std::getenv("XDG_CACHE_HOME");
+		if (cacheHome && *cacheHome)
+		{
+			return std::string(cacheHome);
+		}
+
+		const char* home = std::getenv("HOME");
+		if (!home || !*home)
+		{
+			return std::string();
+		}
+
+		createDirectory(std::string(home) + "/.cache");
+		return std::string(home) + "/.cache";
+#endif
+	}
+}
+
+ShaderCache::ShaderCache(const std::string& driverInfo) :
+	driverInfo(driverInfo),
+	isSupported(false)
+{
+	// Program binaries are core in 4.1; some drivers expose the entry points but no formats.
+	int formats = 0;
+	if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+
+	const std::string root = formats > 0 ? getCacheRoot() : std::string();
+	if (root.empty())
+	{
+		return;
+	}
+
+	directory = root + pathSeparator + "OpenGLWin32";
+	createDirectory(directory);
+	directory += pathSeparator;
+	directory += "ShaderCache";
+	createDirectory(directory);
+
+	// The version string carries the driver build, which decides binary compatibility.
+	const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+	this->driverInfo += version ? std::string(" - ") + version : std::string();
+	isSupported = true;
+}
+
+uint64_t ShaderCache::getKey(const char* vertexSource, const char* fragmentSource, const std::string& defines) const
+{
+	// Each part is hashed with its terminator so that boundaries between parts matter.
+	uint64_t key = hashBytes(vertexSource, std::strlen(vertexSource) + 1);
+	key = hashBytes(fragmentSource, std::strlen(fragmentSource) + 1, key);
+	key = hashBytes(defines.c_str(), defines.size() + 1, key);
+	return hashBytes(driverInfo.c_str(), driverInfo.size() + 1, key);
+}
+
+bool ShaderCache::load(uint64_t key, unsigned program) const
+{
+	if (!isSupported)
+	{
+		return false;
+	}
+
+	std::ifstream file(getPath(key), std::ios::binary);
+	Header header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != cacheMagic || header.key != key)
+	{
+		return false;
+	}
+
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+	{
+		return false;
+	}
+
+	// A binary the driver no longer accepts leaves the program unlinked, and the caller recompiles.
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+	int status = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status == GL_TRUE;
+}
+
+void ShaderCache::store(uint64_t key, unsigned program) const
+{
+	if (!isSupported)
+	{
+		return;
+	}
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	Header header = {};
+	header.magic = cacheMagic;
+	header.key = key;
+
+	std::vector<char> binary(static_cast<size_t>(length));
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &header.format, binary.data());
+	header.length = static_cast<uint32_t>(written);
+	if (written <= 0)
+	{
+		return;
+	}
+
+	// Entries are written under a temporary name first so a crash never leaves half a binary.
+	const std::string path = getPath(key);
+	const std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), written);
+		if (!file)
+		{
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+	std::rename(temporaryPath.c_str(), path.c_str());
+}
+
+void ShaderCache::prepare(unsigned program) const
+{
+	if (isSupported)
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+std::string ShaderCache::getPath(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%c%016llx.bin", pathSeparator, static_cast<unsigned long long>(key));
+	return directory + name;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// On-disk cache of linked program binaries. Keys cover the shader sources, the defines
+// and the driver, so a changed shader or a driver update simply misses the cache.
+class ShaderCache
+{
+public:
+	ShaderCache(const std::string& driverInfo);
+	~ShaderCache() = default;
+	uint64_t getKey(const char* vertexSource, const char* fragmentSource, const std::string& defines) const;
+	bool load(uint64_t key, unsigned program) const;
+	void store(uint64_t key, unsigned program) const;
+	void prepare(unsigned program) const;
+
+private:
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t format;
+		uint64_t key;
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	std::string getPath(uint64_t key) const;
+
+	std::string directory;
+	std::string driverInfo;
+	bool isSupported;
+};
@@ -0,0 +1,257 @@
+#include "ShaderLibrary.h"
+#include "RenderContext.h"
+#include "ShaderBlocks.h"
+#include "resource.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Without Windows resources the sources are read from the files the resource script
+// embeds, found in SHADER_DIRECTORY.
+#ifndef SHADER_DIRECTORY
+#define SHADER_DIRECTORY "."
+#endif
+
+// KHR_parallel_shader_compile; the loader header predates the extension.
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+#endif
+
+uint32_t ShaderVariant::getKey() const
+{
+	return static_cast<uint32_t>(lighting) |
+		static_cast<uint32_t>(normals) << 2 |
+		lightCount << 3 |
+		clipPlanes << 7 |
+		(quantized ? 1u : 0u) << 11 |
+		(instanced ? 1u : 0u) << 12 |
+		(batched ? 1u : 0u) << 13;
+}
+
+std::string ShaderVariant::getDefines() const
+{
+	// Batched draws need storage buffers, which GLSL 4.00 does not have.
+	std::string defines = batched ? "#version 430\n#define BATCHED\n" : "";
+	if (quantized)
+	{
+		defines += "#define QUANTIZED\n";
+	}
+
+	if (instanced)
+	{
+		defines += "#define INSTANCED\n";
+	}
+
+	// Unlit programs read neither normals nor lights, so those features do not split them.
+	if (lighting != Lighting::Unlit)
+	{
+		defines += lighting == Lighting::Specular ? "#define LIGHTING_SPECULAR\n" : "#define LIGHTING_DIFFUSE\n";
+		defines += "#define LIGHT_COUNT " + std::to_string(lightCount) + "\n";
+		if (normals == NormalSource::Attribute)
+		{
+			defines += "#define NORMAL_ATTRIBUTE\n";
+		}
+	}
+
+	defines += "#define CLIP_PLANES " + std::to_string(clipPlanes) + "\n";
+	return defines;
+}
+
+ShaderLibrary::ShaderLibrary(const ShaderCache* cache) :
+	cache(cache)
+{
+	vertexSource = loadResource(IDR_SHADER_V);
+	fragmentSource = loadResource(IDR_SHADER_F);
+	if (vertexSource.empty() || fragmentSource.empty())
+	{
+		throw std::runtime_error("Cannot read shader files!");
+	}
+
+	if (RenderContext::hasExtension("GL_KHR_parallel_shader_compile") || RenderContext::hasExtension("GL_ARB_parallel_shader_compile"))
+	{
+		const auto maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(RenderContext::getProcAddress("glMaxShaderCompilerThreadsKHR"));
+		const auto maxShaderCompilerThreadsArb = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(RenderContext::getProcAddress("glMaxShaderCompilerThreadsARB"));
+
+		// 0xFFFFFFFF leaves the number of compiler threads to the driver.
+		if (maxShaderCompilerThreads)
+		{
+			maxShaderCompilerThreads(0xFFFFFFFF);
+		}
+		else if (maxShaderCompilerThreadsArb)
+		{
+			maxShaderCompilerThreadsArb(0xFFFFFFFF);
+		}
+	}
+}
+
+ShaderLibrary::~ShaderLibrary()
+{
+	for (auto& program : programs)
+	{
+		delete program.second.shader;
+	}
+
+	for (auto& program : computePrograms)
+	{
+		delete program.second.shader;
+	}
+}
+
+std::string ShaderLibrary::loadResource(int id)
+{
+#ifdef _WIN32
+	const HRSRC resource = FindResource(nullptr, MAKEINTRESOURCE(id), L"SHADER");
+	if (!resource)
+	{
+		return std::string();
+	}
+
+	const HGLOBAL data = LoadResource(nullptr, resource);
+	const char* text = data ? static_cast<const char*>(LockResource(data)) : nullptr;
+	return text ? std::string(text, SizeofResource(nullptr, resource)) : std::string();
+#else
+	const char* name = id == IDR_SHADER_V ? "light.vert" :
+		id == IDR_SHADER_F ? "light.frag" :
+		id == IDR_SHADER_C ? "cull.comp" :
+		id == IDR_SHADER_D ? "depth.comp" : nullptr;
+	if (!name)
+	{
+		return std::string();
+	}
+
+	std::ifstream file(std::string(SHADER_DIRECTORY) + "/" + name, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+#endif
+}
+
+ShaderLibrary::Program& ShaderLibrary::request(const ShaderVariant& variant)
+{
+	const auto known = variants.find(variant.getKey());
+	if (known != variants.end())
+	{
+		return *known->second;
+	}
+
+	const std::string defines = variant.getDefines();
+	const uint64_t hash = hashBytes(defines.data(), defines.size());
+	auto found = programs.find(hash);
+	if (found == programs.end())
+	{
+		Program program;
+		program.shader = new Shader(vertexSource.c_str(), fragmentSource.c_str(), defines, cache);
+		program.finished = false;
+		program.failed = false;
+		found = programs.emplace(hash, program).first;
+	}
+
+	variants[variant.getKey()] = &found->second;
+	return found->second;
+}
+
+void ShaderLibrary::prepare(const ShaderVariant& variant)
+{
+	request(variant);
+}
+
+// Prepared programs are finished on first use. With parallel compilation the driver has
+// usually completed them by then; otherwise this is where the compile cost is paid.
+Shader* ShaderLibrary::get(const ShaderVariant& variant)
+{
+	Program& program = request(variant);
+	if (!program.finished)
+	{
+		program.finished = true;
+
+		constexpr uint32_t frameBlockName = hashName("Frame");
+		constexpr uint32_t objectBlockName = hashName("Object");
+		program.failed = !program.shader->finish();
+		if (program.failed)
+		{
+			error = program.shader->getError();
+		}
+		else
+		{
+			program.shader->bindBlock(frameBlockName, frameBlockBinding);
+			program.shader->bindBlock(objectBlockName, objectBlockBinding);
+			if (variant.batched)
+			{
+				program.shader->bindStorageBlock("Objects", objectStorageBinding);
+				program.shader->bindStorageBlock("DrawIndices", drawIndexStorageBinding);
+			}
+		}
+	}
+
+	return program.failed ? nullptr : program.shader;
+}
+
+Shader* ShaderLibrary::getCulling(CullPass pass)
+{
+	switch (pass)
+	{
+	case CullPass::Visible:
+		return getCompute(IDR_SHADER_C, "#define PASS_VISIBLE\n");
+	case CullPass::Occlusion:
+		return getCompute(IDR_SHADER_C, "#define PASS_OCCLUSION\n");
+	default:
+		return getCompute(IDR_SHADER_C, std::string());
+	}
+}
+
+Shader* ShaderLibrary::getDepthReduction()
+{
+	return getCompute(IDR_SHADER_D, std::string());
+}
+
+// Compute programs are only built when a renderer asks for them, since they need GL 4.3
+// and the light programs do not.
+Shader* ShaderLibrary::getCompute(int id, const std::string& defines)
+{
+	const uint64_t hash = hashBytes(defines.data(), defines.size(), static_cast<uint64_t>(id));
+	Program& program = computePrograms.emplace(hash, Program{ nullptr, false, false }).first->second;
+	if (!program.finished)
+	{
+		program.finished = true;
+
+		const std::string source = loadResource(id);
+		if (source.empty())
+		{
+			program.failed = true;
+			error = "Cannot read a compute shader!";
+			return nullptr;
+		}
+
+		program.shader = new Shader(source.c_str(), defines, cache);
+		program.failed = !program.shader->finish();
+		if (program.failed)
+		{
+			error = program.shader->getError();
+		}
+	}
+
+	return program.failed ? nullptr : program.shader;
+}
+
+unsigned ShaderLibrary::takeUniformLookups()
+{
+	unsigned lookups = 0;
+	for (auto& program : computePrograms)
+	{
+		lookups += program.second.shader ? program.second.shader->takeUniformLookups() : 0;
+	}
+
+	for (auto& program : programs)
+	{
+		lookups += program.second.shader->takeUniformLookups();
+	}
+	return lookups;
+}
+
+std::string ShaderLibrary::getError()
+{
+	return error;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Shader.h"
+#include "ShaderCache.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class NormalSource { Attribute, Derivative };
+enum class Lighting { Unlit, Diffuse, Specular };
+
+// Passes of cull.comp. Frustum culls every draw. With occlusion culling, Visible first
+// draws what was visible last frame, and Occlusion then tests everything against the
+// depth pyramid of those draws and adds what has come into view.
+enum class CullPass { Frustum, Visible, Occlusion };
+
+// Features a draw needs from its program. Each combination is compiled as its own
+// program through #define specialization, so shaders never branch on them at run time.
+struct ShaderVariant
+{
+	NormalSource normals;
+	Lighting lighting;
+	unsigned lightCount;
+	unsigned clipPlanes;
+	bool quantized;
+	bool instanced;
+	bool batched;
+
+	uint32_t getKey() const;
+	std::string getDefines() const;
+};
+
+// Compiles the light shader variants on first request. Variants that expand to the same
+// defines share a program, and prepared variants compile in the background when the
+// driver offers KHR_parallel_shader_compile.
+class ShaderLibrary
+{
+public:
+	ShaderLibrary(const ShaderCache* cache);
+	~ShaderLibrary();
+	ShaderLibrary(const ShaderLibrary&) = delete;
+	ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+	void prepare(const ShaderVariant& variant);
+	Shader* get(const ShaderVariant& variant);
+	Shader* getCulling(CullPass pass);
+	Shader* getDepthReduction();
+	unsigned takeUniformLookups();
+	std::string getError();
+
+private:
+	struct Program
+	{
+		Shader* shader;
+		bool finished;
+		bool failed;
+	};
+
+	Program& request(const ShaderVariant& variant);
+	Shader* getCompute(int id, const std::string& defines);
+	static std::string loadResource(int id);
+
+	const ShaderCache* cache;
+	std::string vertexSource;
+	std::string fragmentSource;
+	std::unordered_map<uint64_t, Program> programs;
+	std::unordered_map<uint32_t, Program*> variants;
+	std::unordered_map<uint64_t, Program> computePrograms;
+	std::string error;
+};
@@ -0,0 +1,548 @@
+#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFTWARE_RENDERER_SSE
+#endif
+
+namespace
+{
+	const int tileSize = 64;
+	const int blockSize = 8;
+	const size_t triangleGrain = 16384;
+
+	// Pixels name their nearest triangle by batch and index within the batch. Clipping
+	// turns a triangle into at most six, so a batch never exceeds 2^17 of them.
+	const unsigned localBits = 17;
+	const uint32_t localMask = (1u << localBits) - 1;
+	const uint32_t noTriangle = ~0u;
+
+	// A near plane and the four section planes of the frame.
+	const int maxPlanes = 1 + static_cast<int>(maxClipPlanes);
+	const int maxClippedVertices = 3 + maxPlanes;
+
+	// The Phong model of light.frag for one fragment.
+	glm::vec4 shadeFragment(const FrameBlock& frame, const ObjectBlock& object, unsigned lightCount, const glm::vec3& position, const glm::vec3& normal)
+	{
+		const glm::vec3 norm = glm::normalize(normal);
+		const bool specular = object.material.x > 0.0f;
+		const glm::vec3 viewDir = glm::normalize(glm::vec3(frame.cameraPosition) - position);
+		glm::vec3 light(frame.ambientLight);
+		for (unsigned i = 0; i < lightCount; ++i)
+		{
+			const glm::vec3 lightDir = glm::normalize(glm::vec3(frame.lightPositions[i]) - position);
+			const glm::vec3 lightColour(frame.lightColours[i]);
+			light += std::max(glm::dot(norm, lightDir), 0.0f) * lightColour;
+			if (specular)
+			{
+				const glm::vec3 reflectDir = 2.0f * glm::dot(norm, lightDir) * norm - lightDir;
+				light += object.material.x * std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), object.material.y) * lightColour;
+			}
+		}
+		return glm::vec4(light, 1.0f) * object.objColour;
+	}
+
+	uint8_t toByte(float value)
+	{
+		return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer(int width, int height) :
+	width(width),
+	height(height),
+	tilesX(0),
+	tilesY(0),
+	blocksX(0),
+	triangleCount(0),
+	seconds(0.0)
+{
+	if (width <= 0 || height <= 0)
+	{
+		throw std::runtime_error("Cannot create a software render target of that size!");
+	}
+
+	// The buffers cover whole blocks, so rows of eight pixels never need a tail.
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	blocksX = (width + blockSize - 1) / blockSize;
+	const int blocksY = (height + blockSize - 1) / blockSize;
+	depthBuffer.resize(static_cast<size_t>(blocksX) * blockSize * blocksY * blockSize);
+	triangleBuffer.resize(depthBuffer.size());
+	blockDepths.resize(static_cast<size_t>(blocksX) * blocksY);
+	pixels.resize(static_cast<size_t>(width) * height * 4);
+}
+
+// objects holds the blocks Graphics uploads for the model's instances, in instance order.
+// Points and lines are not drawn.
+void SoftwareRenderer::render(const Model& model, const FrameBlock& frame, const std::vector<ObjectBlock>& objects, unsigned lightCount)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::fill(depthBuffer.begin(), depthBuffer.end(), 1.0f);
+	std::fill(triangleBuffer.begin(), triangleBuffer.end(), noTriangle);
+	std::fill(blockDepths.begin(), blockDepths.end(), 1.0f);
+
+	const std::vector<Model::Primitive>& primitives = model.getPrimitives();
+	const std::vector<Model::Instance>& instances = model.getInstances();
+	batches.clear();
+	triangleCount = 0;
+	for (size_t i = 0; i < instances.size() && i < objects.size(); ++i)
+	{
+		const Model::Primitive& primitive = primitives[instances[i].primitive];
+		if (primitive.mode != GL_TRIANGLES || primitive.count <= 0)
+		{
+			continue;
+		}
+
+		const size_t count = static_cast<size_t>(primitive.count) / 3;
+		for (size_t first = 0; first < count; first += triangleGrain)
+		{
+			Batch batch;
+			batch.object = i;
+			batch.primitive = instances[i].primitive;
+			batch.firstTriangle = first;
+			batch.triangleCount = std::min(triangleGrain, count - first);
+			batches.push_back(std::move(batch));
+		}
+		triangleCount += count;
+	}
+
+	ThreadPool& pool = ThreadPool::instance();
+	pool.parallelFor(batches.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			setup(model, frame, objects, batches[i]);
+		}
+	});
+
+	lightCount = std::min(lightCount, maxLights);
+	const bool derivedNormals = model.getNormals().empty();
+	pool.parallelFor(static_cast<size_t>(tilesX) * tilesY, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t tile = begin; tile < end; ++tile)
+		{
+			rasterize(tile);
+			shade(tile, frame, objects, lightCount, derivedNormals);
+		}
+	});
+
+	seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Transforms the batch's triangles as light.vert does, clips them against the near plane
+// and the section planes, and lists them in every tile their pixels may fall in.
+void SoftwareRenderer::setup(const Model& model, const FrameBlock& frame, const std::vector<ObjectBlock>& objects, Batch& batch) const
+{
+	const std::vector<glm::vec3>& vertices = model.getVertices();
+	const std::vector<glm::vec3>& normals = model.getNormals();
+	const std::vector<unsigned int>& indices = model.getIndices();
+	const Model::Primitive& primitive = model.getPrimitives()[batch.primitive];
+	const ObjectBlock& object = objects[batch.object];
+	const glm::mat3 normalMatrix(object.normalMatrix);
+	const bool derivedNormal = normals.empty();
+	const size_t firstIndex = primitive.indexOffset / sizeof(unsigned int);
+	const uint32_t objectIndex = static_cast<uint32_t>(batch.object);
+
+	// Planes are kept as (plane, in clip space) pairs; unused section planes are zero.
+	glm::vec4 planes[maxPlanes];
+	bool clipSpace[maxPlanes];
+	int planeCount = 0;
+	planes[planeCount] = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	clipSpace[planeCount++] = true;
+	for (unsigned i = 0; i < maxClipPlanes; ++i)
+	{
+		if (frame.clipPlanes[i] != glm::vec4(0.0f))
+		{
+			planes[planeCount] = frame.clipPlanes[i];
+			clipSpace[planeCount++] = false;
+		}
+	}
+
+	const auto distance = [&](const Vertex& vertex, int plane)
+	{
+		return clipSpace[plane] ? glm::dot(planes[plane], vertex.clip) : glm::dot(planes[plane], glm::vec4(vertex.position, 1.0f));
+	};
+
+	batch.triangles.clear();
+	batch.triangles.reserve(batch.triangleCount);
+	for (size_t triangle = batch.firstTriangle; triangle < batch.firstTriangle + batch.triangleCount; ++triangle)
+	{
+		Vertex corners[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			const size_t element = triangle * 3 + k;
+			const size_t index = primitive.indexType ? indices[firstIndex + element] : element;
+			corners[k].position = glm::vec3(object.modelMatrix * glm::vec4(vertices[index], 1.0f));
+			corners[k].normal = derivedNormal ? glm::vec3(0.0f) : normalMatrix * normals[index];
+			corners[k].clip = frame.viewProjectionMatrix * glm::vec4(corners[k].position, 1.0f);
+		}
+
+		// Triangles entirely beside the view are dropped before any clipping.
+		bool outside = false;
+		for (int axis = 0; axis < 2 && !outside; ++axis)
+		{
+			outside = (corners[0].clip[axis] > corners[0].clip.w && corners[1].clip[axis] > corners[1].clip.w && corners[2].clip[axis] > corners[2].clip.w) ||
+				(corners[0].clip[axis] < -corners[0].clip.w && corners[1].clip[axis] < -corners[1].clip.w && corners[2].clip[axis] < -corners[2].clip.w);
+		}
+		if (outside)
+		{
+			continue;
+		}
+
+		bool inside = true;
+		for (int plane = 0; plane < planeCount && inside; ++plane)
+		{
+			inside = distance(corners[0], plane) >= 0.0f && distance(corners[1], plane) >= 0.0f && distance(corners[2], plane) >= 0.0f;
+		}
+		if (inside)
+		{
+			addTriangle(corners, objectIndex, derivedNormal, batch.triangles);
+			continue;
+		}
+
+		// Sutherland-Hodgman against each plane, then a fan over what is left.
+		Vertex polygon[maxClippedVertices];
+		Vertex clipped[maxClippedVertices];
+		int count = 3;
+		std::copy(corners, corners + 3, polygon);
+		for (int plane = 0; plane < planeCount && count >= 3; ++plane)
+		{
+			int clippedCount = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const Vertex& a = polygon[i];
+				const Vertex& b = polygon[(i + 1) % count];
+				const float distanceA = distance(a, plane);
+				const float distanceB = distance(b, plane);
+				if (distanceA >= 0.0f)
+				{
+					clipped[clippedCount++] = a;
+				}
+
+				if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+				{
+					const float t = distanceA / (distanceA - distanceB);
+					Vertex& vertex = clipped[clippedCount++];
+					vertex.clip = a.clip + (b.clip - a.clip) * t;
+					vertex.position = a.position + (b.position - a.position) * t;
+					vertex.normal = a.normal + (b.normal - a.normal) * t;
+				}
+			}
+			std::copy(clipped, clipped + clippedCount, polygon);
+			count = clippedCount;
+		}
+
+		for (int i = 1; i + 1 < count; ++i)
+		{
+			const Vertex fan[3] = { polygon[0], polygon[i], polygon[i + 1] };
+			addTriangle(fan, objectIndex, derivedNormal, batch.triangles);
+		}
+	}
+
+	// Counting sort of the triangles into tiles, keeping their order within each tile.
+	const size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+	batch.binStarts.assign(tileCount + 1, 0);
+	for (const Triangle& triangle : batch.triangles)
+	{
+		for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty)
+		{
+			for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx)
+			{
+				++batch.binStarts[ty * tilesX + tx + 1];
+			}
+		}
+	}
+
+	for (size_t tile = 0; tile < tileCount; ++tile)
+	{
+		batch.binStarts[tile + 1] += batch.binStarts[tile];
+	}
+
+	std::vector<uint32_t> next(batch.binStarts.begin(), batch.binStarts.end() - 1);
+	batch.binTriangles.resize(batch.binStarts.back());
+	for (uint32_t i = 0; i < batch.triangles.size(); ++i)
+	{
+		const Triangle& triangle = batch.triangles[i];
+		for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty)
+		{
+			for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx)
+			{
+				batch.binTriangles[next[ty * tilesX + tx]++] = i;
+			}
+		}
+	}
+}
+
+// Projects a clipped triangle to the screen. Triangles that cover no pixel centre are
+// dropped; both windings are kept, since the GL path does not cull back faces.
+void SoftwareRenderer::addTriangle(const Vertex (&vertices)[3], uint32_t object, bool derivedNormal, std::vector<Triangle>& triangles) const
+{
+	glm::vec3 screen[3];
+	Triangle triangle;
+	for (int k = 0; k < 3; ++k)
+	{
+		triangle.inverseW[k] = 1.0f / vertices[k].clip.w;
+		const glm::vec3 device = glm::vec3(vertices[k].clip) * triangle.inverseW[k];
+		screen[k] = glm::vec3((device.x * 0.5f + 0.5f) * width, (device.y * 0.5f + 0.5f) * height, device.z * 0.5f + 0.5f);
+	}
+
+	const float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+	if (!(std::abs(area) > 1e-12f))
+	{
+		return;
+	}
+
+	// Pixel centres lie at half-integer coordinates.
+	const float lowX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+	const float highX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+	const float lowY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+	const float highY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+	triangle.minX = std::max(0, static_cast<int>(std::ceil(lowX - 0.5f)));
+	triangle.maxX = std::min(width - 1, static_cast<int>(std::floor(highX - 0.5f)));
+	triangle.minY = std::max(0, static_cast<int>(std::ceil(lowY - 0.5f)));
+	triangle.maxY = std::min(height - 1, static_cast<int>(std::floor(highY - 0.5f)));
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+	{
+		return;
+	}
+
+	// The weight of each vertex is the edge function of the opposite edge over the area.
+	triangle.origin = glm::vec2(screen[0].x, screen[0].y);
+	for (int k = 0; k < 3; ++k)
+	{
+		const glm::vec3& first = screen[(k + 1) % 3];
+		const glm::vec3& second = screen[(k + 2) % 3];
+		const glm::vec2 a(first.x - triangle.origin.x, first.y - triangle.origin.y);
+		const glm::vec2 b(second.x - triangle.origin.x, second.y - triangle.origin.y);
+		triangle.edgeX[k] = -(b.y - a.y) / area;
+		triangle.edgeY[k] = (b.x - a.x) / area;
+		triangle.edgeConstant[k] = ((b.y - a.y) * a.x - (b.x - a.x) * a.y) / area;
+	}
+
+	const glm::vec3 depths(screen[0].z, screen[1].z, screen[2].z);
+	triangle.depth = glm::vec3(glm::dot(triangle.edgeX, depths), glm::dot(triangle.edgeY, depths), glm::dot(triangle.edgeConstant, depths));
+	triangle.minDepth = std::min(depths.x, std::min(depths.y, depths.z));
+
+	// Without normals the shader takes the face normal from screen derivatives.
+	const glm::vec3 faceNormal = glm::cross(vertices[1].position - vertices[0].position, vertices[2].position - vertices[0].position);
+	for (int k = 0; k < 3; ++k)
+	{
+		triangle.positions[k] = vertices[k].position * triangle.inverseW[k];
+		triangle.normals[k] = (derivedNormal ? faceNormal : vertices[k].normal) * triangle.inverseW[k];
+	}
+	triangle.object = object;
+	triangles.push_back(triangle);
+}
+
+// Finds the nearest triangle of every pixel of the tile, in submission order.
+void SoftwareRenderer::rasterize(size_t tile)
+{
+	const int stride = blocksX * blockSize;
+	const int tileX = static_cast<int>(tile % tilesX) * tileSize;
+	const int tileY = static_cast<int>(tile / tilesX) * tileSize;
+	const int tileRight = std::min(tileX + tileSize, width) - 1;
+	const int tileTop = std::min(tileY + tileSize, height) - 1;
+
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		const Batch& batch = batches[b];
+		for (uint32_t bin = batch.binStarts[tile]; bin < batch.binStarts[tile + 1]; ++bin)
+		{
+			const uint32_t local = batch.binTriangles[bin];
+			const Triangle& triangle = batch.triangles[local];
+			const uint32_t id = static_cast<uint32_t>(b) << localBits | local;
+			const int minX = std::max(triangle.minX, tileX);
+			const int maxX = std::min(triangle.maxX, tileRight);
+			const int minY = std::max(triangle.minY, tileY);
+			const int maxY = std::min(triangle.maxY, tileTop);
+
+			for (int blockY = minY / blockSize; blockY <= maxY / blockSize; ++blockY)
+			{
+				for (int blockX = minX / blockSize; blockX <= maxX / blockSize; ++blockX)
+				{
+					// Hierarchical depth: the block already hides everything behind its farthest pixel.
+					float& blockDepth = blockDepths[blockY * blocksX + blockX];
+					if (triangle.minDepth >= blockDepth)
+					{
+						continue;
+					}
+
+					// Each edge function is largest at one corner of the block.
+					const float left = blockX * blockSize + 0.5f - triangle.origin.x;
+					const float bottom = blockY * blockSize + 0.5f - triangle.origin.y;
+					const float right = left + blockSize - 1;
+					const float top = bottom + blockSize - 1;
+					bool outside = false;
+					for (int k = 0; k < 3 && !outside; ++k)
+					{
+						const float highest = triangle.edgeConstant[k] + triangle.edgeX[k] * (triangle.edgeX[k] > 0.0f ? right : left) + triangle.edgeY[k] * (triangle.edgeY[k] > 0.0f ? top : bottom);
+						outside = highest < 0.0f;
+					}
+					if (outside)
+					{
+						continue;
+					}
+
+					bool written = false;
+					const int firstRow = std::max(blockY * blockSize, minY);
+					const int lastRow = std::min(blockY * blockSize + blockSize - 1, maxY);
+#ifdef SOFTWARE_RENDERER_SSE
+					const __m128 zero = _mm_setzero_ps();
+					const __m128 edgeX0 = _mm_set1_ps(triangle.edgeX.x);
+					const __m128 edgeX1 = _mm_set1_ps(triangle.edgeX.y);
+					const __m128 edgeX2 = _mm_set1_ps(triangle.edgeX.z);
+					const __m128 depthX = _mm_set1_ps(triangle.depth.x);
+					const __m128 ids = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(id)));
+					for (int y = firstRow; y <= lastRow; ++y)
+					{
+						const float centreY = y + 0.5f - triangle.origin.y;
+						const __m128 row0 = _mm_set1_ps(triangle.edgeY.x * centreY + triangle.edgeConstant.x);
+						const __m128 row1 = _mm_set1_ps(triangle.edgeY.y * centreY + triangle.edgeConstant.y);
+						const __m128 row2 = _mm_set1_ps(triangle.edgeY.z * centreY + triangle.edgeConstant.z);
+						const __m128 rowDepth = _mm_set1_ps(triangle.depth.y * centreY + triangle.depth.z);
+						for (int x = blockX * blockSize; x < blockX * blockSize + blockSize; x += 4)
+						{
+							const __m128 centreX = _mm_add_ps(_mm_set1_ps(x - triangle.origin.x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+							__m128 mask = _mm_and_ps(
+								_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX0, centreX), row0), zero), _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX1, centreX), row1), zero)),
+								_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX2, centreX), row2), zero));
+							if (_mm_movemask_ps(mask) == 0)
+							{
+								continue;
+							}
+
+							float* depths = &depthBuffer[static_cast<size_t>(y) * stride + x];
+							uint32_t* triangles = &triangleBuffer[static_cast<size_t>(y) * stride + x];
+							const __m128 depth = _mm_add_ps(_mm_mul_ps(depthX, centreX), rowDepth);
+							const __m128 stored = _mm_loadu_ps(depths);
+							mask = _mm_and_ps(mask, _mm_cmplt_ps(depth, stored));
+							if (_mm_movemask_ps(mask) == 0)
+							{
+								continue;
+							}
+
+							const __m128 storedIds = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(triangles)));
+							_mm_storeu_ps(depths, _mm_or_ps(_mm_and_ps(mask, depth), _mm_andnot_ps(mask, stored)));
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(triangles), _mm_castps_si128(_mm_or_ps(_mm_and_ps(mask, ids), _mm_andnot_ps(mask, storedIds))));
+							written = true;
+						}
+					}
+#else
+					for (int y = firstRow; y <= lastRow; ++y)
+					{
+						const float centreY = y + 0.5f - triangle.origin.y;
+						for (int x = blockX * blockSize; x < blockX * blockSize + blockSize; ++x)
+						{
+							const float centreX = x + 0.5f - triangle.origin.x;
+							const glm::vec3 weights = triangle.edgeX * centreX + triangle.edgeY * centreY + triangle.edgeConstant;
+							if (weights.x < 0.0f || weights.y < 0.0f || weights.z < 0.0f)
+							{
+								continue;
+							}
+
+							const size_t pixel = static_cast<size_t>(y) * stride + x;
+							const float depth = triangle.depth.x * centreX + triangle.depth.y * centreY + triangle.depth.z;
+							if (depth < depthBuffer[pixel])
+							{
+								depthBuffer[pixel] = depth;
+								triangleBuffer[pixel] = id;
+								written = true;
+							}
+						}
+					}
+#endif
+
+					if (written)
+					{
+						float farthest = 0.0f;
+						for (int y = blockY * blockSize; y < blockY * blockSize + blockSize; ++y)
+						{
+							const float* row = &depthBuffer[static_cast<size_t>(y) * stride + blockX * blockSize];
+							farthest = std::max(farthest, *std::max_element(row, row + blockSize));
+						}
+						blockDepth = farthest;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Interpolates the world position and normal of each pixel's triangle with perspective
+// and lights it. Rows are flipped, since the rasterizer counts them from the bottom.
+void SoftwareRenderer::shade(size_t tile, const FrameBlock& frame, const std::vector<ObjectBlock>& objects, unsigned lightCount, bool derivedNormals)
+{
+	const int stride = blocksX * blockSize;
+	const int tileX = static_cast<int>(tile % tilesX) * tileSize;
+	const int tileY = static_cast<int>(tile / tilesX) * tileSize;
+	const glm::vec3 cameraPosition(frame.cameraPosition);
+
+	for (int y = tileY; y < std::min(tileY + tileSize, height); ++y)
+	{
+		for (int x = tileX; x < std::min(tileX + tileSize, width); ++x)
+		{
+			uint8_t* pixel = &pixels[(static_cast<size_t>(height - 1 - y) * width + x) * 4];
+			const uint32_t id = triangleBuffer[static_cast<size_t>(y) * stride + x];
+			if (id == noTriangle)
+			{
+				pixel[0] = 0;
+				pixel[1] = 0;
+				pixel[2] = 0;
+				pixel[3] = 255;
+				continue;
+			}
+
+			const Triangle& triangle = batches[id >> localBits].triangles[id & localMask];
+			const glm::vec3 weights = triangle.edgeX * (x + 0.5f - triangle.origin.x) + triangle.edgeY * (y + 0.5f - triangle.origin.y) + triangle.edgeConstant;
+			const float w = 1.0f / glm::dot(weights, triangle.inverseW);
+			const glm::vec3 position = (triangle.positions[0] * weights.x + triangle.positions[1] * weights.y + triangle.positions[2] * weights.z) * w;
+			glm::vec3 normal = triangle.normals[0] * weights.x + triangle.normals[1] * weights.y + triangle.normals[2] * weights.z;
+
+			// Screen derivatives give a normal that always faces the camera.
+			if (derivedNormals && glm::dot(normal, cameraPosition - position) < 0.0f)
+			{
+				normal = -normal;
+			}
+
+			const glm::vec4 colour = shadeFragment(frame, objects[triangle.object], lightCount, position, normal);
+			pixel[0] = toByte(colour.x);
+			pixel[1] = toByte(colour.y);
+			pixel[2] = toByte(colour.z);
+			pixel[3] = toByte(colour.w);
+		}
+	}
+}
+
+const std::vector<uint8_t>& SoftwareRenderer::getPixels() const
+{
+	return pixels;
+}
+
+int SoftwareRenderer::getWidth() const
+{
+	return width;
+}
+
+int SoftwareRenderer::getHeight() const
+{
+	return height;
+}
+
+// Triangles submitted in the last frame, before clipping.
+size_t SoftwareRenderer::getTriangleCount() const
+{
+	return triangleCount;
+}
+
+// Millions of submitted triangles per second over the whole of the last frame.
+double SoftwareRenderer::getThroughput() const
+{
+	return seconds > 0.0 ? triangleCount / seconds * 1e-6 : 0.0;
+}
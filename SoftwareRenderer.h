@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Model.h"
+#include "ShaderBlocks.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Draws the triangles of a model on the CPU with the matrices and lighting of the GL
+// path, for servers without any OpenGL driver. Triangles are set up and sorted into
+// screen tiles in parallel, then every tile is rasterized on its own thread: edge
+// functions are evaluated for four pixels at a time, and 8x8 blocks whose farthest depth
+// lies in front of a triangle are skipped. Rasterizing only records the nearest
+// triangle per pixel, so each visible pixel is shaded once with the Phong model of
+// light.frag. Pixels are RGBA8 rows, top row first, as HeadlessContext reads them back.
+class SoftwareRenderer
+{
+public:
+	SoftwareRenderer(int width, int height);
+	~SoftwareRenderer() = default;
+	void render(const Model& model, const FrameBlock& frame, const std::vector<ObjectBlock>& objects, unsigned lightCount = 1);
+	const std::vector<uint8_t>& getPixels() const;
+	int getWidth() const;
+	int getHeight() const;
+	size_t getTriangleCount() const;
+	double getThroughput() const;
+
+private:
+	struct Vertex
+	{
+		glm::vec4 clip;
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	// Edge functions and depth are scaled so that, at a pixel centre, the edges give the
+	// screen-space barycentric weights. They are taken relative to the first vertex,
+	// which keeps slivers precise far from the screen origin. Attributes are stored
+	// divided by w so they can be interpolated with perspective.
+	struct Triangle
+	{
+		glm::vec2 origin;
+		glm::vec3 edgeX;
+		glm::vec3 edgeY;
+		glm::vec3 edgeConstant;
+		glm::vec3 depth;
+		float minDepth;
+		glm::vec3 inverseW;
+		glm::vec3 positions[3];
+		glm::vec3 normals[3];
+		uint32_t object;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+
+	// A run of triangles of one object, set up by one job. Its triangles are listed per
+	// tile in submission order.
+	struct Batch
+	{
+		size_t object;
+		size_t primitive;
+		size_t firstTriangle;
+		size_t triangleCount;
+		std::vector<Triangle> triangles;
+		std::vector<uint32_t> binStarts;
+		std::vector<uint32_t> binTriangles;
+	};
+
+	void setup(const Model& model, const FrameBlock& frame, const std::vector<ObjectBlock>& objects, Batch& batch) const;
+	void addTriangle(const Vertex (&vertices)[3], uint32_t object, bool derivedNormal, std::vector<Triangle>& triangles) const;
+	void rasterize(size_t tile);
+	void shade(size_t tile, const FrameBlock& frame, const std::vector<ObjectBlock>& objects, unsigned lightCount, bool derivedNormals);
+
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	int blocksX;
+	std::vector<float> depthBuffer;
+	std::vector<uint32_t> triangleBuffer;
+	std::vector<float> blockDepths;
+	std::vector<uint8_t> pixels;
+	std::vector<Batch> batches;
+	size_t triangleCount;
+	double seconds;
+};
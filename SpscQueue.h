@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+// Each side owns one index and only reads the other's, so neither ever waits: push
+// fails when the queue is full and pop fails when it is empty. The indices sit on
+// separate cache lines so that the two threads do not contend for one.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+	SpscQueue() :
+		head(0),
+		tail(0)
+	{
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	bool push(T value)
+	{
+		const size_t index = tail.load(std::memory_order_relaxed);
+		if (index - head.load(std::memory_order_acquire) == Capacity)
+		{
+			return false;
+		}
+
+		slots[index % Capacity] = std::move(value);
+		tail.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value)
+	{
+		const size_t index = head.load(std::memory_order_relaxed);
+		if (index == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		value = std::move(slots[index % Capacity]);
+		head.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two.");
+	static const size_t cacheLine = 64;
+
+	T slots[Capacity];
+	std::atomic<size_t> head;
+	char headPadding[cacheLine - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> tail;
+	char tailPadding[cacheLine - sizeof(std::atomic<size_t>)];
+};
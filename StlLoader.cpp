@@ -0,0 +1,146 @@
+#include "StlLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	const size_t headerSize = 84;
+	const size_t recordSize = 50;
+	const size_t triangleGrain = 1 << 14;
+}
+
+bool StlLoader::load(const std::string& filename, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	MappedFile file(filename);
+	if (!file.isOpen())
+	{
+		error = "Cannot open STL file!";
+		return false;
+	}
+
+	if (file.size() < headerSize)
+	{
+		error = "STL file is truncated!";
+		return false;
+	}
+
+	if (isAscii(file.data(), std::min<size_t>(file.size(), 512)))
+	{
+		error = "Only binary STL is read natively!";
+		return false;
+	}
+
+	uint32_t count;
+	std::memcpy(&count, file.data() + 80, sizeof(count));
+	if (count > (file.size() - headerSize) / recordSize)
+	{
+		error = "STL triangle data is truncated!";
+		return false;
+	}
+
+	resizeTriangles(count, vertices, normals, indices);
+	convertTriangles(file.data() + headerSize, 0, count, vertices, normals, indices);
+	return true;
+}
+
+bool StlLoader::load(GzipStream& stream, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	if (!stream.fill(headerSize))
+	{
+		error = stream.hasError() ? stream.getError() : "STL file is truncated!";
+		return false;
+	}
+
+	if (isAscii(stream.data(), std::min<size_t>(stream.available(), 512)))
+	{
+		error = "Only binary STL is read natively!";
+		return false;
+	}
+
+	uint32_t count;
+	std::memcpy(&count, stream.data() + 80, sizeof(count));
+	stream.consume(headerSize);
+	resizeTriangles(count, vertices, normals, indices);
+
+	for (size_t done = 0; done < count;)
+	{
+		if (!stream.fill(recordSize))
+		{
+			error = stream.hasError() ? stream.getError() : "STL triangle data is truncated!";
+			return false;
+		}
+
+		const size_t batch = std::min<size_t>(count - done, stream.available() / recordSize);
+		convertTriangles(stream.data(), done, batch, vertices, normals, indices);
+		stream.consume(batch * recordSize);
+		done += batch;
+	}
+
+	if (!stream.drain())
+	{
+		error = stream.getError();
+		return false;
+	}
+
+	return true;
+}
+
+std::string StlLoader::getError() const
+{
+	return error;
+}
+
+bool StlLoader::isAscii(const char* data, size_t size)
+{
+	if (size < 5 || std::strncmp(data, "solid", 5) != 0)
+	{
+		return false;
+	}
+
+	// Binary headers may also begin with "solid", but the triangle count and floats that follow are not text.
+	return std::all_of(data, data + size, [](char c)
+	{
+		return (c >= 32 && c < 127) || c == '\n' || c == '\r' || c == '\t';
+	});
+}
+
+// Every triangle keeps its own three vertices so its facet normal shades it flat.
+void StlLoader::resizeTriangles(size_t count, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	vertices.resize(count * 3);
+	normals.resize(count * 3);
+	indices.resize(count * 3);
+}
+
+void StlLoader::convertTriangles(const char* body, size_t first, size_t count, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices)
+{
+	ThreadPool::instance().parallelFor(count, triangleGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const char* record = body + i * recordSize;
+			const size_t corner = (first + i) * 3;
+
+			glm::vec3 normal;
+			std::memcpy(&normal, record, sizeof(glm::vec3));
+			std::memcpy(&vertices[corner], record + 12, 3 * sizeof(glm::vec3));
+
+			// Many exporters leave the facet normal zeroed.
+			if (glm::dot(normal, normal) == 0.0f)
+			{
+				normal = glm::cross(vertices[corner + 1] - vertices[corner], vertices[corner + 2] - vertices[corner]);
+				const float length = glm::length(normal);
+				normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, -1.0f);
+			}
+
+			for (size_t k = 0; k < 3; ++k)
+			{
+				normals[corner + k] = normal;
+				indices[corner + k] = static_cast<unsigned int>(corner + k);
+			}
+		}
+	});
+}
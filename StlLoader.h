@@ -0,0 +1,26 @@
+#pragma once
+
+#include "GzipStream.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Native reader for binary STL. Plain files are memory mapped and compressed ones are
+// converted block by block as they are decompressed, in both cases on the thread pool;
+// ASCII files are left to Assimp.
+class StlLoader
+{
+public:
+	StlLoader() = default;
+	~StlLoader() = default;
+	bool load(const std::string& filename, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+	bool load(GzipStream& stream, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+	std::string getError() const;
+
+private:
+	static bool isAscii(const char* data, size_t size);
+	static void resizeTriangles(size_t count, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+	static void convertTriangles(const char* body, size_t first, size_t count, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices);
+
+	std::string error;
+};
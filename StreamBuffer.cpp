@@ -0,0 +1,159 @@
+#include "StreamBuffer.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	const GLbitfield storageFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLuint64 stallTimeout = 1000000000;
+}
+
+StreamBuffer::StreamBuffer(size_t regionSize) :
+	buffer(0),
+	mapped(nullptr),
+	regionSize(0),
+	region(0),
+	used(0),
+	stalls(0),
+	fences{}
+{
+	create(std::max<size_t>(regionSize, 256));
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+		}
+	}
+
+	// The GL keeps deleted buffers alive until pending draws are done with them, and
+	// deleting a buffer also unmaps it.
+	releaseRetired(true);
+	GLState::instance().deleteBuffers(1, &buffer);
+}
+
+bool StreamBuffer::isSupported()
+{
+	return GLAD_GL_VERSION_4_4 && glBufferStorage && glFenceSync && glClientWaitSync;
+}
+
+void StreamBuffer::beginFrame()
+{
+	region = (region + 1) % regionCount;
+	used = 0;
+	waitForRegion();
+	releaseRetired(false);
+}
+
+void StreamBuffer::endFrame()
+{
+	if (fences[region])
+	{
+		glDeleteSync(fences[region]);
+	}
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// Buffers outgrown this frame are last used by it.
+	for (Retired& old : retired)
+	{
+		if (!old.fence)
+		{
+			old.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+	}
+}
+
+// Alignment must be a power of two, such as GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+StreamBuffer::Allocation StreamBuffer::allocate(size_t size, size_t alignment)
+{
+	size_t offset = (used + alignment - 1) & ~(alignment - 1);
+	if (offset + size > regionSize)
+	{
+		// The frame goes on in a region of a buffer with room for twice what it needs.
+		retired.push_back({ buffer, nullptr });
+		for (GLsync& fence : fences)
+		{
+			if (fence)
+			{
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		create(std::max(regionSize * 2, (offset + size) * 2));
+		offset = 0;
+	}
+
+	used = offset + size;
+	return { mapped + region * regionSize + offset, buffer, region * regionSize + offset };
+}
+
+unsigned StreamBuffer::takeStalls()
+{
+	const unsigned count = stalls;
+	stalls = 0;
+	return count;
+}
+
+void StreamBuffer::create(size_t size)
+{
+	regionSize = size;
+	glGenBuffers(1, &buffer);
+	GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(regionCount * regionSize), nullptr, storageFlags);
+	mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(regionCount * regionSize), storageFlags));
+	if (!mapped)
+	{
+		throw std::runtime_error("Cannot map the stream buffer!");
+	}
+}
+
+// The fence is polled first, so a region the GPU is done with costs no flush.
+void StreamBuffer::waitForRegion()
+{
+	GLsync& fence = fences[region];
+	if (!fence)
+	{
+		return;
+	}
+
+	if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		Profiler::Zone zone("stream stall");
+		++stalls;
+		GLenum status = GL_TIMEOUT_EXPIRED;
+		while (status == GL_TIMEOUT_EXPIRED)
+		{
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, stallTimeout);
+		}
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void StreamBuffer::releaseRetired(bool all)
+{
+	GLState& state = GLState::instance();
+	for (auto old = retired.begin(); old != retired.end();)
+	{
+		const bool done = all || (old->fence && glClientWaitSync(old->fence, 0, 0) != GL_TIMEOUT_EXPIRED);
+		if (!done)
+		{
+			++old;
+			continue;
+		}
+
+		if (old->fence)
+		{
+			glDeleteSync(old->fence);
+		}
+		state.deleteBuffers(1, &old->buffer);
+		old = retired.erase(old);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <cstddef>
+#include <vector>
+
+// Ring of frame-sized regions in one buffer created with glBufferStorage and mapped once,
+// persistently and coherently, so data is written straight into memory the GPU reads
+// with no glBufferSubData and no implicit synchronization. Each frame hands out aligned
+// pieces of one region, and a fence placed at its end guards the region until the GPU has
+// finished with it. When the CPU comes back to a region before its fence has signalled,
+// the wait is counted as a stall and timed by the profiler. A frame that outgrows its
+// region moves to a larger buffer; the old one is deleted once its last frame is done.
+// Allocations last for the frame they were made in and can be bound to any target, as
+// uniform blocks, instance attributes or indirect commands.
+class StreamBuffer
+{
+public:
+	struct Allocation
+	{
+		char* data;
+		unsigned buffer;
+		size_t offset;
+	};
+
+	explicit StreamBuffer(size_t regionSize);
+	~StreamBuffer();
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+	static bool isSupported();
+	void beginFrame();
+	void endFrame();
+	Allocation allocate(size_t size, size_t alignment);
+	unsigned takeStalls();
+
+private:
+	static const size_t regionCount = 3;
+
+	struct Retired
+	{
+		unsigned buffer;
+		GLsync fence;
+	};
+
+	void create(size_t size);
+	void waitForRegion();
+	void releaseRetired(bool all);
+
+	unsigned buffer;
+	char* mapped;
+	size_t regionSize;
+	size_t region;
+	size_t used;
+	unsigned stalls;
+	GLsync fences[regionCount];
+	std::vector<Retired> retired;
+};
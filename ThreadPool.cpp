@@ -0,0 +1,164 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+	stopping(false)
+{
+	start(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+	return static_cast<unsigned>(threads.size()) + 1;
+}
+
+// Replaces the workers, for measuring how work scales with the thread count. No job may
+// be running.
+void ThreadPool::resize(unsigned threadCount)
+{
+	stop();
+	stopping = false;
+	start(threadCount);
+}
+
+void ThreadPool::start(unsigned threadCount)
+{
+	// The caller participates in every job, so one thread fewer is enough.
+	const unsigned workers = threadCount > 1 ? threadCount - 1 : 0;
+	for (unsigned i = 0; i < workers; ++i)
+	{
+		threads.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	threads.clear();
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& task)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	grain = std::max<size_t>(grain, 1);
+	if (threads.empty() || count <= grain)
+	{
+		task(0, count);
+		return;
+	}
+
+	auto job = std::make_shared<Job>();
+	job->task = &task;
+	job->count = count;
+	job->grain = grain;
+	job->chunks = (count + grain - 1) / grain;
+	job->next = 0;
+	job->finished = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	wake.notify_all();
+
+	runChunks(*job);
+	retire(job);
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&job] { return job->finished == job->chunks; });
+	}
+
+	if (job->exception)
+	{
+		std::rethrow_exception(job->exception);
+	}
+}
+
+void ThreadPool::worker()
+{
+	for (;;)
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty())
+			{
+				return;
+			}
+			job = jobs.front();
+		}
+
+		runChunks(*job);
+		retire(job);
+	}
+}
+
+void ThreadPool::runChunks(Job& job)
+{
+	for (;;)
+	{
+		const size_t chunk = job.next++;
+		if (chunk >= job.chunks)
+		{
+			return;
+		}
+
+		const size_t begin = chunk * job.grain;
+		const size_t end = std::min(begin + job.grain, job.count);
+		try
+		{
+			(*job.task)(begin, end);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(job.exceptionMutex);
+			if (!job.exception)
+			{
+				job.exception = std::current_exception();
+			}
+		}
+
+		if (++job.finished == job.chunks)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+	}
+}
+
+void ThreadPool::retire(const std::shared_ptr<Job>& job)
+{
+	// Every chunk has been handed out, so the job no longer needs to be visible to idle workers.
+	std::lock_guard<std::mutex> lock(mutex);
+	const auto it = std::find(jobs.begin(), jobs.end(), job);
+	if (it != jobs.end())
+	{
+		jobs.erase(it);
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker pool shared by the loaders and the renderer. The calling
+// thread always takes part in its own job, so parallelFor may be nested.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned threadCount);
+	~ThreadPool();
+	static ThreadPool& instance();
+	unsigned getThreadCount() const;
+	void resize(unsigned threadCount);
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& task);
+
+private:
+	struct Job
+	{
+		const std::function<void(size_t, size_t)>* task;
+		size_t count;
+		size_t grain;
+		size_t chunks;
+		std::atomic<size_t> next;
+		std::atomic<size_t> finished;
+		std::exception_ptr exception;
+		std::mutex exceptionMutex;
+	};
+
+	void start(unsigned threadCount);
+	void stop();
+	void worker();
+	void runChunks(Job& job);
+	void retire(const std::shared_ptr<Job>& job);
+
+	std::vector<std::thread> threads;
+	std::deque<std::shared_ptr<Job>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping;
+};
@@ -0,0 +1,513 @@
+#include "ThreeMfLoader.h"
+#include "ThreadPool.h"
+#include "ZipArchive.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const char defaultRootPart[] = "/3D/3dmodel.model";
+	const int maxComponentDepth = 32;
+
+	// Forward-only scanner over the tags of an XML buffer. Names and attribute values
+	// are reported as pointers into the buffer, so scanning allocates nothing.
+	class XmlScanner
+	{
+	public:
+		XmlScanner(const char* data, size_t size) :
+			p(data),
+			end(data + size),
+			name(nullptr),
+			nameLength(0),
+			attributeCount(0),
+			endTag(false),
+			emptyTag(false),
+			failed(false)
+		{
+		}
+
+		bool next()
+		{
+			for (;;)
+			{
+				p = static_cast<const char*>(std::memchr(p, '<', static_cast<size_t>(end - p)));
+				if (!p || ++p == end)
+				{
+					failed = p != nullptr;
+					return false;
+				}
+
+				if (*p == '?' || *p == '!')
+				{
+					// Declarations and comments carry no geometry.
+					const char terminator[] = "-->";
+					const bool isComment = end - p >= 3 && p[1] == '-' && p[2] == '-';
+					const char* close = isComment ? std::search(p, end, terminator, terminator + 3) : std::find(p, end, '>');
+					if (close == end)
+					{
+						failed = true;
+						return false;
+					}
+					p = close;
+					continue;
+				}
+
+				endTag = *p == '/';
+				if (endTag)
+				{
+					++p;
+				}
+
+				name = p;
+				while (p != end && !isSpace(*p) && *p != '/' && *p != '>')
+				{
+					++p;
+				}
+				nameLength = static_cast<size_t>(p - name);
+
+				attributeCount = 0;
+				emptyTag = false;
+				return readAttributes();
+			}
+		}
+
+		bool is(const char* localName) const
+		{
+			return matches(name, nameLength, localName);
+		}
+
+		bool isEndTag() const
+		{
+			return endTag;
+		}
+
+		bool isEmptyTag() const
+		{
+			return emptyTag;
+		}
+
+		bool hasError() const
+		{
+			return failed;
+		}
+
+		const char* find(const char* localName) const
+		{
+			for (size_t i = 0; i < attributeCount; ++i)
+			{
+				if (matches(attributes[i].name, attributes[i].nameLength, localName))
+				{
+					return attributes[i].value;
+				}
+			}
+			return nullptr;
+		}
+
+		std::string getString(const char* localName) const
+		{
+			for (size_t i = 0; i < attributeCount; ++i)
+			{
+				if (matches(attributes[i].name, attributes[i].nameLength, localName))
+				{
+					return std::string(attributes[i].value, attributes[i].valueLength);
+				}
+			}
+			return std::string();
+		}
+
+		// Values end at their closing quote, which stops strtof and strtol.
+		float getFloat(const char* localName) const
+		{
+			const char* value = find(localName);
+			return value ? std::strtof(value, nullptr) : 0.0f;
+		}
+
+		long getInt(const char* localName, long fallback) const
+		{
+			const char* value = find(localName);
+			return value ? std::strtol(value, nullptr, 10) : fallback;
+		}
+
+	private:
+		struct Attribute
+		{
+			const char* name;
+			size_t nameLength;
+			const char* value;
+			size_t valueLength;
+		};
+
+		bool readAttributes()
+		{
+			for (;;)
+			{
+				while (p != end && isSpace(*p))
+				{
+					++p;
+				}
+
+				if (p == end)
+				{
+					failed = true;
+					return false;
+				}
+
+				if (*p == '>')
+				{
+					++p;
+					return true;
+				}
+
+				if (*p == '/')
+				{
+					emptyTag = true;
+					++p;
+					continue;
+				}
+
+				const char* attributeName = p;
+				while (p != end && *p != '=' && !isSpace(*p) && *p != '>' && *p != '/')
+				{
+					++p;
+				}
+				const size_t attributeNameLength = static_cast<size_t>(p - attributeName);
+
+				while (p != end && isSpace(*p))
+				{
+					++p;
+				}
+				if (p == end || *p != '=')
+				{
+					failed = true;
+					return false;
+				}
+				++p;
+
+				while (p != end && isSpace(*p))
+				{
+					++p;
+				}
+				if (p == end || (*p != '"' && *p != '\''))
+				{
+					failed = true;
+					return false;
+				}
+
+				const char quote = *p++;
+				const char* value = p;
+				p = static_cast<const char*>(std::memchr(p, quote, static_cast<size_t>(end - p)));
+				if (!p)
+				{
+					failed = true;
+					return false;
+				}
+
+				if (attributeCount < maxAttributes)
+				{
+					attributes[attributeCount++] = { attributeName, attributeNameLength, value, static_cast<size_t>(p - value) };
+				}
+				++p;
+			}
+		}
+
+		static bool isSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+		}
+
+		// Compares the part after any namespace prefix.
+		static bool matches(const char* text, size_t length, const char* localName)
+		{
+			const char* colon = static_cast<const char*>(std::memchr(text, ':', length));
+			if (colon)
+			{
+				length -= static_cast<size_t>(colon + 1 - text);
+				text = colon + 1;
+			}
+			return std::strlen(localName) == length && std::memcmp(text, localName, length) == 0;
+		}
+
+		static const size_t maxAttributes = 16;
+
+		const char* p;
+		const char* end;
+		const char* name;
+		size_t nameLength;
+		Attribute attributes[maxAttributes];
+		size_t attributeCount;
+		bool endTag;
+		bool emptyTag;
+		bool failed;
+	};
+
+	// 3MF stores row-major 4x3 matrices for row vectors; GLM uses column vectors.
+	glm::mat4 parseTransform(const char* value)
+	{
+		glm::mat4 transform(1.0f);
+		if (!value)
+		{
+			return transform;
+		}
+
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int column = 0; column < 3; ++column)
+			{
+				char* next = nullptr;
+				transform[row][column] = std::strtof(value, &next);
+				value = next;
+			}
+		}
+		return transform;
+	}
+
+	bool endsWith(const std::string& text, const std::string& suffix)
+	{
+		if (text.size() < suffix.size())
+		{
+			return false;
+		}
+
+		return std::equal(suffix.rbegin(), suffix.rend(), text.rbegin(), [](char a, char b)
+		{
+			return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+		});
+	}
+}
+
+bool ThreeMfLoader::load(const std::string& filename, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, std::vector<Model::Primitive>& primitives, std::vector<Model::Instance>& instances)
+{
+	ZipArchive archive(filename);
+	if (!archive.isOpen())
+	{
+		error = archive.getError();
+		return false;
+	}
+
+	std::vector<const ZipArchive::Entry*> modelEntries;
+	std::string rootPath = defaultRootPart;
+	for (const ZipArchive::Entry& entry : archive.getEntries())
+	{
+		if (endsWith(entry.name, ".model"))
+		{
+			modelEntries.push_back(&entry);
+		}
+		else if (entry.name == "_rels/.rels")
+		{
+			std::vector<char> relationships;
+			if (archive.extract(entry, relationships))
+			{
+				const std::string target = findRootPart(relationships.data(), relationships.size());
+				if (!target.empty())
+				{
+					rootPath = target[0] == '/' ? target : "/" + target;
+				}
+			}
+		}
+	}
+
+	std::vector<Part> parts(modelEntries.size());
+	ThreadPool::instance().parallelFor(parts.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			std::vector<char> xml;
+			parts[i].path = "/" + modelEntries[i]->name;
+			if (!archive.extract(*modelEntries[i], xml))
+			{
+				parts[i].error = "Cannot inflate " + modelEntries[i]->name;
+			}
+			else
+			{
+				parsePart(xml.data(), xml.size(), parts[i]);
+			}
+		}
+	});
+
+	const Part* root = nullptr;
+	for (const Part& part : parts)
+	{
+		if (!part.error.empty())
+		{
+			error = part.error;
+			return false;
+		}
+
+		for (const Object& object : part.objects)
+		{
+			objects[ObjectKey(part.path, object.id)] = &object;
+		}
+
+		if (part.path == rootPath)
+		{
+			root = &part;
+		}
+	}
+
+	if (!root || root->buildItems.empty())
+	{
+		error = "3MF package has no build items!";
+		return false;
+	}
+
+	for (const Reference& item : root->buildItems)
+	{
+		if (!instantiate(ObjectKey(item.path.empty() ? root->path : item.path, item.objectId), item.transform, 0, instances))
+		{
+			return false;
+		}
+	}
+
+	// Mesh objects share one vertex and index buffer; their indices are rebased in parallel.
+	std::vector<size_t> firstVertex(meshes.size() + 1, 0);
+	std::vector<size_t> firstIndex(meshes.size() + 1, 0);
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		firstVertex[i + 1] = firstVertex[i] + meshes[i]->vertices.size();
+		firstIndex[i + 1] = firstIndex[i] + meshes[i]->indices.size();
+
+		Model::Primitive primitive;
+		primitive.vao = 0;
+		primitive.mode = GL_TRIANGLES;
+		primitive.indexType = GL_UNSIGNED_INT;
+		primitive.indexOffset = firstIndex[i] * sizeof(unsigned int);
+		primitive.count = static_cast<int>(meshes[i]->indices.size());
+		primitive.normals = true;
+		primitive.quantized = false;
+		primitives.push_back(primitive);
+	}
+
+	vertices.resize(firstVertex.back());
+	indices.resize(firstIndex.back());
+	ThreadPool::instance().parallelFor(meshes.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			std::copy(meshes[i]->vertices.begin(), meshes[i]->vertices.end(), vertices.begin() + firstVertex[i]);
+
+			const unsigned int base = static_cast<unsigned int>(firstVertex[i]);
+			std::transform(meshes[i]->indices.begin(), meshes[i]->indices.end(), indices.begin() + firstIndex[i], [base](unsigned int index) { return index + base; });
+		}
+	});
+
+	return true;
+}
+
+std::string ThreeMfLoader::getError() const
+{
+	return error;
+}
+
+bool ThreeMfLoader::parsePart(const char* data, size_t size, Part& part)
+{
+	XmlScanner xml(data, size);
+	Object* object = nullptr;
+	bool inBuild = false;
+
+	while (xml.next())
+	{
+		if (xml.is("object"))
+		{
+			object = nullptr;
+			if (!xml.isEndTag() && !xml.isEmptyTag())
+			{
+				part.objects.emplace_back();
+				object = &part.objects.back();
+				object->id = static_cast<int>(xml.getInt("id", -1));
+			}
+		}
+		else if (!object)
+		{
+			if (xml.is("build"))
+			{
+				inBuild = !xml.isEndTag() && !xml.isEmptyTag();
+			}
+			else if (inBuild && xml.is("item") && !xml.isEndTag())
+			{
+				part.buildItems.push_back({ xml.getString("path"), static_cast<int>(xml.getInt("objectid", -1)), parseTransform(xml.find("transform")) });
+			}
+		}
+		else if (xml.is("vertex"))
+		{
+			object->vertices.emplace_back(xml.getFloat("x"), xml.getFloat("y"), xml.getFloat("z"));
+		}
+		else if (xml.is("triangle"))
+		{
+			object->indices.push_back(static_cast<unsigned int>(xml.getInt("v1", -1)));
+			object->indices.push_back(static_cast<unsigned int>(xml.getInt("v2", -1)));
+			object->indices.push_back(static_cast<unsigned int>(xml.getInt("v3", -1)));
+		}
+		else if (xml.is("component") && !xml.isEndTag())
+		{
+			object->components.push_back({ xml.getString("path"), static_cast<int>(xml.getInt("objectid", -1)), parseTransform(xml.find("transform")) });
+		}
+	}
+
+	if (xml.hasError())
+	{
+		part.error = "Malformed XML in " + part.path;
+		return false;
+	}
+
+	for (const Object& parsed : part.objects)
+	{
+		const size_t vertexCount = parsed.vertices.size();
+		if (std::any_of(parsed.indices.begin(), parsed.indices.end(), [vertexCount](unsigned int index) { return index >= vertexCount; }))
+		{
+			part.error = "Triangle references a missing vertex in " + part.path;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::string ThreeMfLoader::findRootPart(const char* data, size_t size)
+{
+	XmlScanner xml(data, size);
+	while (xml.next())
+	{
+		if (xml.is("Relationship") && endsWith(xml.getString("Type"), "/3dmodel"))
+		{
+			return xml.getString("Target");
+		}
+	}
+	return std::string();
+}
+
+bool ThreeMfLoader::instantiate(const ObjectKey& key, const glm::mat4& transform, int depth, std::vector<Model::Instance>& instances)
+{
+	const auto object = objects.find(key);
+	if (object == objects.end() || depth > maxComponentDepth)
+	{
+		error = "3MF build references a missing or recursive object!";
+		return false;
+	}
+
+	if (!object->second->indices.empty())
+	{
+		const auto primitive = meshPrimitives.find(key);
+		if (primitive == meshPrimitives.end())
+		{
+			meshPrimitives[key] = meshes.size();
+			instances.push_back({ meshes.size(), transform });
+			meshes.push_back(object->second);
+		}
+		else
+		{
+			instances.push_back({ primitive->second, transform });
+		}
+	}
+
+	for (const Reference& component : object->second->components)
+	{
+		const ObjectKey componentKey(component.path.empty() ? key.first : component.path, component.objectId);
+		if (!instantiate(componentKey, transform * component.transform, depth + 1, instances))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
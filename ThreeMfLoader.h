@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Model.h"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 3MF package reader. Model parts are inflated and parsed in parallel, every mesh
+// object becomes one primitive in the shared buffers, and build items become instances.
+class ThreeMfLoader
+{
+public:
+	ThreeMfLoader() = default;
+	~ThreeMfLoader() = default;
+	bool load(const std::string& filename, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, std::vector<Model::Primitive>& primitives, std::vector<Model::Instance>& instances);
+	std::string getError() const;
+
+private:
+	struct Reference
+	{
+		std::string path;
+		int objectId;
+		glm::mat4 transform;
+	};
+
+	struct Object
+	{
+		int id;
+		std::vector<glm::vec3> vertices;
+		std::vector<unsigned int> indices;
+		std::vector<Reference> components;
+	};
+
+	struct Part
+	{
+		std::string path;
+		std::vector<Object> objects;
+		std::vector<Reference> buildItems;
+		std::string error;
+	};
+
+	typedef std::pair<std::string, int> ObjectKey;
+
+	static bool parsePart(const char* data, size_t size, Part& part);
+	static std::string findRootPart(const char* data, size_t size);
+	bool instantiate(const ObjectKey& key, const glm::mat4& transform, int depth, std::vector<Model::Instance>& instances);
+
+	std::map<ObjectKey, const Object*> objects;
+	std::map<ObjectKey, size_t> meshPrimitives;
+	std::vector<const Object*> meshes;
+	std::string error;
+};
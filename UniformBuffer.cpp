@@ -0,0 +1,86 @@
+#include "UniformBuffer.h"
+#include "GLState.h"
+#include <cstring>
+
+UniformBuffer::UniformBuffer(unsigned binding, size_t elementSize, StreamBuffer* stream) :
+	buffer(0),
+	binding(binding),
+	elementSize(elementSize),
+	alignment(256),
+	stride(elementSize),
+	capacity(0),
+	frame(0),
+	stream(stream),
+	streamed{}
+{
+	// Every element starts on a boundary the driver accepts for glBindBufferRange.
+	int boundary = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &boundary);
+	alignment = boundary > 0 ? static_cast<size_t>(boundary) : 256;
+	stride = (elementSize + alignment - 1) / alignment * alignment;
+
+	if (!stream)
+	{
+		glGenBuffers(1, &buffer);
+	}
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	if (buffer)
+	{
+		GLState::instance().deleteBuffers(1, &buffer);
+	}
+}
+
+void UniformBuffer::upload(const void* elements, size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	const char* source = static_cast<const char*>(elements);
+	if (stream)
+	{
+		streamed = stream->allocate(count * stride, alignment);
+		for (size_t i = 0; i < count; ++i)
+		{
+			std::memcpy(streamed.data + i * stride, source + i * elementSize, elementSize);
+		}
+		return;
+	}
+
+	GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+	if (count > capacity)
+	{
+		capacity = capacity ? capacity : 1;
+		while (capacity < count)
+		{
+			capacity *= 2;
+		}
+		glBufferData(GL_UNIFORM_BUFFER, frameCount * capacity * stride, nullptr, GL_DYNAMIC_DRAW);
+		staging.resize(capacity * stride);
+	}
+
+	frame = (frame + 1) % frameCount;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::memcpy(staging.data() + i * stride, source + i * elementSize, elementSize);
+	}
+
+	glBufferSubData(GL_UNIFORM_BUFFER, frame * capacity * stride, count * stride, staging.data());
+}
+
+void UniformBuffer::bind(size_t element) const
+{
+	if (stream)
+	{
+		GLState::instance().bindBufferRange(GL_UNIFORM_BUFFER, binding, streamed.buffer, static_cast<ptrdiff_t>(streamed.offset + element * stride), static_cast<ptrdiff_t>(elementSize));
+		return;
+	}
+
+	GLState::instance().bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, static_cast<ptrdiff_t>((frame * capacity + element) * stride), static_cast<ptrdiff_t>(elementSize));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "StreamBuffer.h"
+#include <cstddef>
+#include <vector>
+
+// Uniform buffer split into per-frame segments used in turn, so writing this frame's data
+// never waits for draws of the previous frames. All elements of a frame are written with
+// a single upload and bound one at a time by offset. Given a stream buffer, elements are
+// written straight into its mapped region for the frame instead, so they have to be
+// uploaded again every frame they are bound in.
+class UniformBuffer
+{
+public:
+	UniformBuffer(unsigned binding, size_t elementSize, StreamBuffer* stream = nullptr);
+	~UniformBuffer();
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+	void upload(const void* elements, size_t count);
+	void bind(size_t element) const;
+
+private:
+	static const size_t frameCount = 3;
+
+	unsigned buffer;
+	unsigned binding;
+	size_t elementSize;
+	size_t alignment;
+	size_t stride;
+	size_t capacity;
+	size_t frame;
+	std::vector<char> staging;
+	StreamBuffer* stream;
+	StreamBuffer::Allocation streamed;
+};
@@ -0,0 +1,159 @@
+#include "GLState.h"
+#include "Hash.h"
+#include "HeadlessContext.h"
+#include "Shader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// The normal transform of light.vert before and after normal matrices moved to the
+	// per-object data. The fragment shader reads the normal, so it is never optimized out.
+	const char* const vertexSource = R"(#version 400
+layout (location = 0) in vec3 vertex;
+layout (location = 1) in vec3 normal;
+out vec3 vertNormal;
+uniform mat4 modelMatrix;
+uniform mat4 normalMatrix;
+void main()
+{
+#ifdef INVERSE_PER_VERTEX
+	vertNormal = mat3(transpose(inverse(modelMatrix))) * normal;
+#else
+	vertNormal = mat3(normalMatrix) * normal;
+#endif
+	gl_Position = modelMatrix * vec4(vertex, 1.0);
+}
+)";
+
+	const char* const fragmentSource = R"(#version 400
+in vec3 vertNormal;
+out vec4 colour;
+void main()
+{
+	colour = vec4(vertNormal, 1.0);
+}
+)";
+
+	struct Options
+	{
+		size_t vertices = 10000000;
+		unsigned repeat = 5;
+	};
+
+	bool parseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i + 1 < argc; i += 2)
+		{
+			const std::string argument = argv[i];
+			char* end = nullptr;
+			const unsigned long long value = std::strtoull(argv[i + 1], &end, 10);
+			if (*end != '\0' || value == 0)
+			{
+				return false;
+			}
+
+			if (argument == "--vertices")
+			{
+				options.vertices = static_cast<size_t>(value);
+			}
+			else if (argument == "--repeat")
+			{
+				options.repeat = static_cast<unsigned>(value);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return argc % 2 == 1;
+	}
+
+	// Best of the repeats, in milliseconds, after one small draw that finishes compiling.
+	double measure(Shader& shader, size_t vertices, unsigned repeat)
+	{
+		const float matrix[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+		shader.setShader();
+		glUniformMatrix4fv(shader.getUniform(hashName("modelMatrix")), 1, GL_FALSE, matrix);
+		glUniformMatrix4fv(shader.getUniform(hashName("normalMatrix")), 1, GL_FALSE, matrix);
+		glDrawArrays(GL_POINTS, 0, 1000);
+		glFinish();
+
+		double best = 0.0;
+		for (unsigned run = 0; run < repeat; ++run)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(vertices));
+			glFinish();
+			const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			best = run == 0 ? milliseconds : std::min(best, milliseconds);
+		}
+		return best;
+	}
+}
+
+// Measures the vertex stage alone: random points are drawn with rasterizer discard, once
+// with the normal matrix inverted for every vertex and once with it passed in, as the
+// per-object data does. Times are the best of the repeats, in milliseconds:
+//   VertexBenchmark [--vertices n] [--repeat n]
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "Usage: %s [--vertices n] [--repeat n]\n", argv[0]);
+		return 2;
+	}
+
+	try
+	{
+		HeadlessContext context(64, 64, 1000.0f, 0.1f);
+
+		std::vector<float> data(options.vertices * 6);
+		for (float& value : data)
+		{
+			value = static_cast<float>(std::rand()) / RAND_MAX;
+		}
+
+		GLState& state = GLState::instance();
+		unsigned vao = 0;
+		unsigned vbo = 0;
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		state.bindVertexArray(vao);
+		state.bindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(data.size() * sizeof(float)), data.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), nullptr);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), reinterpret_cast<const void*>(3 * sizeof(float)));
+		state.setEnabled(GL_RASTERIZER_DISCARD, true);
+
+		Shader inverse(vertexSource, fragmentSource, "#define INVERSE_PER_VERTEX\n");
+		Shader precomputed(vertexSource, fragmentSource, "");
+		if (!inverse.finish() || !precomputed.finish())
+		{
+			std::fprintf(stderr, "%s%s\n", inverse.getError().c_str(), precomputed.getError().c_str());
+			return 1;
+		}
+
+		std::printf("%s\n%zu vertices, best of %u\n", context.getVideoCardInfo().c_str(), options.vertices, options.repeat);
+		std::printf("inverse per vertex: %.1f ms\n", measure(inverse, options.vertices, options.repeat));
+		std::printf("precomputed normal matrix: %.1f ms\n", measure(precomputed, options.vertices, options.repeat));
+
+		state.setEnabled(GL_RASTERIZER_DISCARD, false);
+		state.deleteVertexArrays(1, &vao);
+		state.deleteBuffers(1, &vbo);
+		return 0;
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,191 @@
+#include "ZipArchive.h"
+#include "Inflater.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const uint32_t endOfDirectorySignature = 0x06054b50;
+	const uint32_t zip64LocatorSignature = 0x07064b50;
+	const uint32_t zip64EndOfDirectorySignature = 0x06064b50;
+	const uint32_t directoryEntrySignature = 0x02014b50;
+	const uint32_t localHeaderSignature = 0x04034b50;
+
+	template <typename T>
+	T readValue(const char* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+}
+
+ZipArchive::ZipArchive(const std::string& filename) :
+	file(filename),
+	isValid(false)
+{
+	if (!file.isOpen())
+	{
+		error = "Cannot open archive!";
+		return;
+	}
+
+	isValid = readCentralDirectory();
+}
+
+bool ZipArchive::isOpen() const
+{
+	return isValid;
+}
+
+const std::vector<ZipArchive::Entry>& ZipArchive::getEntries() const
+{
+	return entries;
+}
+
+bool ZipArchive::extract(const Entry& entry, std::vector<char>& out) const
+{
+	const char* data = file.data();
+	const uint64_t size = file.size();
+
+	if (size < 30 || entry.localHeaderOffset > size - 30 || readValue<uint32_t>(data + entry.localHeaderOffset) != localHeaderSignature)
+	{
+		return false;
+	}
+
+	const char* header = data + entry.localHeaderOffset;
+	const uint64_t dataOffset = entry.localHeaderOffset + 30 + readValue<uint16_t>(header + 26) + readValue<uint16_t>(header + 28);
+	if (dataOffset > size || entry.compressedSize > size - dataOffset)
+	{
+		return false;
+	}
+
+	const char* compressed = data + dataOffset;
+	switch (entry.method)
+	{
+	case 0:
+		out.assign(compressed, compressed + entry.compressedSize);
+		return entry.compressedSize == entry.uncompressedSize;
+	case 8:
+		return Inflater::inflate(compressed, static_cast<size_t>(entry.compressedSize), out, static_cast<size_t>(entry.uncompressedSize));
+	default:
+		return false;
+	}
+}
+
+std::string ZipArchive::getError() const
+{
+	return error;
+}
+
+bool ZipArchive::readCentralDirectory()
+{
+	const char* data = file.data();
+	const size_t size = file.size();
+	if (size < 22)
+	{
+		error = "Archive is too small!";
+		return false;
+	}
+
+	// The end-of-directory record sits before a comment of up to 64 KB.
+	size_t end = size - 22;
+	const size_t searchLimit = end > 0xFFFF ? end - 0xFFFF : 0;
+	while (readValue<uint32_t>(data + end) != endOfDirectorySignature)
+	{
+		if (end == searchLimit)
+		{
+			error = "Archive has no central directory!";
+			return false;
+		}
+		--end;
+	}
+
+	uint64_t entryCount = readValue<uint16_t>(data + end + 10);
+	uint64_t directorySize = readValue<uint32_t>(data + end + 12);
+	uint64_t directoryOffset = readValue<uint32_t>(data + end + 16);
+
+	if (end >= 20 && readValue<uint32_t>(data + end - 20) == zip64LocatorSignature)
+	{
+		const uint64_t zip64End = readValue<uint64_t>(data + end - 20 + 8);
+		if (size < 56 || zip64End > size - 56 || readValue<uint32_t>(data + zip64End) != zip64EndOfDirectorySignature)
+		{
+			error = "Archive has a corrupt Zip64 directory!";
+			return false;
+		}
+		entryCount = readValue<uint64_t>(data + zip64End + 32);
+		directorySize = readValue<uint64_t>(data + zip64End + 40);
+		directoryOffset = readValue<uint64_t>(data + zip64End + 48);
+	}
+
+	if (directoryOffset > size || directorySize > size - directoryOffset)
+	{
+		error = "Archive central directory is out of range!";
+		return false;
+	}
+
+	const char* record = data + directoryOffset;
+	const char* directoryEnd = record + directorySize;
+	// Every record takes at least 46 bytes, so the count cannot be trusted past that.
+	entries.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, directorySize / 46)));
+
+	for (uint64_t i = 0; i < entryCount; ++i)
+	{
+		if (directoryEnd - record < 46 || readValue<uint32_t>(record) != directoryEntrySignature)
+		{
+			error = "Archive central directory is corrupt!";
+			return false;
+		}
+
+		const uint16_t flags = readValue<uint16_t>(record + 8);
+		const uint16_t nameLength = readValue<uint16_t>(record + 28);
+		const uint16_t extraLength = readValue<uint16_t>(record + 30);
+		const uint16_t commentLength = readValue<uint16_t>(record + 32);
+		if (directoryEnd - record < 46 + nameLength + extraLength + commentLength)
+		{
+			error = "Archive central directory is corrupt!";
+			return false;
+		}
+
+		Entry entry;
+		entry.name.assign(record + 46, nameLength);
+		entry.method = (flags & 1) ? 0xFFFF : readValue<uint16_t>(record + 10);
+		entry.compressedSize = readValue<uint32_t>(record + 20);
+		entry.uncompressedSize = readValue<uint32_t>(record + 24);
+		entry.localHeaderOffset = readValue<uint32_t>(record + 42);
+
+		// Zip64 extra fields only carry the values whose 32-bit fields are saturated.
+		const char* extra = record + 46 + nameLength;
+		const char* extraEnd = extra + extraLength;
+		while (extraEnd - extra >= 4)
+		{
+			const uint16_t id = readValue<uint16_t>(extra);
+			const uint16_t length = readValue<uint16_t>(extra + 2);
+			const char* field = extra + 4;
+			const char* fieldEnd = field + length;
+			if (fieldEnd > extraEnd)
+			{
+				break;
+			}
+
+			if (id == 0x0001)
+			{
+				uint64_t* values[3] = { &entry.uncompressedSize, &entry.compressedSize, &entry.localHeaderOffset };
+				for (uint64_t* value : values)
+				{
+					if (*value == 0xFFFFFFFF && fieldEnd - field >= 8)
+					{
+						*value = readValue<uint64_t>(field);
+						field += 8;
+					}
+				}
+			}
+			extra = fieldEnd;
+		}
+
+		entries.push_back(entry);
+		record += 46 + nameLength + extraLength + commentLength;
+	}
+
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+
+// Read-only access to the entries of a (Zip64-aware) zip file through a memory mapping.
+class ZipArchive
+{
+public:
+	struct Entry
+	{
+		std::string name;
+		unsigned method;
+		uint64_t compressedSize;
+		uint64_t uncompressedSize;
+		uint64_t localHeaderOffset;
+	};
+
+	ZipArchive(const std::string& filename);
+	~ZipArchive() = default;
+	bool isOpen() const;
+	const std::vector<Entry>& getEntries() const;
+	bool extract(const Entry& entry, std::vector<char>& out) const;
+	std::string getError() const;
+
+private:
+	bool readCentralDirectory();
+
+	MappedFile file;
+	std::vector<Entry> entries;
+	bool isValid;
+	std::string error;
+};
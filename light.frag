@@ -1,28 +1,66 @@
 #version 400
 
 in vec3 vert;
+#ifdef NORMAL_ATTRIBUTE
 in vec3 vertNormal;
+#endif
+#if defined(INSTANCED) || defined(BATCHED)
+flat in vec4 vertColour;
+flat in vec4 vertMaterial;
+#else
+#define vertColour objColour
+#define vertMaterial material
+#endif
 
 out vec4 fragColor;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec4 objColour;
+layout (std140) uniform Frame
+{
+   mat4 viewMatrix;
+   mat4 projectionMatrix;
+   mat4 viewProjectionMatrix;
+   vec4 cameraPosition;
+   vec4 ambientLight;
+   vec4 lightPositions[4];
+   vec4 lightColours[4];
+   vec4 clipPlanes[4];
+};
+
+#ifndef BATCHED
+layout (std140) uniform Object
+{
+   mat4 modelMatrix;
+   mat4 normalMatrix;
+   vec4 objColour;
+   vec4 material;
+   vec4 positionScale;
+   vec4 positionOffset;
+};
+#endif
 
 void main()
 {
-   vec3 lightColor = vec3(1.0, 1.0, 1.0);
-   float ambientStrength = 0.1;
-   vec3 ambient = ambientStrength * lightColor;
-   vec3 lightDir  = normalize(lightPos - vert);
+#if defined(LIGHTING_DIFFUSE) || defined(LIGHTING_SPECULAR)
+#ifdef NORMAL_ATTRIBUTE
    vec3 norm = normalize(vertNormal);
-   float diff = max(dot(norm, lightDir), 0.0);
-   vec3 diffuse = diff * lightColor;
-   float specularStrength = 0.5;
-   vec3 viewDir = normalize(viewPos - vert);
-   vec3 reflectDir = reflect(-lightDir, norm);
-   float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-   vec3 specular = specularStrength * spec * lightColor;
-   
-   fragColor = vec4(ambient + diffuse + specular, 1.0) * objColour;
+#else
+   vec3 norm = normalize(cross(dFdx(vert), dFdy(vert)));
+#endif
+#ifdef LIGHTING_SPECULAR
+   vec3 viewDir = normalize(cameraPosition.xyz - vert);
+#endif
+   vec3 light = ambientLight.rgb;
+   for (int i = 0; i < LIGHT_COUNT; ++i)
+   {
+      vec3 lightDir = normalize(lightPositions[i].xyz - vert);
+      light += max(dot(norm, lightDir), 0.0) * lightColours[i].rgb;
+#ifdef LIGHTING_SPECULAR
+      vec3 reflectDir = reflect(-lightDir, norm);
+      light += vertMaterial.x * pow(max(dot(viewDir, reflectDir), 0.0), vertMaterial.y) * lightColours[i].rgb;
+#endif
+   }
+   fragColor = vec4(light, 1.0) * vertColour;
+#else
+   fragColor = vertColour;
+#endif
 }
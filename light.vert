@@ -1,18 +1,124 @@
 #version 400
 
+// Feature defines are inserted after the version line by ShaderLibrary:
+// QUANTIZED, INSTANCED, BATCHED, NORMAL_ATTRIBUTE, LIGHTING_DIFFUSE, LIGHTING_SPECULAR,
+// LIGHT_COUNT and CLIP_PLANES. Without NORMAL_ATTRIBUTE the fragment shader derives
+// flat normals. INSTANCED places every draw once per copy with per-instance attributes.
+// BATCHED programs are built as GLSL 4.30 and read per-draw data from the Objects
+// storage buffer, for glMultiDrawElementsIndirect. DrawIndices maps each draw of a
+// batch to its object, since culling may leave out draws.
+
+#ifdef BATCHED
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
 layout (location = 0) in vec3 vertex;
 layout (location = 1) in vec3 normal;
+#ifdef INSTANCED
+layout (location = 2) in mat4 instanceMatrix;
+layout (location = 6) in mat3 instanceNormalMatrix;
+layout (location = 9) in vec4 instanceColour;
+#endif
 
 out vec3 vert;
+#ifdef NORMAL_ATTRIBUTE
 out vec3 vertNormal;
+#endif
+#if defined(INSTANCED) || defined(BATCHED)
+flat out vec4 vertColour;
+flat out vec4 vertMaterial;
+#endif
+
+layout (std140) uniform Frame
+{
+   mat4 viewMatrix;
+   mat4 projectionMatrix;
+   mat4 viewProjectionMatrix;
+   vec4 cameraPosition;
+   vec4 ambientLight;
+   vec4 lightPositions[4];
+   vec4 lightColours[4];
+   vec4 clipPlanes[4];
+};
+
+#ifdef BATCHED
+struct ObjectData
+{
+   mat4 modelMatrix;
+   mat4 normalMatrix;
+   vec4 objColour;
+   vec4 material;
+   vec4 positionScale;
+   vec4 positionOffset;
+};
+
+layout (std430) readonly buffer Objects
+{
+   ObjectData objects[];
+};
+
+layout (std430) readonly buffer DrawIndices
+{
+   uint drawIndices[];
+};
+
+uniform uint drawBase;
+#else
+layout (std140) uniform Object
+{
+   mat4 modelMatrix;
+   mat4 normalMatrix;
+   vec4 objColour;
+   vec4 material;
+   vec4 positionScale;
+   vec4 positionOffset;
+};
+#endif
 
-uniform mat4 projectionMatrix;
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
+#if CLIP_PLANES > 0
+out float gl_ClipDistance[CLIP_PLANES];
+#endif
 
 void main()
 {
-   vert = vec3(modelMatrix * vec4(vertex, 1.0));
-   vertNormal = mat3(transpose(inverse(modelMatrix))) * normal;
-   gl_Position = projectionMatrix * viewMatrix * vec4(vert, 1.0);
+#ifdef BATCHED
+   ObjectData object = objects[drawIndices[drawBase + uint(gl_DrawIDARB)]];
+   mat4 modelMatrix = object.modelMatrix;
+   mat4 normalMatrix = object.normalMatrix;
+   vec4 objColour = object.objColour;
+   vec4 material = object.material;
+   vec4 positionScale = object.positionScale;
+   vec4 positionOffset = object.positionOffset;
+#endif
+#ifdef QUANTIZED
+   vec3 position = vertex * positionScale.xyz + positionOffset.xyz;
+#else
+   vec3 position = vertex;
+#endif
+#ifdef INSTANCED
+   vert = vec3(instanceMatrix * (modelMatrix * vec4(position, 1.0)));
+   vertColour = instanceColour;
+#else
+   vert = vec3(modelMatrix * vec4(position, 1.0));
+#endif
+#if defined(BATCHED) && !defined(INSTANCED)
+   vertColour = objColour;
+#endif
+#if defined(INSTANCED) || defined(BATCHED)
+   vertMaterial = material;
+#endif
+#ifdef NORMAL_ATTRIBUTE
+#ifdef INSTANCED
+   vertNormal = instanceNormalMatrix * (mat3(normalMatrix) * normal);
+#else
+   vertNormal = mat3(normalMatrix) * normal;
+#endif
+#endif
+#if CLIP_PLANES > 0
+   for (int i = 0; i < CLIP_PLANES; ++i)
+   {
+      gl_ClipDistance[i] = dot(clipPlanes[i], vec4(vert, 1.0));
+   }
+#endif
+   gl_Position = viewProjectionMatrix * vec4(vert, 1.0);
 }
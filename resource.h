@@ -14,6 +14,8 @@
 #define IDR_MAINFRAME                   128
 #define IDR_SHADER_V                    134
 #define IDR_SHADER_F                    135
+#define IDR_SHADER_C                    136
+#define IDR_SHADER_D                    137
 #define ID_FILE_LOADMODEL               32771
 #define IDC_STATIC                      -1
 
@@ -22,7 +24,7 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NO_MFC                     1
-#define _APS_NEXT_RESOURCE_VALUE        136
+#define _APS_NEXT_RESOURCE_VALUE        138
 #define _APS_NEXT_COMMAND_VALUE         32772
 #define _APS_NEXT_CONTROL_VALUE         1000
 #define _APS_NEXT_SYMED_VALUE           110